@@ -0,0 +1,63 @@
+// Copyright (c) 2020-2021 AVME Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+#include <benchmark/benchmark.h>
+
+#include <core/ABI.h>
+#include <core/Utils.h>
+#include <network/Pangolin.h>
+
+// Benchmarks for the wallet core conversion, ABI and Pangolin helpers.
+
+static void BM_Utils_uintToHex(benchmark::State& state) {
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(Utils::uintToHex("1000000000000000000"));
+  }
+}
+BENCHMARK(BM_Utils_uintToHex);
+
+static void BM_Utils_fixedPointToWei(benchmark::State& state) {
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(Utils::fixedPointToWei("1234.567890123456789", 18));
+  }
+}
+BENCHMARK(BM_Utils_fixedPointToWei);
+
+static void BM_Utils_weiToFixedPoint(benchmark::State& state) {
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(Utils::weiToFixedPoint("1234567890123456789012", 18));
+  }
+}
+BENCHMARK(BM_Utils_weiToFixedPoint);
+
+static void BM_ABI_encodeABIfromJson(benchmark::State& state) {
+  // Same example as in the ABI::encodeABIfromJson docs
+  const std::string input = "{\"function\": \"f(uint256,uint32[],bytes10[],bytes)\","
+    "\"args\": [\"0x123\", [\"0x456\", \"0x789\"], [\"1234567890\", \"1234567890\"], \"Hello, world!\"],"
+    "\"types\": [\"uint*\", \"uint*[]\", \"bytes*[]\", \"bytes\"]}";
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(ABI::encodeABIfromJson(input));
+  }
+}
+BENCHMARK(BM_ABI_encodeABIfromJson);
+
+static void BM_Pangolin_parseHex(benchmark::State& state) {
+  // getReserves() output: reserve0, reserve1, blockTimestampLast
+  const std::string hex = "0x"
+    "00000000000000000000000000000000000000000000021e19e0c9bab2400000"
+    "0000000000000000000000000000000000000000000000056bc75e2d63100000"
+    "0000000000000000000000000000000000000000000000000000000060c7a1f0";
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(Pangolin::parseHex(hex, {"uint", "uint", "uint"}));
+  }
+}
+BENCHMARK(BM_Pangolin_parseHex);
+
+static void BM_Pangolin_calcExchangeAmountOut(benchmark::State& state) {
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(Pangolin::calcExchangeAmountOut(
+      "1000000000000000000", "10000000000000000000000", "100000000000000000000"
+    ));
+  }
+}
+BENCHMARK(BM_Pangolin_calcExchangeAmountOut);
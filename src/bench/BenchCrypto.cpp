@@ -0,0 +1,195 @@
+// Copyright (c) 2020-2021 AVME Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+#include <benchmark/benchmark.h>
+
+#include <boost/filesystem.hpp>
+
+#include <lib/devcore/RLP.h>
+#include <lib/devcore/SHA3.h>
+#include <lib/devcrypto/Common.h>
+#include <lib/devcrypto/KDF.h>
+#include <lib/devcrypto/SecretStore.h>
+#include <lib/ethcore/TransactionBase.h>
+
+#include <core/Utils.h>
+
+using namespace dev;
+using namespace dev::eth;
+
+// Benchmarks for the hashing, RLP, signing and keystore primitives.
+
+// Build a simple signed AVAX transfer for the sign/recover benchmarks.
+static TransactionSkeleton benchSkeleton() {
+  TransactionSkeleton txSkel;
+  txSkel.creation = false;
+  txSkel.from = Address("0x1111111111111111111111111111111111111111");
+  txSkel.to = Address("0x2222222222222222222222222222222222222222");
+  txSkel.value = u256("1000000000000000000");
+  txSkel.nonce = 42;
+  txSkel.gas = 21000;
+  txSkel.gasPrice = u256("225000000000");
+  txSkel.chainId = 43114;
+  return txSkel;
+}
+
+static void BM_SHA3(benchmark::State& state) {
+  bytes input(state.range(0), 0xAB);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(dev::sha3(input));
+  }
+  state.SetBytesProcessed(int64_t(state.iterations()) * state.range(0));
+}
+BENCHMARK(BM_SHA3)->Arg(32)->Arg(64)->Arg(136)->Arg(1024);
+
+// Hashing 256 inputs of the same size one by one vs. with sha3Batch
+// (40 = an address in Hex for EIP-55, 64 = a public key, 200 = a small transaction).
+static void BM_SHA3_loop(benchmark::State& state) {
+  std::vector<bytes> inputs(256, bytes(state.range(0), 0xAB));
+  for (auto _ : state) {
+    for (const bytes& input : inputs) benchmark::DoNotOptimize(dev::sha3(input));
+  }
+  state.SetItemsProcessed(int64_t(state.iterations()) * inputs.size());
+}
+BENCHMARK(BM_SHA3_loop)->Arg(40)->Arg(64)->Arg(200);
+
+static void BM_SHA3_batch(benchmark::State& state) {
+  std::vector<bytes> inputs(256, bytes(state.range(0), 0xAB));
+  std::vector<bytesConstRef> refs;
+  for (const bytes& input : inputs) refs.push_back(bytesConstRef(&input));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(dev::sha3Batch(refs));
+  }
+  state.SetItemsProcessed(int64_t(state.iterations()) * inputs.size());
+}
+BENCHMARK(BM_SHA3_batch)->Arg(40)->Arg(64)->Arg(200);
+
+static void BM_toCamelCaseAddress(benchmark::State& state) {
+  std::string address = "0x5aaeb6053f3e94c9b9a09f33669435e7ef1beaed";
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(Utils::toCamelCaseAddress(address));
+  }
+}
+BENCHMARK(BM_toCamelCaseAddress);
+
+static void BM_formatAddress(benchmark::State& state) {
+  Address a;
+  Utils::parseAddress(std::string("0x5aaeb6053f3e94c9b9a09f33669435e7ef1beaed"), a);
+  char buf[42];
+  for (auto _ : state) {
+    Utils::formatAddress(a, buf, true);
+    benchmark::DoNotOptimize(buf);
+  }
+}
+BENCHMARK(BM_formatAddress);
+
+static void BM_RLP_encode(benchmark::State& state) {
+  TransactionBase t(benchSkeleton(), Secret(sha3("avme-bench")));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(t.rlp());
+  }
+}
+BENCHMARK(BM_RLP_encode);
+
+static void BM_RLP_decode(benchmark::State& state) {
+  bytes rlp = TransactionBase(benchSkeleton(), Secret(sha3("avme-bench"))).rlp();
+  for (auto _ : state) {
+    RLP r(rlp);
+    u256 nonce = r[0].toInt<u256>();
+    Address to = r[3].toHash<Address>(RLP::VeryStrict);
+    u256 value = r[4].toInt<u256>();
+    benchmark::DoNotOptimize(nonce);
+    benchmark::DoNotOptimize(to);
+    benchmark::DoNotOptimize(value);
+  }
+}
+BENCHMARK(BM_RLP_decode);
+
+static void BM_TransactionBase_sign(benchmark::State& state) {
+  Secret s(sha3("avme-bench"));
+  TransactionSkeleton txSkel = benchSkeleton();
+  for (auto _ : state) {
+    TransactionBase t(txSkel);
+    t.sign(s);
+    benchmark::DoNotOptimize(t.signature());
+  }
+}
+BENCHMARK(BM_TransactionBase_sign);
+
+static void BM_TransactionBase_sender(benchmark::State& state) {
+  bytes rlp = TransactionBase(benchSkeleton(), Secret(sha3("avme-bench"))).rlp();
+  for (auto _ : state) {
+    // Sender is cached inside the transaction, so decode a fresh one each time
+    TransactionBase t(rlp, CheckTransaction::None);
+    benchmark::DoNotOptimize(t.sender());
+  }
+}
+BENCHMARK(BM_TransactionBase_sender);
+
+// Signing/recovering a batch of 256 hashes on 1, 2 and 4 threads.
+static void BM_signBatch(benchmark::State& state) {
+  Secret s(sha3("avme-bench"));
+  h256s hashes;
+  for (int i = 0; i < 256; i++) hashes.push_back(sha3(std::to_string(i)));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(dev::signBatch(s, hashes, state.range(0)));
+  }
+  state.SetItemsProcessed(state.iterations() * hashes.size());
+}
+BENCHMARK(BM_signBatch)->Arg(1)->Arg(2)->Arg(4)->UseRealTime();
+
+static void BM_recoverBatch(benchmark::State& state) {
+  Secret s(sha3("avme-bench"));
+  std::vector<std::pair<Signature, h256>> items;
+  for (int i = 0; i < 256; i++) {
+    h256 hash = sha3(std::to_string(i));
+    items.emplace_back(dev::sign(s, hash), hash);
+  }
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(dev::recoverBatch(items, state.range(0)));
+  }
+  state.SetItemsProcessed(state.iterations() * items.size());
+}
+BENCHMARK(BM_recoverBatch)->Arg(1)->Arg(2)->Arg(4)->UseRealTime();
+
+static void BM_SecretStore_encrypt(benchmark::State& state) {
+  boost::filesystem::path keysPath = boost::filesystem::temp_directory_path()
+    / boost::filesystem::unique_path("avme-bench-%%%%-%%%%");
+  SecretStore store(keysPath);
+  Secret s(sha3("avme-bench"));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(store.importSecret(s.ref(), "password"));
+  }
+  boost::filesystem::remove_all(keysPath);
+}
+BENCHMARK(BM_SecretStore_encrypt)->Unit(benchmark::kMillisecond)->Iterations(5);
+
+static void BM_SecretStore_decrypt(benchmark::State& state) {
+  boost::filesystem::path keysPath = boost::filesystem::temp_directory_path()
+    / boost::filesystem::unique_path("avme-bench-%%%%-%%%%");
+  SecretStore store(keysPath);
+  h128 uuid = store.importSecret(Secret(sha3("avme-bench")).ref(), "password");
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(store.secret(uuid, []{ return std::string("password"); }, false));
+  }
+  boost::filesystem::remove_all(keysPath);
+}
+BENCHMARK(BM_SecretStore_decrypt)->Unit(benchmark::kMillisecond)->Iterations(5);
+
+static void BM_PBKDF2(benchmark::State& state) {
+  bytes salt = h256::random().asBytes();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(dev::pbkdf2("password", salt, state.range(0), 32));
+  }
+}
+BENCHMARK(BM_PBKDF2)->Arg(4096)->Arg(262144)->Unit(benchmark::kMillisecond);
+
+// Same total work (n * p) split into 1, 2 and 4 lanes.
+static void BM_ScryptLanes(benchmark::State& state) {
+  bytes salt = h256::random().asBytes();
+  uint32_t p = state.range(0);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(dev::scryptParallel("password", bytesConstRef(&salt), (1 << 16) / p, 8, p, 32));
+  }
+}
+BENCHMARK(BM_ScryptLanes)->Arg(1)->Arg(2)->Arg(4)->Unit(benchmark::kMillisecond)->UseRealTime();
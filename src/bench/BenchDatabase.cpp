@@ -0,0 +1,74 @@
+// Copyright (c) 2020-2021 AVME Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+#include <benchmark/benchmark.h>
+
+#include <boost/filesystem.hpp>
+
+#include <core/Database.h>
+#include <core/Utils.h>
+
+// Benchmarks for the LevelDB-backed token database.
+
+// Open a token database in a fresh temp wallet folder, filled with a given number of entries.
+static boost::filesystem::path openBenchDB(Database& db, int entries) {
+  boost::filesystem::path folder = boost::filesystem::temp_directory_path()
+    / boost::filesystem::unique_path("avme-bench-%%%%-%%%%");
+  Utils::walletFolderPath = folder;
+  db.openTokenDB();
+  for (int i = 0; i < entries; i++) {
+    db.putTokenDBValue(Address(unsigned(i)), std::string(128, 'x'));
+  }
+  return folder;
+}
+
+static void closeBenchDB(Database& db, boost::filesystem::path folder) {
+  db.closeTokenDB();
+  boost::filesystem::remove_all(folder);
+  Utils::walletFolderPath = "";
+}
+
+static void BM_Database_put(benchmark::State& state) {
+  Database db;
+  boost::filesystem::path folder = openBenchDB(db, 0);
+  int i = 0;
+  std::string value(128, 'x');
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(db.putTokenDBValue(Address(unsigned(i++)), value));
+  }
+  closeBenchDB(db, folder);
+}
+BENCHMARK(BM_Database_put);
+
+static void BM_Database_get(benchmark::State& state) {
+  Database db;
+  boost::filesystem::path folder = openBenchDB(db, 1000);
+  int i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(db.getTokenDBValue(Address(unsigned(i++ % 1000))));
+  }
+  closeBenchDB(db, folder);
+}
+BENCHMARK(BM_Database_get);
+
+static void BM_Database_exists(benchmark::State& state) {
+  Database db;
+  boost::filesystem::path folder = openBenchDB(db, 1000);
+  int i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(db.tokenDBKeyExists(Address(unsigned(i++ % 1000))));
+  }
+  closeBenchDB(db, folder);
+}
+BENCHMARK(BM_Database_exists);
+
+static void BM_Database_iterate(benchmark::State& state) {
+  Database db;
+  boost::filesystem::path folder = openBenchDB(db, state.range(0));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(db.getAllTokenDBValues());
+  }
+  state.SetItemsProcessed(int64_t(state.iterations()) * state.range(0));
+  closeBenchDB(db, folder);
+}
+BENCHMARK(BM_Database_iterate)->Arg(100)->Arg(1000);
@@ -0,0 +1,29 @@
+// Copyright (c) 2020-2021 AVME Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+// Microbenchmarks for the wallet core and devcore primitives.
+// Results are printed as JSON by default so they can be stored and compared
+// between releases, e.g. `./avme-bench --benchmark_out=bench.json`.
+// Pass --benchmark_format=console to get the human-readable table instead.
+
+int main(int argc, char *argv[]) {
+  std::vector<char*> args(argv, argv + argc);
+  bool hasFormat = false;
+  for (int i = 1; i < argc; i++) {
+    if (std::strncmp(argv[i], "--benchmark_format", 18) == 0) hasFormat = true;
+  }
+  static char jsonFormat[] = "--benchmark_format=json";
+  if (!hasFormat) args.push_back(jsonFormat);
+  int count = static_cast<int>(args.size());
+
+  benchmark::Initialize(&count, args.data());
+  if (benchmark::ReportUnrecognizedArguments(count, args.data())) return 1;
+  benchmark::RunSpecifiedBenchmarks();
+  return 0;
+}
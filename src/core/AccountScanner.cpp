@@ -0,0 +1,138 @@
+// Copyright (c) 2020-2021 AVME Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+#include "AccountScanner.h"
+
+std::size_t AccountScanner::chunkSize = 50;
+uint32_t AccountScanner::defaultGapLimit = 20;
+uint32_t AccountScanner::maxGapLimit = 100;
+std::chrono::milliseconds AccountScanner::scanTimeout(10000);
+
+std::vector<AccountRecord> AccountScanner::deriveAccounts(
+  const std::string& phrase, uint32_t start, uint32_t count
+) {
+  // Hardened indexes aren't Accounts, the range stops before them
+  count = (start > BIP39::maxAccountIndex) ? 0 : std::min(count, BIP39::maxAccountIndex - start + 1);
+  std::vector<AccountRecord> ret(count);
+  if (count == 0) return ret;
+  std::shared_ptr<BIP39::DerivationContext> ctx = BIP39::getDerivationContext(phrase);
+
+  // Each worker takes a contiguous slice, deriving a child only
+  // needs the (read-only) parent node so no locking is required
+  unsigned workers = std::max(1u, std::thread::hardware_concurrency());
+  workers = std::min<unsigned>(workers, count);
+  uint32_t slice = (count + workers - 1) / workers;
+  auto deriveSlice = [&](uint32_t from, uint32_t to) {
+    for (uint32_t i = from; i < to; i++) {
+      bip3x::HDKey childKey = ctx->deriveChild(start + i);
+      KeyPair k(Secret::frombip3x(childKey.privateKey));
+      childKey.clear();
+      ret[i].index = start + i;
+      ret[i].address = "0x" + k.address().hex();
+    }
+  };
+  std::vector<std::thread> threads;
+  for (uint32_t from = slice; from < count; from += slice) {
+    threads.emplace_back(deriveSlice, from, std::min(from + slice, count));
+  }
+  deriveSlice(0, std::min(slice, count));
+  for (std::thread& t : threads) t.join();
+  return ret;
+}
+
+// Fetch balance and nonce for records [from, to) in a single batched request.
+static bool fetchChunk(std::vector<AccountRecord>& records, std::size_t from, std::size_t to) {
+  std::vector<Request> reqs;
+  for (std::size_t i = from; i < to; i++) {
+    uint64_t id = (i - from) * 2;
+    reqs.push_back({id + 1, "2.0", "eth_getBalance", {records[i].address, "latest"}});
+    reqs.push_back({id + 2, "2.0", "eth_getTransactionCount", {records[i].address, "latest"}});
+  }
+  std::string resp = API::httpGetRequest(API::buildMultiRequest(reqs));
+  if (resp.empty()) return false;
+  try {
+    // Batch answers may come in any order, so match them by id
+    json respArr = json::parse(resp);
+    if (!respArr.is_array()) throw std::runtime_error("not a batch response");
+    std::size_t answered = 0;
+    for (const json& r : respArr) {
+      if (!r.contains("id") || !r.contains("result") || !r["id"].is_number()) continue;
+      uint64_t id = r["id"].get<uint64_t>();
+      if (id < 1 || id > reqs.size()) continue;
+      std::size_t i = from + (id - 1) / 2;
+      u256 value = boost::lexical_cast<HexTo<u256>>(r["result"].get<std::string>());
+      if (id % 2 == 1) records[i].balance = value; else records[i].nonce = value;
+      answered++;
+    }
+    if (answered != reqs.size()) throw std::runtime_error("incomplete batch response");
+  } catch (std::exception const& e) {
+    Utils::logToDebug(std::string("Account state lookup failed: ") + e.what());
+    return false;
+  }
+  for (std::size_t i = from; i < to; i++) records[i].fetched = true;
+  return true;
+}
+
+bool AccountScanner::fetchAccountStates(std::vector<AccountRecord>& records) {
+  // Chunks write to disjoint ranges of the vector, so they can run in parallel
+  std::vector<std::future<bool>> futures;
+  for (std::size_t from = 0; from < records.size(); from += chunkSize) {
+    std::size_t to = std::min(from + chunkSize, records.size());
+    futures.push_back(std::async(std::launch::async, fetchChunk, std::ref(records), from, to));
+  }
+  bool ret = true;
+  for (std::future<bool>& f : futures) ret = f.get() && ret;
+  return ret;
+}
+
+std::vector<AccountRecord> AccountScanner::scan(
+  const std::string& phrase, uint32_t start, uint32_t count
+) {
+  std::vector<AccountRecord> ret = deriveAccounts(phrase, start, count);
+
+  // The lookup works on its own copy, so a slow node can be left behind
+  std::shared_ptr<std::vector<AccountRecord>> records = std::make_shared<std::vector<AccountRecord>>(ret);
+  std::shared_ptr<std::promise<void>> done = std::make_shared<std::promise<void>>();
+  std::future<void> fetched = done->get_future();
+  std::thread([records, done](){
+    fetchAccountStates(*records);
+    done->set_value();
+  }).detach();
+  if (fetched.wait_for(scanTimeout) == std::future_status::ready) {
+    ret = std::move(*records);
+  } else {
+    Utils::logToDebug("Account state lookup timed out for index " + std::to_string(start));
+  }
+  return ret;
+}
+
+std::vector<AccountRecord> AccountScanner::discover(
+  const std::string& phrase, uint32_t gapLimit, uint32_t maxAccounts,
+  std::function<void(const AccountRecord&)> onRecord
+) {
+  // Scan in windows of at least one full gap, so a single window
+  // is enough to end the discovery for unused seeds
+  gapLimit = std::min(gapLimit, maxGapLimit);
+  maxAccounts = std::min(maxAccounts, BIP39::maxAccountIndex + 1);
+  uint32_t window = std::max<uint32_t>(std::max<uint32_t>(gapLimit, 1), chunkSize);
+  std::vector<AccountRecord> ret;
+  int64_t lastUsed = -1;
+  uint32_t next = 0;
+  while (next < maxAccounts && (int64_t(next) - lastUsed - 1) < gapLimit) {
+    uint32_t count = std::min(window, maxAccounts - next);
+    std::vector<AccountRecord> records = deriveAccounts(phrase, next, count);
+    bool ok = fetchAccountStates(records);
+    for (AccountRecord& r : records) {
+      if (r.used()) lastUsed = r.index;
+      if (onRecord) onRecord(r);
+      ret.push_back(std::move(r));
+    }
+    next += count;
+    if (!ok) {
+      Utils::logToDebug("Account discovery stopped at index " + std::to_string(next));
+      return ret;
+    }
+  }
+  ret.resize(lastUsed + 1);
+  return ret;
+}
@@ -0,0 +1,93 @@
+// Copyright (c) 2020-2021 AVME Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+#ifndef ACCOUNTSCANNER_H
+#define ACCOUNTSCANNER_H
+
+#include <chrono>
+#include <functional>
+#include <future>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <core/BIP39.h>
+#include <core/Utils.h>
+#include <network/API.h>
+
+// Struct for an Account derived from a seed, and its on-chain state.
+typedef struct AccountRecord {
+  uint32_t index = 0;       // Last index of the derivation path ("m/44'/60'/0'/0/<index>")
+  std::string address;      // "0x"-prefixed address
+  u256 balance = 0;         // AVAX balance in Wei
+  u256 nonce = 0;           // Number of sent transactions
+  bool fetched = false;     // Whether balance and nonce were fetched successfully
+
+  // An Account counts as used if it ever sent a transaction or holds funds.
+  bool used() const { return (nonce > 0 || balance > 0); }
+} AccountRecord;
+
+/**
+ * Class for discovering the Accounts that belong to a BIP39 seed.
+ * Addresses are derived in parallel from a shared DerivationContext,
+ * and their balances/nonces are fetched with one batched JSON-RPC request
+ * per chunk (chunks are also sent in parallel). Discovery follows the
+ * BIP44 gap limit rule: scanning stops after N consecutive unused Accounts.
+ */
+class AccountScanner {
+  public:
+    // Number of Accounts per batched request (each one takes 2 calls).
+    static std::size_t chunkSize;
+
+    // Default number of consecutive unused Accounts that ends a discovery,
+    // and the highest one accepted (so a discovery can't run unbounded).
+    static uint32_t defaultGapLimit;
+    static uint32_t maxGapLimit;
+
+    // Longest wait for the states of a scan() before returning without them.
+    static std::chrono::milliseconds scanTimeout;
+
+    /**
+     * Derive the addresses for the Accounts in [start, start + count),
+     * splitting the work across the available hardware threads.
+     * The range stops at BIP39::maxAccountIndex.
+     * Returns the records in index order (with no on-chain state).
+     */
+    static std::vector<AccountRecord> deriveAccounts(
+      const std::string& phrase, uint32_t start, uint32_t count
+    );
+
+    /**
+     * Fetch balance and nonce for every given record, in batches of chunkSize.
+     * Records whose batch failed are left with fetched = false.
+     * Returns true if every record was fetched, false otherwise.
+     */
+    static bool fetchAccountStates(std::vector<AccountRecord>& records);
+
+    /**
+     * Derive a fixed range of Accounts and fetch their states, waiting up to
+     * scanTimeout for the node. On timeout the lookup is left running in the
+     * background and the records are returned without states (fetched = false).
+     * Returns the records in index order.
+     */
+    static std::vector<AccountRecord> scan(
+      const std::string& phrase, uint32_t start, uint32_t count
+    );
+
+    /**
+     * Find every used Account for a seed, starting from index 0 and
+     * stopping after gapLimit (at most maxGapLimit) consecutive unused ones
+     * (or maxAccounts in total).
+     * onRecord, if set, is called for each record as soon as its window is done.
+     * Returns all records up to (and including) the last used Account
+     * (empty if the seed was never used). If a lookup fails, scanning stops
+     * and every record scanned so far is returned, check their fetched flags.
+     */
+    static std::vector<AccountRecord> discover(
+      const std::string& phrase, uint32_t gapLimit = defaultGapLimit,
+      uint32_t maxAccounts = 1000,
+      std::function<void(const AccountRecord&)> onRecord = nullptr
+    );
+};
+
+#endif // ACCOUNTSCANNER_H
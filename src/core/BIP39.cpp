@@ -14,6 +14,69 @@ bip3x::HDKey BIP39::createKey(std::string phrase, std::string derivPath) {
   return rootKey;
 }
 
+// Lock/unlock the pages holding a key's secret parts so they're never swapped to disk.
+static void lockKeyMemory(bip3x::HDKey& key, bool lock) {
+  Utils::lockMemory(key.privateKey.data(), key.privateKey.size(), lock);
+  Utils::lockMemory(key.chainCode.data(), key.chainCode.size(), lock);
+}
+
+BIP39::DerivationContext::DerivationContext(const std::string& phrase, std::string parentPath)
+  : parentPath(parentPath)
+{
+  // The seed is only needed to get to the parent node, so it's wiped right away
+  bip3x::bytes_64 seed = bip3x::HDKeyEncoder::makeBip39Seed(phrase);
+  this->parent = bip3x::HDKeyEncoder::makeBip32RootKey(seed);
+  OPENSSL_cleanse(seed.data(), seed.size());
+  bip3x::HDKeyEncoder::makeExtendedKey(this->parent, parentPath);
+  lockKeyMemory(this->parent, true);
+}
+
+BIP39::DerivationContext::~DerivationContext() {
+  OPENSSL_cleanse(this->parent.privateKey.data(), this->parent.privateKey.size());
+  OPENSSL_cleanse(this->parent.chainCode.data(), this->parent.chainCode.size());
+  lockKeyMemory(this->parent, false);
+  this->parent.clear();
+}
+
+bip3x::HDKey BIP39::DerivationContext::deriveChild(uint32_t index) const {
+  // Paths are applied relative to the given key, so "m/<index>"
+  // from the parent node is the same as the full path from the root
+  bip3x::HDKey child = this->parent;
+  bip3x::HDKeyEncoder::makeExtendedKey(child, "m/" + boost::lexical_cast<std::string>(index));
+  return child;
+}
+
+// Cached context for the last used phrase, identified by the phrase's hash.
+static std::shared_ptr<BIP39::DerivationContext> cachedContext;
+static h256 cachedContextHash;
+static std::mutex cachedContextLock;
+
+std::shared_ptr<BIP39::DerivationContext> BIP39::getDerivationContext(const std::string& phrase) {
+  h256 hash = dev::sha3(phrase);
+  cachedContextLock.lock();
+  if (cachedContext != nullptr && cachedContextHash == hash) {
+    std::shared_ptr<DerivationContext> ret = cachedContext;
+    cachedContextLock.unlock();
+    return ret;
+  }
+  cachedContextLock.unlock();
+
+  // Derive outside the lock, it's the expensive part
+  std::shared_ptr<DerivationContext> ret = std::make_shared<DerivationContext>(phrase);
+  cachedContextLock.lock();
+  cachedContext = ret;
+  cachedContextHash = hash;
+  cachedContextLock.unlock();
+  return ret;
+}
+
+void BIP39::clearDerivationContext() {
+  cachedContextLock.lock();
+  cachedContext.reset();
+  cachedContextHash = h256();
+  cachedContextLock.unlock();
+}
+
 bool BIP39::wordExists(std::string word) {
   struct words* wordlist;
   bip39_get_wordlist(NULL, &wordlist);
@@ -21,19 +84,6 @@ bool BIP39::wordExists(std::string word) {
   return (idx != 0);
 }
 
-std::vector<std::string> BIP39::generateAccountsFromSeed(std::string seed, int64_t index) {
-  std::vector<std::string> ret;
-  for (int64_t i = 0; i < 10; ++i, ++index) {
-    std::string address;
-    std::string derivPath = "m/44'/60'/0'/0/" + boost::lexical_cast<std::string>(index);
-    bip3x::HDKey rootKey = BIP39::createKey(seed, derivPath);
-    KeyPair k(Secret::frombip3x(rootKey.privateKey));
-    address += boost::lexical_cast<std::string>(index) + " " + "0x" + k.address().hex();
-    ret.push_back(address);
-  }
-  return ret;
-}
-
 std::pair<bool,std::string> BIP39::saveEncryptedMnemonic(
   bip3x::Bip39Mnemonic::MnemonicResult &mnemonic, std::string &password
 ) {
@@ -4,6 +4,8 @@
 #ifndef BIP39_H
 #define BIP39_H
 
+#include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 #include <utility>
@@ -12,6 +14,7 @@
 #include <boost/filesystem.hpp>
 #include <boost/algorithm/string/replace.hpp>
 
+#include <openssl/crypto.h>
 #include <openssl/rand.h>
 
 #include <bip3x/bip39.h>
@@ -27,6 +30,9 @@
  * Namespace for BIP39-related functions (mnemonics, wordlists, etc.).
  */
 namespace BIP39 {
+  // Highest Account index, the ones above it (2^31 and up) are hardened.
+  const uint32_t maxAccountIndex = 0x7FFFFFFF;
+
   /**
    * Generate a new random mnemonic phrase.
    * Returns the mnemonic phrase.
@@ -41,16 +47,57 @@ namespace BIP39 {
   bip3x::HDKey createKey(std::string phrase, std::string derivPath);
 
   /**
-   * Check if a word exists in the English BIP39 wordlist.
-   * Returns true on success, false on failure.
+   * Derivation context for a mnemonic phrase.
+   * Runs the seed generation (PBKDF2, 2048 rounds) and the derivation of the
+   * hardened parent node (by default "m/44'/60'/0'/0") only once, keeping just
+   * the parent key in locked memory (wiped on destruction), and derives only
+   * the last non-hardened child for each index afterwards.
    */
-  bool wordExists(std::string word);
+  class DerivationContext {
+    private:
+      bip3x::HDKey parent;
+      std::string parentPath;
+
+    public:
+      /**
+       * Constructor. Derives and caches the parent node for the phrase.
+       */
+      DerivationContext(const std::string& phrase, std::string parentPath = "m/44'/60'/0'/0");
+      ~DerivationContext();
+      DerivationContext(const DerivationContext&) = delete;
+      DerivationContext& operator=(const DerivationContext&) = delete;
+
+      /**
+       * Derive the child key at a given index (e.g. "m/44'/60'/0'/0/<index>").
+       * The index must be at most maxAccountIndex.
+       * Returns the child key pair.
+       */
+      bip3x::HDKey deriveChild(uint32_t index) const;
+
+      /**
+       * Get the derivation path of the parent node.
+       * Returns the path string.
+       */
+      const std::string& getParentPath() const { return parentPath; }
+  };
+
+  /**
+   * Get the derivation context for a given phrase, creating it if needed.
+   * Only the context for the last used phrase is cached, identified by its hash.
+   * Returns a shared pointer to the context.
+   */
+  std::shared_ptr<DerivationContext> getDerivationContext(const std::string& phrase);
+
+  /**
+   * Wipe the cached derivation context (e.g. when closing the Wallet).
+   */
+  void clearDerivationContext();
 
   /**
-   * Generate a list with 10 Accounts based on a given seed and a starting index.
-   * Returns a vector with the addresses.
+   * Check if a word exists in the English BIP39 wordlist.
+   * Returns true on success, false on failure.
    */
-  std::vector<std::string> generateAccountsFromSeed(std::string seed, int64_t start);
+  bool wordExists(std::string word);
 
   /**
    * Save a mnemonic phrase to a JSON file in the default path.
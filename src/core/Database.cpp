@@ -8,6 +8,8 @@
 // ======================================================================
 
 bool Database::openTokenDB() {
+  static Metrics::Histogram& hist = Metrics::histogram("avme_db_op_seconds", "db=\"token\",op=\"open\"");
+  Metrics::Timer timer(hist);
   std::string path = Utils::walletFolderPath.string() + "/wallet/c-avax/tokens";
   if (!exists(path)) { create_directories(path); }
   this->tokenStatus = leveldb::DB::Open(this->tokenOpts, path, &this->tokenDB);
@@ -20,7 +22,9 @@ bool Database::openTokenDB() {
     avme["name"] = "AVME";
     avme["decimals"] = 18;
     avme["avaxPairContract"] = Pangolin::contracts["AVAX-AVME"];
-    this->putTokenDBValue(Pangolin::contracts["AVME"], avme.dump());
+    Address avmeAddress;
+    Utils::parseAddress(Pangolin::contracts["AVME"], avmeAddress);
+    this->putTokenDBValue(avmeAddress, avme.dump());
   }
   return this->tokenStatus.ok();
 }
@@ -38,30 +42,53 @@ bool Database::isTokenDBOpen() {
   return (this->tokenDB != NULL);
 }
 
-bool Database::tokenDBKeyExists(std::string key) {
-  leveldb::Iterator* it = this->tokenDB->NewIterator(leveldb::ReadOptions());
-  for (it->SeekToFirst(); it->Valid(); it->Next()) {
-    if (it->key().ToString() == key) return true;
-  }
-  return false;
-}
-
-std::string Database::getTokenDBValue(std::string key) {
-  this->tokenStatus = this->tokenDB->Get(leveldb::ReadOptions(), key, &this->tokenValue);
-  return (this->tokenStatus.ok()) ? this->tokenValue : this->tokenStatus.ToString();
-}
-
-bool Database::putTokenDBValue(std::string key, std::string value) {
-  this->tokenStatus = this->tokenDB->Put(leveldb::WriteOptions(), key, value);
-  return this->tokenStatus.ok();
-}
-
-bool Database::deleteTokenDBValue(std::string key) {
-  this->tokenStatus = this->tokenDB->Delete(leveldb::WriteOptions(), key);
-  return this->tokenStatus.ok();
+bool Database::tokenDBKeyExists(const Address& key) {
+  static Metrics::Histogram& hist = Metrics::histogram("avme_db_op_seconds", "db=\"token\",op=\"exists\"");
+  Metrics::Timer timer(hist);
+  char keyBuf[42];
+  Utils::formatAddress(key, keyBuf, true);
+  std::string value;
+  return this->tokenDB->Get(leveldb::ReadOptions(), leveldb::Slice(keyBuf, sizeof(keyBuf)), &value).ok();
+}
+
+std::string Database::getTokenDBValue(const Address& key) {
+  static Metrics::Histogram& hist = Metrics::histogram("avme_db_op_seconds", "db=\"token\",op=\"get\"");
+  Metrics::Timer timer(hist);
+  char keyBuf[42];
+  Utils::formatAddress(key, keyBuf, true);
+  // Local status and value, so concurrent calls don't share them
+  std::string value;
+  leveldb::Status status = this->tokenDB->Get(
+    leveldb::ReadOptions(), leveldb::Slice(keyBuf, sizeof(keyBuf)), &value
+  );
+  return (status.ok()) ? value : status.ToString();
+}
+
+bool Database::putTokenDBValue(const Address& key, std::string value) {
+  static Metrics::Histogram& hist = Metrics::histogram("avme_db_op_seconds", "db=\"token\",op=\"put\"");
+  Metrics::Timer timer(hist);
+  char keyBuf[42];
+  Utils::formatAddress(key, keyBuf, true);
+  leveldb::Status status = this->tokenDB->Put(
+    leveldb::WriteOptions(), leveldb::Slice(keyBuf, sizeof(keyBuf)), value
+  );
+  return status.ok();
+}
+
+bool Database::deleteTokenDBValue(const Address& key) {
+  static Metrics::Histogram& hist = Metrics::histogram("avme_db_op_seconds", "db=\"token\",op=\"delete\"");
+  Metrics::Timer timer(hist);
+  char keyBuf[42];
+  Utils::formatAddress(key, keyBuf, true);
+  leveldb::Status status = this->tokenDB->Delete(
+    leveldb::WriteOptions(), leveldb::Slice(keyBuf, sizeof(keyBuf))
+  );
+  return status.ok();
 }
 
 std::vector<std::string> Database::getAllTokenDBValues() {
+  static Metrics::Histogram& hist = Metrics::histogram("avme_db_op_seconds", "db=\"token\",op=\"iterate\"");
+  Metrics::Timer timer(hist);
   std::vector<std::string> ret;
   leveldb::Iterator* it = this->tokenDB->NewIterator(leveldb::ReadOptions());
   for (it->SeekToFirst(); it->Valid(); it->Next()) {
@@ -75,9 +102,11 @@ std::vector<std::string> Database::getAllTokenDBValues() {
 // TX HISTORY DATABASE FUNCTIONS
 // ======================================================================
 
-bool Database::openHistoryDB(std::string address) {
+bool Database::openHistoryDB(const Address& address) {
+  static Metrics::Histogram& hist = Metrics::histogram("avme_db_op_seconds", "db=\"history\",op=\"open\"");
+  Metrics::Timer timer(hist);
   std::string path = Utils::walletFolderPath.string()
-    + "/wallet/c-avax/accounts/transactions/" + address;
+    + "/wallet/c-avax/accounts/transactions/" + Utils::addressString(address);
   if (!exists(path)) { create_directories(path); }
   this->historyStatus = leveldb::DB::Open(this->historyOpts, path, &this->historyDB);
   return this->historyStatus.ok();
@@ -97,6 +126,8 @@ bool Database::isHistoryDBOpen() {
 }
 
 bool Database::historyDBKeyExists(std::string key) {
+  static Metrics::Histogram& hist = Metrics::histogram("avme_db_op_seconds", "db=\"history\",op=\"exists\"");
+  Metrics::Timer timer(hist);
   leveldb::Iterator* it = this->historyDB->NewIterator(leveldb::ReadOptions());
   for (it->SeekToFirst(); it->Valid(); it->Next()) {
     if (it->key().ToString() == key) return true;
@@ -105,21 +136,29 @@ bool Database::historyDBKeyExists(std::string key) {
 }
 
 std::string Database::getHistoryDBValue(std::string key) {
+  static Metrics::Histogram& hist = Metrics::histogram("avme_db_op_seconds", "db=\"history\",op=\"get\"");
+  Metrics::Timer timer(hist);
   this->historyStatus = this->tokenDB->Get(leveldb::ReadOptions(), key, &this->historyValue);
   return (this->historyStatus.ok()) ? this->historyValue : this->historyStatus.ToString();
 }
 
 bool Database::putHistoryDBValue(std::string key, std::string value) {
+  static Metrics::Histogram& hist = Metrics::histogram("avme_db_op_seconds", "db=\"history\",op=\"put\"");
+  Metrics::Timer timer(hist);
   this->historyStatus = this->historyDB->Put(leveldb::WriteOptions(), key, value);
   return this->historyStatus.ok();
 }
 
 bool Database::deleteHistoryDBValue(std::string key) {
+  static Metrics::Histogram& hist = Metrics::histogram("avme_db_op_seconds", "db=\"history\",op=\"delete\"");
+  Metrics::Timer timer(hist);
   this->historyStatus = this->historyDB->Delete(leveldb::WriteOptions(), key);
   return this->historyStatus.ok();
 }
 
 std::vector<std::string> Database::getAllHistoryDBValues() {
+  static Metrics::Histogram& hist = Metrics::histogram("avme_db_op_seconds", "db=\"history\",op=\"iterate\"");
+  Metrics::Timer timer(hist);
   std::vector<std::string> ret;
   leveldb::Iterator* it = this->historyDB->NewIterator(leveldb::ReadOptions());
   for (it->SeekToFirst(); it->Valid(); it->Next()) {
@@ -20,11 +20,11 @@ using namespace boost::filesystem;
  */
 class Database {
   private:
-    // The ARC20 token database, options, status and value.
+    // The ARC20 token database, options and status (of opening it).
+    // Reads and writes keep their own status, so they can run concurrently.
     leveldb::DB* tokenDB;
     leveldb::Options tokenOpts;
     leveldb::Status tokenStatus;
-    std::string tokenValue;
 
     // The tx history database, options, status and value.
     leveldb::DB* historyDB;
@@ -42,18 +42,21 @@ class Database {
     }
 
     // Token database functions.
+    // Tokens are keyed by their contract's address in camel-case (EIP-55),
+    // formatted on the stack so lookups don't allocate a key.
     bool openTokenDB();
     std::string getTokenDBStatus();
     void closeTokenDB();
     bool isTokenDBOpen();
-    bool tokenDBKeyExists(std::string key);
-    std::string getTokenDBValue(std::string key);
-    bool putTokenDBValue(std::string key, std::string value);
-    bool deleteTokenDBValue(std::string key);
+    bool tokenDBKeyExists(const Address& key);
+    std::string getTokenDBValue(const Address& key);
+    bool putTokenDBValue(const Address& key, std::string value);
+    bool deleteTokenDBValue(const Address& key);
     std::vector<std::string> getAllTokenDBValues();
 
     // Tx history database functions.
-    bool openHistoryDB(std::string address);
+    // Each Account has its own database, in a folder named after its lower-case address.
+    bool openHistoryDB(const Address& address);
     std::string getHistoryDBStatus();
     void closeHistoryDB();
     bool isHistoryDBOpen();
@@ -0,0 +1,213 @@
+// Copyright (c) 2020-2021 AVME Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+#include "Logger.h"
+
+#include <ctime>
+
+Logger::State::State() : ring(new Slot[capacity]) {
+  for (std::size_t i = 0; i < capacity; i++) {
+    ring[i].seq.store(i, std::memory_order_relaxed);
+  }
+  this->writer = std::thread(&Logger::writerLoop, std::ref(*this));
+}
+
+Logger::State::~State() {
+  this->lock.lock();
+  this->running = false;
+  this->lock.unlock();
+  this->cv.notify_all();
+  if (this->writer.joinable()) this->writer.join();
+  if (this->file != nullptr) std::fclose(this->file);
+}
+
+Logger::State& Logger::state() {
+  static State s;
+  return s;
+}
+
+bool Logger::enabled(Level level) {
+  return static_cast<int>(level) >= state().minLevel.load(std::memory_order_relaxed);
+}
+
+void Logger::log(Level level, std::string msg) {
+  State& s = state();
+  if (static_cast<int>(level) < s.minLevel.load(std::memory_order_relaxed)) return;
+
+  // Truncate or sample out large payloads before they hit the ring
+  std::size_t limit = s.payloadLimit.load(std::memory_order_relaxed);
+  if (msg.size() > limit) {
+    std::size_t total = msg.size();
+    unsigned rate = s.payloadSampleRate.load(std::memory_order_relaxed);
+    std::size_t count = s.oversized.fetch_add(1, std::memory_order_relaxed);
+    std::size_t keep = (rate > 1 && count % rate != 0) ? std::min<std::size_t>(limit, 128) : limit;
+    msg.resize(keep);
+    msg += "... [" + std::to_string(total - keep) + " bytes omitted]";
+  }
+
+  // Claim a slot (bounded MPMC queue, used here with a single consumer)
+  std::size_t pos = s.enqueuePos.load(std::memory_order_relaxed);
+  Slot* slot;
+  for (;;) {
+    slot = &s.ring[pos & (capacity - 1)];
+    std::size_t seq = slot->seq.load(std::memory_order_acquire);
+    std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+    if (diff == 0) {
+      if (s.enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+    } else if (diff < 0) {
+      s.dropped.fetch_add(1, std::memory_order_relaxed);
+      return;
+    } else {
+      pos = s.enqueuePos.load(std::memory_order_relaxed);
+    }
+  }
+  slot->level = level;
+  slot->time = std::chrono::system_clock::now();
+  slot->msg = std::move(msg);
+  slot->seq.store(pos + 1, std::memory_order_release);
+}
+
+void Logger::setLevel(Level level) {
+  state().minLevel = static_cast<int>(level);
+}
+
+void Logger::setLogFile(boost::filesystem::path filePath) {
+  State& s = state();
+  flush();
+  s.lock.lock();
+  if (s.filePath != filePath) {
+    s.filePath = filePath;
+    s.reopen = true;
+  }
+  s.lock.unlock();
+  s.cv.notify_all();
+}
+
+void Logger::setRotation(std::size_t maxFileSize, unsigned maxFiles) {
+  State& s = state();
+  s.maxFileSize = maxFileSize;
+  s.maxFiles = maxFiles;
+}
+
+void Logger::setPayloadLimit(std::size_t maxBytes, unsigned sampleRate) {
+  State& s = state();
+  s.payloadLimit = maxBytes;
+  s.payloadSampleRate = (sampleRate == 0) ? 1 : sampleRate;
+}
+
+void Logger::flush(std::chrono::milliseconds timeout) {
+  State& s = state();
+  std::size_t target = s.enqueuePos.load(std::memory_order_acquire);
+  std::unique_lock<std::mutex> lk(s.lock);
+  s.cv.notify_all();
+  s.flushed.wait_for(lk, timeout, [&]{
+    return s.written.load(std::memory_order_acquire) >= target || !s.running;
+  });
+}
+
+void Logger::writerLoop(State& s) {
+  std::unique_lock<std::mutex> lk(s.lock);
+  while (s.running) {
+    // Close the current file if the path changed, it's reopened lazily on the next write
+    if (s.reopen) {
+      if (s.file != nullptr) std::fclose(s.file);
+      s.file = nullptr;
+      s.openPath = s.filePath;
+      s.reopen = false;
+    }
+    lk.unlock();
+    std::size_t count = drain(s);
+    lk.lock();
+    if (count > 0 && s.file != nullptr) std::fflush(s.file);
+    s.flushed.notify_all();
+    // Producers never signal, so poll the ring periodically
+    if (count == 0) s.cv.wait_for(lk, std::chrono::milliseconds(20));
+  }
+  lk.unlock();
+  drain(s);
+  if (s.file != nullptr) std::fflush(s.file);
+}
+
+std::size_t Logger::drain(State& s) {
+  std::size_t count = 0;
+  std::size_t dropped = s.dropped.exchange(0, std::memory_order_relaxed);
+  if (dropped > 0) {
+    writeLine(s, Level::Warning, std::chrono::system_clock::now(),
+      "Logger queue full, dropped " + std::to_string(dropped) + " messages"
+    );
+  }
+  for (;;) {
+    Slot& slot = s.ring[s.dequeuePos & (capacity - 1)];
+    std::size_t seq = slot.seq.load(std::memory_order_acquire);
+    if (seq != s.dequeuePos + 1) break;
+    writeLine(s, slot.level, slot.time, slot.msg);
+    slot.msg.clear();
+    slot.seq.store(s.dequeuePos + capacity, std::memory_order_release);
+    s.dequeuePos++;
+    s.written.store(s.dequeuePos, std::memory_order_release);
+    count++;
+  }
+  return count;
+}
+
+void Logger::openFile(State& s) {
+  s.file = std::fopen(s.openPath.string().c_str(), "ab");
+  s.fileSize = 0;
+  if (s.file != nullptr) {
+    std::fseek(s.file, 0, SEEK_END);
+    long size = std::ftell(s.file);
+    s.fileSize = (size > 0) ? static_cast<std::size_t>(size) : 0;
+  }
+}
+
+void Logger::rotateFile(State& s) {
+  boost::system::error_code ec;
+  std::fclose(s.file);
+  s.file = nullptr;
+  std::string base = s.openPath.string();
+  unsigned maxFiles = s.maxFiles;
+  for (unsigned i = maxFiles; i > 1; i--) {
+    boost::filesystem::rename(base + "." + std::to_string(i - 1), base + "." + std::to_string(i), ec);
+  }
+  if (maxFiles > 0) {
+    boost::filesystem::rename(s.openPath, base + ".1", ec);
+  } else {
+    boost::filesystem::remove(s.openPath, ec);
+  }
+  openFile(s);
+}
+
+void Logger::writeLine(
+  State& s, Level level, std::chrono::system_clock::time_point time, const std::string& msg
+) {
+  static const char* labels[] = { "DEBUG", "INFO", "WARN", "ERROR" };
+  if (s.file == nullptr) openFile(s);
+  if (s.file == nullptr) return;
+
+  // Format as "[dd-mm-YYYY HH-MM-SS.mmm] [LEVEL] message"
+  std::time_t t = std::chrono::system_clock::to_time_t(time);
+  int ms = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(
+    time.time_since_epoch()).count() % 1000
+  );
+  std::tm tm;
+#ifdef _WIN32
+  localtime_s(&tm, &t);
+#else
+  localtime_r(&t, &tm);
+#endif
+  char header[64];
+  std::size_t len = std::strftime(header, sizeof(header), "[%d-%m-%Y %H-%M-%S", &tm);
+  len += std::snprintf(header + len, sizeof(header) - len, ".%03d] [%s] ",
+    ms, labels[static_cast<int>(level)]
+  );
+
+  std::size_t maxFileSize = s.maxFileSize;
+  if (maxFileSize > 0 && s.fileSize > 0 && s.fileSize + len + msg.size() + 1 > maxFileSize) {
+    rotateFile(s);
+    if (s.file == nullptr) return;
+  }
+  std::fwrite(header, 1, len, s.file);
+  std::fwrite(msg.data(), 1, msg.size(), s.file);
+  std::fputc('\n', s.file);
+  s.fileSize += len + msg.size() + 1;
+}
@@ -0,0 +1,135 @@
+// Copyright (c) 2020-2021 AVME Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <boost/filesystem.hpp>
+
+/**
+ * Asynchronous logger for the debug log file.
+ * Callers push messages into a lock-free multi-producer/single-consumer
+ * ring buffer and return immediately; a background thread drains it,
+ * formats the timestamps and writes to a single long-lived file handle,
+ * rotating the file once it grows past a given size.
+ * If the ring is full, messages are dropped (and counted) instead of blocking.
+ */
+class Logger {
+  public:
+    // Log levels, from most to least verbose.
+    enum class Level { Debug = 0, Info = 1, Warning = 2, Error = 3 };
+
+  private:
+    // Ring buffer capacity, must be a power of two.
+    static const std::size_t capacity = 4096;
+
+    // A single slot in the ring. seq tells whether it's free or filled.
+    struct Slot {
+      std::atomic<std::size_t> seq;
+      Level level;
+      std::chrono::system_clock::time_point time;
+      std::string msg;
+    };
+
+    // Shared state between producers and the writer thread.
+    struct State {
+      std::unique_ptr<Slot[]> ring;
+      std::atomic<std::size_t> enqueuePos{0};
+      std::size_t dequeuePos = 0; // Only touched by the writer thread.
+      std::atomic<std::size_t> written{0};
+      std::atomic<std::size_t> dropped{0};
+      std::atomic<std::size_t> oversized{0};
+      std::atomic<int> minLevel{static_cast<int>(Level::Debug)};
+      std::atomic<std::size_t> payloadLimit{4096};
+      std::atomic<unsigned> payloadSampleRate{1};
+      std::atomic<bool> running{true};
+
+      // Guards the config below and is used by the writer to sleep/wake.
+      std::mutex lock;
+      std::condition_variable cv;
+      std::condition_variable flushed;
+      boost::filesystem::path filePath = "debug.log";
+      bool reopen = true;
+      std::atomic<std::size_t> maxFileSize{10 * 1024 * 1024};
+      std::atomic<unsigned> maxFiles{3};
+
+      // Only touched by the writer thread.
+      boost::filesystem::path openPath;
+      std::FILE* file = nullptr;
+      std::size_t fileSize = 0;
+      std::thread writer;
+
+      State();
+      ~State();
+    };
+
+    /**
+     * Get the logger state, lazily starting the writer thread on first use.
+     * Returns a reference to the state.
+     */
+    static State& state();
+
+    /**
+     * Writer thread loop and its helpers (drain the ring, open and rotate the file).
+     */
+    static void writerLoop(State& s);
+    static std::size_t drain(State& s);
+    static void openFile(State& s);
+    static void rotateFile(State& s);
+    static void writeLine(State& s, Level level, std::chrono::system_clock::time_point time, const std::string& msg);
+
+  public:
+    /**
+     * Check if a given level would be logged.
+     * Use before building expensive messages (e.g. request/response bodies).
+     * Returns true if enabled, false otherwise.
+     */
+    static bool enabled(Level level);
+
+    /**
+     * Push a message into the log queue. Never blocks.
+     * Payloads bigger than the configured limit are truncated, and if
+     * sampling is set, only one in every N of them is kept at that size
+     * (the others are cut down to a short prefix).
+     */
+    static void log(Level level, std::string msg);
+
+    /**
+     * Set the minimum level that gets logged.
+     */
+    static void setLevel(Level level);
+
+    /**
+     * Set the file to log to. Pending messages are flushed to the old file first.
+     */
+    static void setLogFile(boost::filesystem::path filePath);
+
+    /**
+     * Set the maximum size (in bytes) of the log file before rotating it,
+     * and how many rotated files (debug.log.1, debug.log.2, ...) are kept.
+     */
+    static void setRotation(std::size_t maxFileSize, unsigned maxFiles);
+
+    /**
+     * Set the maximum payload size (in bytes) of a single message,
+     * and keep only one in every sampleRate oversized payloads (1 keeps all).
+     */
+    static void setPayloadLimit(std::size_t maxBytes, unsigned sampleRate = 1);
+
+    /**
+     * Block until every message pushed so far has been written,
+     * or until the timeout expires.
+     */
+    static void flush(std::chrono::milliseconds timeout = std::chrono::milliseconds(1000));
+};
+
+#endif // LOGGER_H
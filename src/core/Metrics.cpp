@@ -0,0 +1,169 @@
+// Copyright (c) 2020-2021 AVME Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+#include "Metrics.h"
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+namespace Metrics {
+  // A registered metric, keeping its name and labels apart for exporting.
+  template <typename T> struct Entry {
+    std::string name;
+    std::string labels;
+    std::unique_ptr<T> metric;
+  };
+
+  // The registry itself. Entries are never removed, so references stay valid.
+  struct Registry {
+    std::mutex lock;
+    std::map<std::string, Entry<Counter>> counters;
+    std::map<std::string, Entry<Gauge>> gauges;
+    std::map<std::string, Entry<Histogram>> histograms;
+  };
+
+  static Registry& registry() {
+    static Registry r;
+    return r;
+  }
+
+  template <typename T> static T& getOrCreate(
+    std::map<std::string, Entry<T>>& map, const std::string& name, const std::string& labels
+  ) {
+    Registry& r = registry();
+    std::string key = name + "{" + labels + "}";
+    std::lock_guard<std::mutex> lk(r.lock);
+    auto it = map.find(key);
+    if (it == map.end()) {
+      Entry<T> entry{name, labels, std::unique_ptr<T>(new T())};
+      it = map.emplace(key, std::move(entry)).first;
+    }
+    return *it->second.metric;
+  }
+
+  Counter& counter(const std::string& name, const std::string& labels) {
+    return getOrCreate(registry().counters, name, labels);
+  }
+
+  Gauge& gauge(const std::string& name, const std::string& labels) {
+    return getOrCreate(registry().gauges, name, labels);
+  }
+
+  Histogram& histogram(const std::string& name, const std::string& labels) {
+    return getOrCreate(registry().histograms, name, labels);
+  }
+
+  Histogram::Histogram() {
+    for (int i = 0; i < bucketCount; i++) buckets[i].store(0, std::memory_order_relaxed);
+  }
+
+  int Histogram::bucketIndex(uint64_t value) {
+    if (value < subBuckets) return static_cast<int>(value);
+    int exponent = 63;
+    while (!(value >> exponent)) exponent--;
+    if (exponent > maxExponent) return bucketCount - 1;
+    int shift = exponent - subBucketBits;
+    int sub = static_cast<int>((value >> shift) & (subBuckets - 1));
+    return ((exponent - subBucketBits + 1) * subBuckets) + sub;
+  }
+
+  uint64_t Histogram::bucketValue(int index) {
+    if (index < subBuckets) return static_cast<uint64_t>(index);
+    int exponent = (index / subBuckets) + subBucketBits - 1;
+    int sub = index % subBuckets;
+    return (static_cast<uint64_t>(subBuckets + sub)) << (exponent - subBucketBits);
+  }
+
+  void Histogram::record(uint64_t micros) {
+    buckets[bucketIndex(micros)].fetch_add(1, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+    sum.fetch_add(micros, std::memory_order_relaxed);
+    uint64_t prev = max.load(std::memory_order_relaxed);
+    while (micros > prev && !max.compare_exchange_weak(prev, micros, std::memory_order_relaxed)) {}
+  }
+
+  uint64_t Histogram::quantile(double q) const {
+    uint64_t total = getCount();
+    if (total == 0) return 0;
+    uint64_t target = static_cast<uint64_t>(q * total);
+    if (target >= total) target = total - 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < bucketCount; i++) {
+      seen += buckets[i].load(std::memory_order_relaxed);
+      if (seen > target) {
+        uint64_t upper = (i + 1 < bucketCount) ? bucketValue(i + 1) - 1 : getMax();
+        return std::min(upper, getMax());
+      }
+    }
+    return getMax();
+  }
+
+  // Format a metric line, merging the metric's labels with extra ones (e.g. quantile).
+  static void writeLine(
+    std::stringstream& ss, const std::string& name, const std::string& labels,
+    const std::string& extra, const std::string& value
+  ) {
+    ss << name;
+    if (!labels.empty() || !extra.empty()) {
+      ss << "{" << labels << ((!labels.empty() && !extra.empty()) ? "," : "") << extra << "}";
+    }
+    ss << " " << value << "\n";
+  }
+
+  static std::string toSeconds(uint64_t micros) {
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%.6f", micros / 1000000.0);
+    return std::string(buf);
+  }
+
+  std::string toPrometheus() {
+    Registry& r = registry();
+    std::stringstream ss;
+    std::string lastName;
+    std::lock_guard<std::mutex> lk(r.lock);
+    for (auto& it : r.counters) {
+      if (it.second.name != lastName) ss << "# TYPE " << it.second.name << " counter\n";
+      lastName = it.second.name;
+      writeLine(ss, it.second.name, it.second.labels, "", std::to_string(it.second.metric->get()));
+    }
+    for (auto& it : r.gauges) {
+      if (it.second.name != lastName) ss << "# TYPE " << it.second.name << " gauge\n";
+      lastName = it.second.name;
+      writeLine(ss, it.second.name, it.second.labels, "", std::to_string(it.second.metric->get()));
+    }
+    for (auto& it : r.histograms) {
+      const Histogram& h = *it.second.metric;
+      if (it.second.name != lastName) ss << "# TYPE " << it.second.name << " summary\n";
+      lastName = it.second.name;
+      for (const char* q : { "0.5", "0.9", "0.99", "0.999" }) {
+        writeLine(ss, it.second.name, it.second.labels,
+          std::string("quantile=\"") + q + "\"", toSeconds(h.quantile(std::stod(q)))
+        );
+      }
+      writeLine(ss, it.second.name + "_sum", it.second.labels, "", toSeconds(h.getSum()));
+      writeLine(ss, it.second.name + "_count", it.second.labels, "", std::to_string(h.getCount()));
+    }
+    // A summary has no "_max" sample, so the maximums are a gauge family of their own
+    for (auto& it : r.histograms) {
+      std::string name = it.second.name + "_max";
+      if (name != lastName) ss << "# TYPE " << name << " gauge\n";
+      lastName = name;
+      writeLine(ss, name, it.second.labels, "", toSeconds(it.second.metric->getMax()));
+    }
+    return ss.str();
+  }
+
+  bool writeToFile(boost::filesystem::path filePath) {
+    // Write to a temp file first so readers never see a partial export
+    boost::filesystem::path tmpPath = filePath.string() + ".tmp";
+    std::ofstream file(tmpPath.string(), std::ios::out | std::ios::trunc);
+    if (!file.is_open()) return false;
+    file << toPrometheus();
+    file.close();
+    if (file.fail()) return false;
+    boost::system::error_code ec;
+    boost::filesystem::rename(tmpPath, filePath, ec);
+    return !ec;
+  }
+}
@@ -0,0 +1,138 @@
+// Copyright (c) 2020-2021 AVME Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <boost/filesystem.hpp>
+
+/**
+ * Namespace for the built-in metrics registry.
+ * Holds named counters, gauges and latency histograms that can be updated
+ * from any thread without locking, and exported in Prometheus text format
+ * either to a file or through MetricsServer.
+ * Metrics are identified by a name and an optional label string,
+ * e.g. histogram("avme_api_request_seconds", "method=\"eth_call\"").
+ */
+namespace Metrics {
+  /**
+   * Monotonically increasing counter.
+   */
+  class Counter {
+    private:
+      std::atomic<uint64_t> value{0};
+
+    public:
+      void inc(uint64_t n = 1) { value.fetch_add(n, std::memory_order_relaxed); }
+      uint64_t get() const { return value.load(std::memory_order_relaxed); }
+  };
+
+  /**
+   * Value that can go up and down (e.g. number of in-flight requests).
+   */
+  class Gauge {
+    private:
+      std::atomic<int64_t> value{0};
+
+    public:
+      void set(int64_t v) { value.store(v, std::memory_order_relaxed); }
+      void add(int64_t n) { value.fetch_add(n, std::memory_order_relaxed); }
+      int64_t get() const { return value.load(std::memory_order_relaxed); }
+  };
+
+  /**
+   * HDR-style latency histogram, recording values in microseconds.
+   * Buckets are log-linear: each power of two is split into 16 sub-buckets,
+   * so any recorded value is reported with at most ~6% relative error,
+   * from 1us up to several days, in a fixed amount of memory.
+   */
+  class Histogram {
+    private:
+      static const int subBucketBits = 4;
+      static const int subBuckets = 1 << subBucketBits;
+      static const int maxExponent = 40;
+      static const int bucketCount = (maxExponent - subBucketBits + 2) * subBuckets;
+      std::atomic<uint64_t> buckets[bucketCount];
+      std::atomic<uint64_t> count{0};
+      std::atomic<uint64_t> sum{0};
+      std::atomic<uint64_t> max{0};
+
+      /**
+       * Get the bucket index for a given value, and the lowest value of a bucket.
+       */
+      static int bucketIndex(uint64_t value);
+      static uint64_t bucketValue(int index);
+
+    public:
+      Histogram();
+
+      /**
+       * Record a value in microseconds.
+       */
+      void record(uint64_t micros);
+
+      /**
+       * Get the total count, sum and maximum of recorded values, respectively.
+       */
+      uint64_t getCount() const { return count.load(std::memory_order_relaxed); }
+      uint64_t getSum() const { return sum.load(std::memory_order_relaxed); }
+      uint64_t getMax() const { return max.load(std::memory_order_relaxed); }
+
+      /**
+       * Get the value at a given quantile (0.0 to 1.0).
+       * Returns the upper bound of the bucket the quantile falls into, in microseconds.
+       */
+      uint64_t quantile(double q) const;
+  };
+
+  /**
+   * RAII timer that records the elapsed time into a histogram when destroyed.
+   */
+  class Timer {
+    private:
+      Histogram& hist;
+      std::chrono::steady_clock::time_point start;
+
+    public:
+      explicit Timer(Histogram& hist)
+        : hist(hist), start(std::chrono::steady_clock::now()) {}
+      ~Timer() {
+        hist.record(std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::steady_clock::now() - start
+        ).count());
+      }
+  };
+
+  /**
+   * Get (creating if needed) a metric with the given name and labels.
+   * References stay valid for the lifetime of the program, so hot paths
+   * with fixed labels can look them up once and keep them.
+   * Returns a reference to the metric.
+   */
+  Counter& counter(const std::string& name, const std::string& labels = "");
+  Gauge& gauge(const std::string& name, const std::string& labels = "");
+  Histogram& histogram(const std::string& name, const std::string& labels = "");
+
+  /**
+   * Export all metrics in Prometheus text format.
+   * Histograms are exported as summaries (quantiles in seconds, sum and count).
+   * Returns the formatted text.
+   */
+  std::string toPrometheus();
+
+  /**
+   * Write all metrics in Prometheus text format to a file.
+   * Returns true on success, false on failure.
+   */
+  bool writeToFile(boost::filesystem::path filePath);
+}
+
+#endif // METRICS_H
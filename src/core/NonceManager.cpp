@@ -0,0 +1,166 @@
+// Copyright (c) 2020-2021 AVME Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+#include "NonceManager.h"
+
+std::chrono::seconds NonceManager::maxSyncAge(30);
+std::chrono::seconds NonceManager::dropTimeout(120);
+
+std::shared_ptr<NonceManager::AccountNonces> NonceManager::get(const Address& address) {
+  std::lock_guard<std::mutex> lk(this->accountsLock);
+  std::shared_ptr<AccountNonces>& n = this->accounts[address];
+  if (!n) n = std::make_shared<AccountNonces>();
+  return n;
+}
+
+bool NonceManager::sync(const Address& address, AccountNonces& n) {
+  // Both counts and the receipts of in-flight transactions in one request
+  std::string addressStr = Utils::addressString(address);
+  std::vector<Request> reqs;
+  std::vector<u256> pendingNonces;
+  reqs.push_back({1, "2.0", "eth_getTransactionCount", {addressStr, "latest"}});
+  reqs.push_back({2, "2.0", "eth_getTransactionCount", {addressStr, "pending"}});
+  for (const std::pair<const u256, PendingNonce>& p : n.pending) {
+    reqs.push_back({reqs.size() + 1, "2.0", "eth_getTransactionReceipt", {p.second.txHash}});
+    pendingNonces.push_back(p.first);
+  }
+  std::string resp = API::httpGetRequest(API::buildMultiRequest(reqs));
+  if (resp.empty()) return false;
+
+  u256 latest = 0, pendingCount = 0;
+  std::set<u256> mined;
+  try {
+    // Batch answers may come in any order, so match them by id
+    json respArr = json::parse(resp);
+    if (!respArr.is_array()) throw std::runtime_error("not a batch response");
+    bool gotLatest = false, gotPending = false;
+    for (const json& r : respArr) {
+      if (!r.contains("id") || !r.contains("result") || !r["id"].is_number()) continue;
+      uint64_t id = r["id"].get<uint64_t>();
+      if (id == 1 || id == 2) {
+        u256 count = boost::lexical_cast<HexTo<u256>>(r["result"].get<std::string>());
+        if (id == 1) { latest = count; gotLatest = true; } else { pendingCount = count; gotPending = true; }
+      } else if (id >= 3 && id <= reqs.size() && !r["result"].is_null()) {
+        mined.insert(pendingNonces[id - 3]);
+      }
+    }
+    if (!gotLatest || !gotPending) throw std::runtime_error("incomplete batch response");
+  } catch (std::exception const& e) {
+    Utils::logToDebug(std::string("Nonce sync failed: ") + e.what());
+    return false;
+  }
+
+  auto now = std::chrono::steady_clock::now();
+  n.confirmed = latest;
+  for (auto it = n.pending.begin(); it != n.pending.end();) {
+    // Below "latest" the nonce was used, either by this transaction or by one that replaced it
+    bool done = (it->first < latest || mined.count(it->first));
+    // The node's pool doesn't know about it and it's been a while, so it was dropped
+    bool dropped = (it->first >= pendingCount && now - it->second.sentAt > dropTimeout);
+    if (done || dropped) it = n.pending.erase(it); else ++it;
+  }
+
+  // Never go back below a nonce that is still reserved or in flight here,
+  // the node's pending count may lag behind right after a broadcast
+  u256 next = std::max(latest, pendingCount);
+  if (!n.pending.empty()) next = std::max(next, n.pending.rbegin()->first + 1);
+  if (!n.reserved.empty()) next = std::max(next, *n.reserved.rbegin() + 1);
+  n.next = next;
+
+  // Released nonces the node already counts were used somewhere else
+  u256 used = std::max(latest, pendingCount);
+  for (auto it = n.released.begin(); it != n.released.end();) {
+    if (*it < used || *it >= next || n.pending.count(*it)) it = n.released.erase(it); else ++it;
+  }
+  n.synced = true;
+  n.syncedAt = now;
+  return true;
+}
+
+bool NonceManager::reserve(const Address& address, u256& nonce) {
+  return reserveRange(address, 1, nonce);
+}
+
+bool NonceManager::reserveRange(const Address& address, size_t count, u256& first) {
+  std::shared_ptr<AccountNonces> state = get(address);
+  AccountNonces& n = *state;
+  std::lock_guard<std::mutex> lk(n.lock);
+  // Idle Accounts are synced again in case they were used somewhere else,
+  // busy ones rely on the local state to avoid a request per transaction
+  bool idle = (n.reserved.empty()
+    && std::chrono::steady_clock::now() - n.syncedAt > maxSyncAge);
+  if ((!n.synced || idle) && !sync(address, n)) return false;
+  // A gap left by a released nonce is filled first, or everything after it stays queued
+  if (count == 1 && !n.released.empty()) {
+    first = *n.released.begin();
+    n.released.erase(n.released.begin());
+    n.reserved.insert(first);
+    return true;
+  }
+  first = n.next;
+  for (size_t i = 0; i < count; i++) n.reserved.insert(n.next++);
+  return true;
+}
+
+void NonceManager::release(const Address& address, const u256& nonce) {
+  std::shared_ptr<AccountNonces> state = get(address);
+  AccountNonces& n = *state;
+  std::lock_guard<std::mutex> lk(n.lock);
+  if (!n.reserved.erase(nonce)) return;
+  n.released.insert(nonce);
+  // Released nonces right below next are simply handed out again from there
+  while (!n.released.empty() && *n.released.rbegin() + 1 == n.next) {
+    n.released.erase(std::prev(n.released.end()));
+    n.next--;
+  }
+}
+
+void NonceManager::markBroadcast(const Address& address, const u256& nonce, const std::string& txHash) {
+  std::shared_ptr<AccountNonces> state = get(address);
+  AccountNonces& n = *state;
+  std::lock_guard<std::mutex> lk(n.lock);
+  n.reserved.erase(nonce);
+  n.released.erase(nonce);
+  n.pending[nonce] = {txHash, std::chrono::steady_clock::now()};
+  if (nonce >= n.next) n.next = nonce + 1;
+}
+
+void NonceManager::invalidate(const Address& address) {
+  std::shared_ptr<AccountNonces> state = get(address);
+  AccountNonces& n = *state;
+  std::lock_guard<std::mutex> lk(n.lock);
+  n.synced = false;
+}
+
+bool NonceManager::reconcile(const Address& address) {
+  std::shared_ptr<AccountNonces> state = get(address);
+  AccountNonces& n = *state;
+  std::lock_guard<std::mutex> lk(n.lock);
+  return sync(address, n);
+}
+
+std::map<u256, PendingNonce> NonceManager::pendingTxs(const Address& address) {
+  std::shared_ptr<AccountNonces> state = get(address);
+  AccountNonces& n = *state;
+  std::lock_guard<std::mutex> lk(n.lock);
+  return n.pending;
+}
+
+void NonceManager::clear() {
+  std::lock_guard<std::mutex> lk(this->accountsLock);
+  this->accounts.clear();
+}
+
+bool NonceManager::isNonceError(const std::string& error) {
+  std::string e = error;
+  std::transform(e.begin(), e.end(), e.begin(), ::tolower);
+  return (e.find("nonce too low") != std::string::npos
+    || e.find("nonce is too low") != std::string::npos);
+}
+
+bool NonceManager::isKnownTxError(const std::string& error) {
+  std::string e = error;
+  std::transform(e.begin(), e.end(), e.begin(), ::tolower);
+  return (e.find("already imported") != std::string::npos
+    || e.find("already known") != std::string::npos);
+}
@@ -0,0 +1,135 @@
+// Copyright (c) 2020-2021 AVME Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+#ifndef NONCEMANAGER_H
+#define NONCEMANAGER_H
+
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+
+#include <core/Utils.h>
+#include <network/API.h>
+
+// Struct for a transaction that was broadcast but not mined yet.
+typedef struct PendingNonce {
+  std::string txHash;   // "0x"-prefixed transaction hash
+  std::chrono::steady_clock::time_point sentAt;
+} PendingNonce;
+
+/**
+ * Local, per-Account nonce allocator.
+ * The chain's nonce is only fetched when an Account is first used
+ * (or has been idle for a while, or after the node rejected a nonce),
+ * so back-to-back transactions get their nonces without any requests.
+ * Nonces are handed out atomically, so concurrent transactions from the
+ * same Account never share one, and are tracked until they're mined.
+ * Syncing reconciles the local state with the node's "latest" and
+ * "pending" transaction counts and the receipts of in-flight transactions,
+ * all in one batched request.
+ */
+class NonceManager {
+  private:
+    // Nonce state of a single Account.
+    struct AccountNonces {
+      std::mutex lock;                          // Serializes this Account's operations
+      bool synced = false;                      // Whether next/confirmed can be trusted
+      std::chrono::steady_clock::time_point syncedAt;
+      u256 confirmed = 0;                       // Number of mined transactions ("latest")
+      u256 next = 0;                            // Next nonce to hand out
+      std::set<u256> reserved;                  // Handed out, not broadcast yet
+      std::set<u256> released;                  // Given back below next, handed out first
+      std::map<u256, PendingNonce> pending;     // Broadcast, not mined yet
+    };
+
+    // State of every Account seen so far, and the mutex for the map itself.
+    // States are shared, so one in use outlives a clear().
+    std::map<Address, std::shared_ptr<AccountNonces>> accounts;
+    std::mutex accountsLock;
+
+    // Get the state of an Account, creating it if needed.
+    std::shared_ptr<AccountNonces> get(const Address& address);
+
+    /**
+     * Reconcile an Account's state with the node. Must be called with its lock held.
+     * Returns true on success, false on failure.
+     */
+    bool sync(const Address& address, AccountNonces& n);
+
+  public:
+    // Idle time after which an Account is synced again before handing out a nonce.
+    static std::chrono::seconds maxSyncAge;
+
+    // Time after which a transaction the node doesn't know about is considered dropped.
+    static std::chrono::seconds dropTimeout;
+
+    /**
+     * Hand out the next nonce for an Account, syncing first if needed.
+     * The lowest released nonce is reused before a new one is taken.
+     * The nonce stays reserved until it's either broadcast or released.
+     * Returns true on success, false if the nonce couldn't be fetched.
+     */
+    bool reserve(const Address& address, u256& nonce);
+
+    /**
+     * Hand out count consecutive nonces for an Account at once, syncing first if needed.
+     * first is set to the lowest one. Released nonces are only reused by reserve().
+     * Returns true on success, false if the nonces couldn't be fetched.
+     */
+    bool reserveRange(const Address& address, size_t count, u256& first);
+
+    /**
+     * Give back a reserved nonce that won't be used (e.g. signing or broadcast failed).
+     * If it's not the last nonce handed out, it's kept aside and handed out
+     * again by the next reserve(), so the transactions after it aren't stuck
+     * behind the gap.
+     */
+    void release(const Address& address, const u256& nonce);
+
+    /**
+     * Mark a reserved nonce as broadcast with the given transaction hash.
+     */
+    void markBroadcast(const Address& address, const u256& nonce, const std::string& txHash);
+
+    /**
+     * Force an Account to be synced again on the next reservation
+     * (e.g. after the node said a nonce was too low).
+     */
+    void invalidate(const Address& address);
+
+    /**
+     * Sync an Account with the node right away.
+     * Returns true on success, false on failure.
+     */
+    bool reconcile(const Address& address);
+
+    /**
+     * Get the transactions of an Account that were broadcast but not mined yet.
+     * Returns a map of nonces and transactions.
+     */
+    std::map<u256, PendingNonce> pendingTxs(const Address& address);
+
+    /**
+     * Forget the state of all Accounts (e.g. when closing the Wallet).
+     */
+    void clear();
+
+    /**
+     * Check if a broadcast error means the nonce was already used
+     * (by another transaction, so it has to be built again with a new one).
+     * Returns true on success, false on failure.
+     */
+    static bool isNonceError(const std::string& error);
+
+    /**
+     * Check if a broadcast error means the node already has this exact
+     * transaction in its pool, so it was sent and its hash is known.
+     * Returns true on success, false on failure.
+     */
+    static bool isKnownTxError(const std::string& error);
+};
+
+#endif // NONCEMANAGER_H
@@ -0,0 +1,85 @@
+// Copyright (c) 2020-2021 AVME Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+#include "SessionAuth.h"
+
+SessionAuth::SessionAuth() {
+  const char* envIterations = std::getenv("AVME_AUTH_ITERATIONS");
+  if (envIterations != nullptr) setIterations(std::strtoul(envIterations, nullptr, 10));
+}
+
+void SessionAuth::setPassphrase(const std::string& pass) {
+  static Metrics::Histogram& hist = Metrics::histogram("avme_kdf_seconds", "op=\"pbkdf2\"");
+  h256 newSalt = h256::random();
+  unsigned int newIterations = this->iterations;
+  bytesSec newHash;
+  {
+    Metrics::Timer timer(hist);
+    newHash = dev::pbkdf2(pass, newSalt.asBytes(), newIterations);
+  }
+  this->hashLock.lock();
+  this->hash = newHash;
+  this->salt = newSalt;
+  this->hashIterations = newIterations;
+  this->hashLock.unlock();
+  revokeTokens();
+}
+
+bool SessionAuth::verify(const std::string& pass) const {
+  static Metrics::Histogram& hist = Metrics::histogram("avme_kdf_seconds", "op=\"pbkdf2\"");
+  this->hashLock.lock();
+  h256 curSalt = this->salt;
+  unsigned int curIterations = this->hashIterations;
+  this->hashLock.unlock();
+  if (curIterations == 0) return false;
+
+  bytesSec check;
+  {
+    Metrics::Timer timer(hist);
+    check = dev::pbkdf2(pass, curSalt.asBytes(), curIterations);
+  }
+  std::lock_guard<std::mutex> lk(this->hashLock);
+  if (curSalt != this->salt) return false; // Passphrase changed in the meantime
+  return (check.size() == this->hash.size()
+    && CRYPTO_memcmp(check.ref().data(), this->hash.ref().data(), check.size()) == 0);
+}
+
+void SessionAuth::clear() {
+  this->hashLock.lock();
+  this->hash = bytesSec();
+  this->salt = h256();
+  this->hashIterations = 0;
+  this->hashLock.unlock();
+  revokeTokens();
+}
+
+std::string SessionAuth::issueToken(std::chrono::seconds ttl) {
+  unsigned char bytes[32];
+  RAND_bytes(bytes, sizeof(bytes));
+  std::string token = toHex(bytesConstRef(bytes, sizeof(bytes)));
+  OPENSSL_cleanse(bytes, sizeof(bytes));
+  std::lock_guard<std::mutex> lk(this->tokensLock);
+  this->tokens[dev::sha3(token)] = std::chrono::steady_clock::now() + ttl;
+  return token;
+}
+
+bool SessionAuth::verifyToken(const std::string& token) {
+  // Tokens are looked up by hash, so the comparison doesn't leak the token itself
+  h256 tokenHash = dev::sha3(token);
+  auto now = std::chrono::steady_clock::now();
+  std::lock_guard<std::mutex> lk(this->tokensLock);
+  for (auto it = this->tokens.begin(); it != this->tokens.end();) {
+    if (it->second <= now) it = this->tokens.erase(it); else ++it;
+  }
+  return (this->tokens.find(tokenHash) != this->tokens.end());
+}
+
+void SessionAuth::revokeToken(const std::string& token) {
+  std::lock_guard<std::mutex> lk(this->tokensLock);
+  this->tokens.erase(dev::sha3(token));
+}
+
+void SessionAuth::revokeTokens() {
+  std::lock_guard<std::mutex> lk(this->tokensLock);
+  this->tokens.clear();
+}
@@ -0,0 +1,94 @@
+// Copyright (c) 2020-2021 AVME Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+#ifndef SESSIONAUTH_H
+#define SESSIONAUTH_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <string>
+
+#include <openssl/crypto.h>
+#include <openssl/rand.h>
+
+#include <core/Utils.h>
+
+/**
+ * Passphrase verifier for an already loaded Wallet.
+ * The Wallet's keys are protected by the keystore's own KDF, so this only
+ * has to confirm the user knows the passphrase during a session: it keeps
+ * a salted PBKDF2 hash with a configurable (and much lower) iteration count,
+ * compares it in constant time, and can issue short-lived unlock tokens
+ * so repeated confirmations don't need the passphrase (or a KDF) at all.
+ */
+class SessionAuth {
+  private:
+    // Salted hash of the passphrase and the number of iterations used for it.
+    bytesSec hash;
+    h256 salt;
+    unsigned int hashIterations = 0;
+    mutable std::mutex hashLock;
+
+    // Iteration count for the next call to setPassphrase().
+    std::atomic<unsigned int> iterations{4096};
+
+    // Active unlock tokens, by their hash, and their expiry times.
+    std::map<h256, std::chrono::steady_clock::time_point> tokens;
+    std::mutex tokensLock;
+
+  public:
+    /**
+     * Constructor. The default iteration count can be overridden
+     * with the AVME_AUTH_ITERATIONS environment variable.
+     */
+    SessionAuth();
+
+    /**
+     * Set the PBKDF2 iteration count for the verifier.
+     * Only takes effect on the next call to setPassphrase().
+     */
+    void setIterations(unsigned int value) { iterations = (value > 0) ? value : 1; }
+    unsigned int getIterations() { return iterations; }
+
+    /**
+     * Hash and store the passphrase with a new random salt.
+     * Also revokes all unlock tokens.
+     */
+    void setPassphrase(const std::string& pass);
+
+    /**
+     * Check if a passphrase matches the stored hash (constant-time compare).
+     * Returns true on success, false on failure or if no passphrase was set.
+     */
+    bool verify(const std::string& pass) const;
+
+    /**
+     * Wipe the stored hash and revoke all unlock tokens.
+     */
+    void clear();
+
+    /**
+     * Issue a random unlock token valid for a given time.
+     * Only the token's hash is kept, the caller owns the token itself.
+     * Returns the token in Hex.
+     */
+    std::string issueToken(std::chrono::seconds ttl);
+
+    /**
+     * Check if an unlock token is valid and not expired.
+     * Expired tokens are removed along the way.
+     * Returns true on success, false on failure.
+     */
+    bool verifyToken(const std::string& token);
+
+    /**
+     * Revoke a given token / all tokens, respectively.
+     */
+    void revokeToken(const std::string& token);
+    void revokeTokens();
+};
+
+#endif // SESSIONAUTH_H
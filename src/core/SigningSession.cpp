@@ -0,0 +1,137 @@
+// Copyright (c) 2020-2021 AVME Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+#include "SigningSession.h"
+
+#include <cstdlib>
+#include <new>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+// Size of a memory page, the unit memory is locked in.
+static std::size_t pageSize() {
+  #ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return std::size_t(info.dwPageSize);
+  #else
+    return std::size_t(sysconf(_SC_PAGESIZE));
+  #endif
+}
+
+// Allocate a locked, page-aligned page for a single secret. Page locks don't
+// nest, so sharing a page would let unlocking one secret expose another.
+static Secret* newSlot() {
+  std::size_t size = pageSize();
+  void* p = nullptr;
+  #ifdef _WIN32
+    p = VirtualAlloc(nullptr, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+  #else
+    if (posix_memalign(&p, size, size) != 0) p = nullptr;
+  #endif
+  if (p == nullptr) throw std::bad_alloc();
+  Utils::lockMemory(p, size, true);
+  return new (p) Secret();
+}
+
+void SigningSession::SlotDeleter::operator()(Secret* secret) const {
+  secret->ref().cleanse();
+  secret->~Secret();
+  Utils::lockMemory(secret, pageSize(), false);
+  #ifdef _WIN32
+    VirtualFree(secret, 0, MEM_RELEASE);
+  #else
+    free(secret);
+  #endif
+}
+
+SigningSession::SigningSession() {
+  this->reaper = std::thread(&SigningSession::reap, this);
+}
+
+SigningSession::~SigningSession() {
+  {
+    std::lock_guard<std::mutex> lk(this->entriesLock);
+    this->stopping = true;
+    while (!this->entries.empty()) wipe(this->entries.begin());
+  }
+  this->reaperCond.notify_all();
+  if (this->reaper.joinable()) this->reaper.join();
+}
+
+void SigningSession::wipe(std::map<Address, Entry>::iterator it) {
+  // The slot's deleter wipes the secret before its page is unlocked
+  this->entries.erase(it);
+}
+
+void SigningSession::reap() {
+  std::unique_lock<std::mutex> lk(this->entriesLock);
+  while (!this->stopping) {
+    auto now = std::chrono::steady_clock::now();
+    auto next = std::chrono::steady_clock::time_point::max();
+    for (auto it = this->entries.begin(); it != this->entries.end();) {
+      if (it->second.expiry <= now) {
+        wipe(it++);
+      } else {
+        next = std::min(next, it->second.expiry);
+        ++it;
+      }
+    }
+    if (next == std::chrono::steady_clock::time_point::max()) {
+      this->reaperCond.wait(lk);
+    } else {
+      this->reaperCond.wait_until(lk, next);
+    }
+  }
+}
+
+void SigningSession::unlock(Address const& address, Secret const& secret, std::chrono::seconds ttl) {
+  // Allocate and lock the slot before copying the secret into it
+  std::unique_ptr<Secret, SlotDeleter> slot(newSlot());
+  *slot = secret;
+  {
+    std::lock_guard<std::mutex> lk(this->entriesLock);
+    auto it = this->entries.find(address);
+    if (it != this->entries.end()) wipe(it);
+    Entry& e = this->entries[address];
+    e.secret = std::move(slot);
+    e.expiry = std::chrono::steady_clock::now() + ttl;
+  }
+  this->reaperCond.notify_all();
+}
+
+void SigningSession::lock(Address const& address) {
+  std::lock_guard<std::mutex> lk(this->entriesLock);
+  auto it = this->entries.find(address);
+  if (it != this->entries.end()) wipe(it);
+}
+
+void SigningSession::lockAll() {
+  std::lock_guard<std::mutex> lk(this->entriesLock);
+  while (!this->entries.empty()) wipe(this->entries.begin());
+}
+
+std::chrono::seconds SigningSession::remaining(Address const& address) {
+  std::lock_guard<std::mutex> lk(this->entriesLock);
+  auto it = this->entries.find(address);
+  auto now = std::chrono::steady_clock::now();
+  if (it == this->entries.end() || it->second.expiry <= now) return std::chrono::seconds(0);
+  return std::chrono::duration_cast<std::chrono::seconds>(it->second.expiry - now);
+}
+
+Secret SigningSession::secret(Address const& address) {
+  std::lock_guard<std::mutex> lk(this->entriesLock);
+  auto it = this->entries.find(address);
+  if (it == this->entries.end()) return Secret();
+  // The reaper may not have woken up yet, so expiry is checked here too
+  if (it->second.expiry <= std::chrono::steady_clock::now()) {
+    wipe(it);
+    return Secret();
+  }
+  return *it->second.secret;
+}
@@ -0,0 +1,82 @@
+// Copyright (c) 2020-2021 AVME Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+#ifndef SIGNINGSESSION_H
+#define SIGNINGSESSION_H
+
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <core/Utils.h>
+
+/**
+ * Unlocked signing session.
+ * Keeps the decrypted secrets of unlocked Accounts in memory for a limited
+ * time (TTL), so signing doesn't rerun the keystore KDF for every transaction.
+ * Each secret lives in a page of its own that is locked in RAM, and is
+ * wiped (and its page unlocked and freed) as soon as it expires (by a
+ * background thread), is locked manually or the session is destroyed.
+ */
+class SigningSession {
+  private:
+    // Wipes a secret, then unlocks and frees its page.
+    struct SlotDeleter {
+      void operator()(Secret* secret) const;
+    };
+
+    // An unlocked secret and the moment it expires.
+    struct Entry {
+      std::unique_ptr<Secret, SlotDeleter> secret;
+      std::chrono::steady_clock::time_point expiry;
+    };
+
+    std::map<Address, Entry> entries;
+    std::mutex entriesLock;
+
+    // Thread that wipes expired secrets, woken up on every change.
+    std::thread reaper;
+    std::condition_variable reaperCond;
+    bool stopping = false;
+
+    // Wipe and remove an entry. Caller must hold entriesLock.
+    void wipe(std::map<Address, Entry>::iterator it);
+
+    // Reaper loop, sleeps until the earliest expiry.
+    void reap();
+
+  public:
+    SigningSession();
+    ~SigningSession();
+    SigningSession(const SigningSession&) = delete;
+    SigningSession& operator=(const SigningSession&) = delete;
+
+    /**
+     * Unlock an Account's secret for a given time, replacing any previous
+     * entry for the same Account (which also resets the TTL).
+     */
+    void unlock(Address const& address, Secret const& secret, std::chrono::seconds ttl);
+
+    /**
+     * Wipe an Account's secret / all secrets, respectively.
+     */
+    void lock(Address const& address);
+    void lockAll();
+
+    /**
+     * Get the remaining unlocked time for an Account.
+     * Returns the number of seconds left, or 0 if the Account is locked.
+     */
+    std::chrono::seconds remaining(Address const& address);
+
+    /**
+     * Get a copy of an Account's secret if it's still unlocked.
+     * Returns the Secret, or an "empty" Secret if the Account is locked.
+     */
+    Secret secret(Address const& address);
+};
+
+#endif // SIGNINGSESSION_H
@@ -0,0 +1,260 @@
+// Copyright (c) 2020-2021 AVME Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+#include "TxTracker.h"
+
+std::chrono::milliseconds TxTracker::pollInterval(2000);
+unsigned TxTracker::maxBackoffBlocks = 64;
+unsigned TxTracker::maxPendingBlocks = 1800;
+
+// Get the mined transaction count ("latest" nonce) of many Accounts in one batch request.
+// Accounts whose count couldn't be fetched are left out.
+static std::map<Address, u256> getMinedCounts(const std::set<Address>& accounts) {
+  std::map<Address, u256> ret;
+  if (accounts.empty()) return ret;
+  std::vector<Request> reqs;
+  std::vector<Address> reqAccounts(accounts.begin(), accounts.end());
+  for (const Address& account : reqAccounts) {
+    reqs.push_back({reqs.size() + 1, "2.0", "eth_getTransactionCount", {Utils::addressString(account), "latest"}});
+  }
+  std::string resp = API::httpGetRequest(API::buildMultiRequest(reqs));
+  try {
+    // Batch answers may come in any order, so match them by id
+    json respArr = json::parse(resp);
+    for (const json& r : respArr) {
+      if (!r.contains("id") || !r["id"].is_number() || !r.contains("result") || !r["result"].is_string()) continue;
+      uint64_t id = r["id"].get<uint64_t>();
+      if (id < 1 || id > reqAccounts.size()) continue;
+      u256 count = boost::lexical_cast<HexTo<u256>>(r["result"].get<std::string>());
+      ret[reqAccounts[id - 1]] = count;
+    }
+  } catch (std::exception const& e) {}
+  return ret;
+}
+
+TxTracker::TxTracker() {
+  this->worker = std::thread(&TxTracker::run, this);
+}
+
+TxTracker::~TxTracker() {
+  {
+    std::lock_guard<std::mutex> lk(this->lock);
+    this->stopping = true;
+  }
+  this->cond.notify_all();
+  if (this->worker.joinable()) this->worker.join();
+}
+
+void TxTracker::setStore(TxStoreFunc store) {
+  std::lock_guard<std::mutex> lk(this->lock);
+  this->store = store;
+}
+
+void TxTracker::setListener(TxListener listener) {
+  std::lock_guard<std::mutex> lk(this->lock);
+  this->listener = listener;
+}
+
+void TxTracker::track(const Address& account, const TxData& tx, bool store) {
+  {
+    std::lock_guard<std::mutex> lk(this->lock);
+    if (this->tracked.count(tx.hex)) return;
+    this->queued.push_back({account, tx, store, 0, 0, 0});
+    this->wake = true;
+  }
+  this->cond.notify_all();
+}
+
+void TxTracker::notifyBlock(const u256& number) {
+  {
+    std::lock_guard<std::mutex> lk(this->lock);
+    this->pushedAt = std::chrono::steady_clock::now();
+    if (number <= this->head) return;
+    this->head = number;
+    this->wake = true;
+  }
+  this->cond.notify_all();
+}
+
+void TxTracker::pollNow() {
+  {
+    std::lock_guard<std::mutex> lk(this->lock);
+    this->wake = true;
+    this->force = true;
+  }
+  this->cond.notify_all();
+}
+
+size_t TxTracker::pending() {
+  std::lock_guard<std::mutex> lk(this->lock);
+  return this->queued.size() + this->tracked.size();
+}
+
+void TxTracker::clear() {
+  std::vector<Entry> entries;
+  {
+    std::lock_guard<std::mutex> lk(this->lock);
+    for (const Entry& e : this->queued) if (e.store) entries.push_back(e);
+    this->queued.clear();
+    this->tracked.clear();
+  }
+  storeEntries(entries);
+  std::lock_guard<std::mutex> storeLk(this->storeLock);
+  std::lock_guard<std::mutex> lk(this->lock);
+  this->store = nullptr;
+}
+
+void TxTracker::storeEntries(const std::vector<Entry>& entries) {
+  std::lock_guard<std::mutex> storeLk(this->storeLock);
+  TxStoreFunc storeFunc;
+  {
+    std::lock_guard<std::mutex> lk(this->lock);
+    storeFunc = this->store;
+  }
+  if (!storeFunc || entries.empty()) return;
+  std::map<Address, std::vector<TxData>> byAccount;
+  for (const Entry& e : entries) byAccount[e.account].push_back(e.tx);
+  for (const std::pair<const Address, std::vector<TxData>>& p : byAccount) {
+    storeFunc(p.first, p.second);
+  }
+}
+
+void TxTracker::poll(const u256& block, bool all) {
+  // Only the transactions that are due at this block are checked
+  std::vector<std::string> hashes;
+  std::set<Address> stale;
+  {
+    std::lock_guard<std::mutex> lk(this->lock);
+    for (std::pair<const std::string, Entry>& p : this->tracked) {
+      if (p.second.firstBlock == 0) p.second.firstBlock = block;
+      if (!all && p.second.nextBlock > block) continue;
+      hashes.push_back(p.first);
+      if (p.second.misses > 0) stale.insert(p.second.account);
+    }
+  }
+  if (hashes.empty()) return;
+  static Metrics::Counter& checks = Metrics::counter("avme_tx_receipt_checks_total");
+  checks.inc(hashes.size());
+  // The counts are fetched before the receipts: a transaction that has no
+  // receipt below a count taken earlier was never mined, and never will be
+  std::map<Address, u256> minedCounts = getMinedCounts(stale);
+  std::vector<bool> answered;
+  std::vector<json> receipts = API::getTxReceipts(hashes, &answered);
+
+  // A receipt is final: status 0x1 means confirmed, 0x0 means it was mined but reverted
+  // Only the nonces of mined or replaced transactions are known to be used,
+  // a dropped one may still have a replacement pending
+  static Metrics::Counter& dropped = Metrics::counter("avme_tx_dropped_total");
+  std::vector<Entry> finished;
+  std::set<std::pair<Address, std::string>> usedNonces;
+  {
+    std::lock_guard<std::mutex> lk(this->lock);
+    for (size_t i = 0; i < hashes.size(); i++) {
+      auto it = this->tracked.find(hashes[i]);
+      if (it == this->tracked.end()) continue; // Cleared in the meantime
+      if (!answered[i]) continue; // Couldn't be fetched, it's checked again next block
+      const json& receipt = receipts[i];
+      if (!receipt.is_object() || !receipt.contains("status") || !receipt["status"].is_string()) {
+        Entry& e = it->second;
+        auto count = minedCounts.find(e.account);
+        bool replaced = false;
+        try {
+          replaced = (count != minedCounts.end() && count->second > boost::lexical_cast<u256>(e.tx.nonce));
+        } catch (std::exception const& ex) {}
+        bool expired = (block >= e.firstBlock + maxPendingBlocks);
+        if (replaced || expired) {
+          Utils::logToDebug("Transaction 0x" + e.tx.hex + (replaced ? " was replaced" : " was dropped"));
+          if (replaced) usedNonces.insert({e.account, e.tx.nonce});
+          dropped.inc();
+          e.tx.confirmed = false;
+          e.tx.invalid = true;
+          finished.push_back(e);
+          this->tracked.erase(it);
+          continue;
+        }
+        e.misses++;
+        e.nextBlock = block + std::min<unsigned>(1u << std::min(e.misses - 1, 31u), maxBackoffBlocks);
+        continue;
+      }
+      std::string status = receipt["status"].get<std::string>();
+      it->second.tx.confirmed = (status == "0x1");
+      it->second.tx.invalid = (status != "0x1");
+      usedNonces.insert({it->second.account, it->second.tx.nonce});
+      finished.push_back(it->second);
+      this->tracked.erase(it);
+    }
+
+    // Only one transaction per nonce can be mined, the others sent with it
+    // (replacements, or the original of one) will never be, so they're settled too
+    for (auto it = this->tracked.begin(); it != this->tracked.end();) {
+      if (!usedNonces.count({it->second.account, it->second.tx.nonce})) { ++it; continue; }
+      it->second.tx.confirmed = false;
+      it->second.tx.invalid = true;
+      finished.push_back(it->second);
+      it = this->tracked.erase(it);
+    }
+  }
+  if (finished.empty()) return;
+  storeEntries(finished);
+  TxListener listenerFunc;
+  {
+    std::lock_guard<std::mutex> lk(this->lock);
+    listenerFunc = this->listener;
+  }
+  if (listenerFunc) {
+    for (const Entry& e : finished) listenerFunc(e.account, e.tx);
+  }
+}
+
+void TxTracker::run() {
+  std::unique_lock<std::mutex> lk(this->lock);
+  while (!this->stopping) {
+    if (!this->wake) {
+      if (this->tracked.empty()) {
+        this->cond.wait(lk);
+      } else {
+        this->cond.wait_for(lk, pollInterval);
+      }
+    }
+    if (this->stopping) break;
+    this->wake = false;
+
+    // New transactions are stored first, so they show up in history right away
+    std::vector<Entry> toStore;
+    bool added = !this->queued.empty();
+    for (const Entry& e : this->queued) {
+      if (this->tracked.count(e.tx.hex)) continue;
+      this->tracked[e.tx.hex] = e;
+      if (e.store) toStore.push_back(e);
+    }
+    this->queued.clear();
+    bool all = this->force;
+    this->force = false;
+    bool pushed = (std::chrono::steady_clock::now() - this->pushedAt < pollInterval * 2);
+    bool idle = this->tracked.empty();
+    static Metrics::Gauge& pendingGauge = Metrics::gauge("avme_tx_pending");
+    pendingGauge.set(int64_t(this->tracked.size()));
+    lk.unlock();
+
+    try {
+      storeEntries(toStore);
+      // Follow the chain head by polling only while nothing is pushing it
+      if (!pushed && !idle) {
+        u256 number = boost::lexical_cast<HexTo<u256>>(API::getCurrentBlock());
+        lk.lock();
+        if (number > this->head) this->head = number;
+        lk.unlock();
+      }
+      lk.lock();
+      u256 block = this->head;
+      bool newBlock = (block != this->polledHead);
+      this->polledHead = block;
+      lk.unlock();
+      // Receipts are checked on new blocks, for new transactions or when forced
+      if (!idle && (newBlock || added || all)) poll(block, all);
+    } catch (std::exception const& e) {
+      Utils::logToDebug(std::string("Error when tracking transactions: ") + e.what());
+    }
+    lk.lock();
+  }
+}
@@ -0,0 +1,144 @@
+// Copyright (c) 2020-2021 AVME Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+#ifndef TXTRACKER_H
+#define TXTRACKER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <core/Utils.h>
+#include <network/API.h>
+
+// Callback for transactions of an Account whose history records changed.
+typedef std::function<void(const Address&, const std::vector<TxData>&)> TxStoreFunc;
+
+// Callback for a transaction that was confirmed or failed.
+typedef std::function<void(const Address&, const TxData&)> TxListener;
+
+/**
+ * Background confirmation tracker for pending transactions.
+ * Sending only hands the transaction over and returns, a long-lived thread
+ * then stores it in the Account's history and follows the chain head,
+ * either by polling eth_blockNumber or through notifyBlock() when a push
+ * source (e.g. a newHeads subscription) is available.
+ * On each new block, the receipts of the pending transactions that are due
+ * are fetched in one batch request. A transaction without a receipt is checked
+ * again after 1, 2, 4... blocks (up to maxBackoffBlocks), so stale ones don't
+ * cost a request per block. Each history record is updated and the listener
+ * notified as soon as that transaction is confirmed or failed. Once one is
+ * mined, the others from the same Account with the same nonce (replaced or
+ * replacements) are settled as failed. So are the ones that will never be
+ * mined: stale transactions whose nonce the Account's mined transaction count
+ * already passed (replaced from elsewhere), and the ones still pending after
+ * maxPendingBlocks (dropped). Once nothing is pending, polling stops.
+ */
+class TxTracker {
+  private:
+    // A pending transaction, the Account that sent it and when to check it next.
+    struct Entry {
+      Address account;
+      TxData tx;
+      bool store;           // Whether it still has to be added to history
+      u256 nextBlock;       // Block from which its receipt is due again
+      unsigned misses;      // Receipt checks that found nothing so far
+      u256 firstBlock;      // Block at its first receipt check
+    };
+
+    // Transactions waiting to be picked up, and the ones waiting for a receipt (by hash).
+    std::vector<Entry> queued;
+    std::map<std::string, Entry> tracked;
+
+    // History writer and listener, set by the Wallet and the UI respectively.
+    TxStoreFunc store;
+    TxListener listener;
+
+    // Held while storing, so clear() can wait for a store in progress.
+    std::mutex storeLock;
+
+    // Latest known block, when it was last pushed, and the block of the last receipt check.
+    u256 head = 0;
+    u256 polledHead = 0;
+    std::chrono::steady_clock::time_point pushedAt;
+
+    // Worker thread, woken up on new transactions and blocks or when stopping.
+    std::thread worker;
+    std::mutex lock;
+    std::condition_variable cond;
+    bool wake = false;
+    bool force = false;
+    bool stopping = false;
+
+    // Store a list of entries in history, grouped by Account.
+    void storeEntries(const std::vector<Entry>& entries);
+
+    // Fetch the receipts of the transactions due at the given block and settle the finished ones.
+    void poll(const u256& block, bool all);
+
+    // Worker loop.
+    void run();
+
+  public:
+    // Time between eth_blockNumber polls while there are pending transactions.
+    static std::chrono::milliseconds pollInterval;
+
+    // Longest wait between receipt checks of a stale transaction, in blocks.
+    static unsigned maxBackoffBlocks;
+
+    // Blocks after which a transaction that still wasn't mined is settled as dropped.
+    static unsigned maxPendingBlocks;
+
+    TxTracker();
+    ~TxTracker();
+    TxTracker(const TxTracker&) = delete;
+    TxTracker& operator=(const TxTracker&) = delete;
+
+    /**
+     * Set the function that stores (inserts or updates, by hash) history records.
+     */
+    void setStore(TxStoreFunc store);
+
+    /**
+     * Set the function called for each transaction once it's confirmed or failed.
+     */
+    void setListener(TxListener listener);
+
+    /**
+     * Start tracking a pending transaction sent from the given Account.
+     * If store is true it's also added to history, in the background.
+     * Transactions that are already tracked are ignored.
+     */
+    void track(const Address& account, const TxData& tx, bool store = true);
+
+    /**
+     * Report a new chain head from a push source. While blocks are
+     * being pushed, eth_blockNumber isn't polled.
+     */
+    void notifyBlock(const u256& number);
+
+    /**
+     * Check every pending transaction right away, regardless of backoff.
+     */
+    void pollNow();
+
+    /**
+     * Get the number of transactions still waiting to be stored or confirmed.
+     */
+    size_t pending();
+
+    /**
+     * Store the transactions not stored yet and stop tracking all of them
+     * (e.g. when closing the Wallet). Waits for a store in progress, and
+     * nothing else is stored until a new store function is set.
+     */
+    void clear();
+};
+
+#endif // TXTRACKER_H
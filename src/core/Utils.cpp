@@ -3,29 +3,25 @@
 // file LICENSE or http://www.opensource.org/licenses/mit-license.php.
 #include "Utils.h"
 
+#include <cstdio>
+#include <shared_mutex>
+#include <sstream>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
 boost::filesystem::path Utils::walletFolderPath;
-std::mutex Utils::debugFileLock;
-std::mutex Utils::storageThreadLock;
 u256 Utils::MAX_U256_VALUE() { return (raiseToPow(2, 256) - 1); }
 
 void Utils::logToDebug(std::string debug) {
-  boost::filesystem::path debugFilePath = walletFolderPath / "debug.log";
-  debugFileLock.lock();
-  // Timestamps (epoch and human-readable) and confirmed
-  const auto p1 = std::chrono::system_clock::now();
-  auto t = std::time(nullptr);
-  auto tm = *std::localtime(&t);
-  std::stringstream timestream;
-  timestream << std::put_time(&tm, "[%d-%m-%Y %H-%M-%S] ");
-  std::string toWrite = timestream.str();
-  toWrite += debug;
-
-  std::ofstream debugFile (debugFilePath.c_str(), std::ios::out | std::ios::app);
-  debugFile << toWrite << std::endl;
-  debugFile.close();
-
-  debugFileLock.unlock();
-  return;
+  Logger::log(Logger::Level::Info, std::move(debug));
 }
 
 std::string Utils::toLowerCaseAddress(std::string address) {
@@ -34,30 +30,122 @@ std::string Utils::toLowerCaseAddress(std::string address) {
   return ret;
 }
 
+// Value of each Hex digit (either case), or -1 if the character isn't one.
+static const int8_t hexNibbles[256] = {
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1, -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,  0, 1, 2, 3, 4, 5, 6, 7, 8, 9,-1,-1,-1,-1,-1,-1,
+  -1,10,11,12,13,14,15,-1,-1,-1,-1,-1,-1,-1,-1,-1, -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,10,11,12,13,14,15,-1,-1,-1,-1,-1,-1,-1,-1,-1, -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1, -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1, -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1, -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1, -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1
+};
+static const char hexDigitsLower[] = "0123456789abcdef";
+static const char hexDigitsUpper[] = "0123456789ABCDEF";
+
+bool Utils::parseAddress(const char* data, std::size_t size, Address& out) {
+  if (size == 42 && data[0] == '0' && (data[1] == 'x' || data[1] == 'X')) {
+    data += 2;
+    size -= 2;
+  }
+  if (size != 40) return false;
+  Address ret;
+  for (std::size_t i = 0; i < 20; i++) {
+    int hi = hexNibbles[(unsigned char)data[i * 2]];
+    int lo = hexNibbles[(unsigned char)data[i * 2 + 1]];
+    if (hi < 0 || lo < 0) return false;
+    ret[i] = byte((hi << 4) | lo);
+  }
+  out = ret;
+  return true;
+}
+
+bool Utils::parseAddress(const std::string& str, Address& out) {
+  return parseAddress(str.data(), str.size(), out);
+}
+
+void Utils::formatAddress(const Address& address, char (&out)[42], bool checksum) {
+  out[0] = '0';
+  out[1] = 'x';
+  for (std::size_t i = 0; i < 20; i++) {
+    out[2 + i * 2] = hexDigitsLower[address[i] >> 4];
+    out[3 + i * 2] = hexDigitsLower[address[i] & 0x0f];
+  }
+  if (!checksum) return;
+  // EIP-55: digit i is upper-case if nibble i of the hash of the lower-case digits is 8 or more
+  h256 hash = dev::sha3(bytesConstRef(reinterpret_cast<const byte*>(out + 2), 40));
+  for (std::size_t i = 0; i < 40; i++) {
+    byte nibble = (i % 2 == 0) ? (hash[i / 2] >> 4) : (hash[i / 2] & 0x0f);
+    if (nibble > 7) out[2 + i] = hexDigitsUpper[hexNibbles[(unsigned char)out[2 + i]]];
+  }
+}
+
+std::string Utils::addressString(const Address& address, bool checksum) {
+  char buf[42];
+  formatAddress(address, buf, checksum);
+  return std::string(buf, sizeof(buf));
+}
+
 std::string Utils::toCamelCaseAddress(std::string address) {
-  // Address has to be hashed as all lower-case and without the "0x" part
-  address = toLowerCaseAddress(address);
-  if (address.substr(0, 2) == "0x") { address = address.substr(2); }
-  std::string addressHash = dev::toHex(dev::sha3(address));
-  std::string ret = "0x";
-  for (int i = 0; i < address.length(); i++) {
-    // If ith character is 8 to f then make it uppercase
-    ret += (std::stoi(addressHash.substr(i, 1), nullptr, 16) > 7)
-      ? std::toupper(address[i]) : address[i];
+  Address a;
+  if (!parseAddress(address, a)) return toLowerCaseAddress(address);
+  return addressString(a, true);
+}
+
+std::vector<std::string> Utils::toCamelCaseAddresses(const std::vector<std::string>& addresses) {
+  // Format all valid addresses in lower-case first, then hash them in one batch
+  std::vector<std::string> ret;
+  std::vector<std::size_t> valid;
+  ret.reserve(addresses.size());
+  for (std::size_t i = 0; i < addresses.size(); i++) {
+    Address a;
+    if (parseAddress(addresses[i], a)) {
+      ret.push_back(addressString(a, false));
+      valid.push_back(i);
+    } else {
+      ret.push_back(toLowerCaseAddress(addresses[i]));
+    }
+  }
+  std::vector<bytesConstRef> refs;
+  refs.reserve(valid.size());
+  for (std::size_t i : valid) { refs.push_back(bytesConstRef(ret[i]).cropped(2)); }
+  h256s hashes = dev::sha3Batch(refs);
+
+  for (std::size_t v = 0; v < valid.size(); v++) {
+    std::string& address = ret[valid[v]];
+    for (std::size_t i = 0; i < 40; i++) {
+      byte nibble = (i % 2 == 0) ? (hashes[v][i / 2] >> 4) : (hashes[v][i / 2] & 0x0f);
+      if (nibble > 7) address[2 + i] = hexDigitsUpper[hexNibbles[(unsigned char)address[2 + i]]];
+    }
   }
   return ret;
 }
 
-std::string Utils::randomHexBytes() {
-  unsigned char saltBytes[32];
-  RAND_bytes(saltBytes, sizeof(saltBytes));
-  return toHex(
-    dev::sha3(std::string((char*)saltBytes, sizeof(saltBytes)), false)
-  ).substr(0,16);
+std::string Utils::newRequestID() {
+  static const uint32_t prefix = []{
+    uint32_t ret = 0;
+    RAND_bytes(reinterpret_cast<unsigned char*>(&ret), sizeof(ret));
+    return ret;
+  }();
+  static std::atomic<uint32_t> counter{0};
+  char buf[17];
+  std::snprintf(buf, sizeof(buf), "%08x%08x", prefix, counter.fetch_add(1, std::memory_order_relaxed));
+  return std::string(buf, 16);
 }
 
-TxData Utils::decodeRawTransaction(std::string rawTxHex) {
-  TransactionBase transaction = TransactionBase(fromHex(rawTxHex), CheckTransaction::None);
+bool Utils::lockMemory(const void* data, std::size_t size, bool lock) {
+  if (data == nullptr || size == 0) return true;
+  #ifdef _WIN32
+    LPVOID p = const_cast<void*>(data);
+    return (lock) ? VirtualLock(p, size) != 0 : VirtualUnlock(p, size) != 0;
+  #else
+    return (lock) ? mlock(data, size) == 0 : munlock(data, size) == 0;
+  #endif
+}
+
+// Fill a TxData from an already decoded transaction.
+static TxData transactionToTxData(const TransactionBase& transaction) {
   TxData ret;
 
   // Creation, message, sender, receiver and data
@@ -81,11 +169,14 @@ TxData Utils::decodeRawTransaction(std::string rawTxHex) {
   }
 
   // Value, nonce, gas limit, gas price, hash and v/r/s signature keys
-  ret.value = weiToFixedPoint(boost::lexical_cast<std::string>(transaction.value()), 18) + " AVAX";
+  ret.value = Utils::weiToFixedPoint(boost::lexical_cast<std::string>(transaction.value()), 18) + " AVAX";
   ret.nonce = boost::lexical_cast<std::string>(transaction.nonce());
   ret.gas = boost::lexical_cast<std::string>(transaction.gas());
   ret.price = formatBalance(transaction.gasPrice()) + " (" +
     boost::lexical_cast<std::string>(transaction.gasPrice()) + " wei)";
+  if (transaction.isDynamicFee()) {
+    ret.price += " max, tip " + boost::lexical_cast<std::string>(transaction.maxPriorityFeePerGas()) + " wei";
+  }
   ret.hash = transaction.sha3(WithoutSignature).hex();
   if (transaction.safeSender()) {
     ret.v = boost::lexical_cast<std::string>(transaction.signature().v);
@@ -106,6 +197,46 @@ TxData Utils::decodeRawTransaction(std::string rawTxHex) {
   return ret;
 }
 
+TxData Utils::decodeRawTransaction(std::string rawTxHex, Address knownSender) {
+  TransactionBase transaction = TransactionBase(fromHex(rawTxHex), CheckTransaction::None);
+  // Our own transactions don't need the (expensive) sender recovery
+  if (knownSender != Address() && transaction.hasSignature()) transaction.forceSender(knownSender);
+  return transactionToTxData(transaction);
+}
+
+std::vector<TxData> Utils::decodeRawTransactions(const std::vector<std::string>& rawTxHexes) {
+  std::vector<TransactionBase> transactions;
+  transactions.reserve(rawTxHexes.size());
+  for (const std::string& rawTxHex : rawTxHexes) {
+    transactions.emplace_back(fromHex(rawTxHex), CheckTransaction::None);
+  }
+
+  // Recover all senders at once across threads, then cache them in each transaction
+  std::vector<std::pair<Signature, h256>> sigs;
+  std::vector<size_t> sigIndexes;
+  for (size_t i = 0; i < transactions.size(); i++) {
+    if (transactions[i].hasSignature() && !transactions[i].hasZeroSignature()) {
+      sigs.emplace_back(transactions[i].signature(), transactions[i].sha3(WithoutSignature));
+      sigIndexes.push_back(i);
+    }
+  }
+  std::vector<Public> pubs = dev::recoverBatch(sigs);
+  std::vector<bytesConstRef> pubRefs;
+  for (const Public& pub : pubs) { pubRefs.push_back(pub.ref()); }
+  h256s pubHashes = dev::sha3Batch(pubRefs);
+  for (size_t i = 0; i < pubs.size(); i++) {
+    // Same as toAddress(pubs[i]), with the hashes done in one batch
+    if (pubs[i]) transactions[sigIndexes[i]].forceSender(right160(pubHashes[i]));
+  }
+
+  std::vector<TxData> ret;
+  ret.reserve(transactions.size());
+  for (const TransactionBase& transaction : transactions) {
+    ret.push_back(transactionToTxData(transaction));
+  }
+  return ret;
+}
+
 std::string Utils::weiToFixedPoint(std::string amount, size_t digits) {
   std::string result;
 
@@ -329,14 +460,38 @@ boost::filesystem::path Utils::getDataDir() {
   return dataPath;
 }
 
+// Locks for the JSON files, spread over a few by path so the same file always gets the same one.
+// Reads share it, writes take it exclusively: replacing a file that is open for
+// reading fails on Windows.
+static std::shared_timed_mutex& jsonFileLock(const boost::filesystem::path& filePath) {
+  static std::shared_timed_mutex locks[16];
+  return locks[std::hash<std::string>()(filePath.string()) % 16];
+}
+
+// Write data to a file and flush it to disk before returning.
+static void writeFileSynced(const boost::filesystem::path& filePath, const std::string& data) {
+  #ifdef _WIN32
+    FILE* f = _wfopen(filePath.wstring().c_str(), L"wb");
+  #else
+    FILE* f = std::fopen(filePath.string().c_str(), "wb");
+  #endif
+  if (f == NULL) throw std::runtime_error("couldn't open " + filePath.string());
+  bool ok = (std::fwrite(data.data(), 1, data.size(), f) == data.size() && std::fflush(f) == 0);
+  #ifdef _WIN32
+    ok = ok && (_commit(_fileno(f)) == 0);
+  #else
+    ok = ok && (fsync(fileno(f)) == 0);
+  #endif
+  ok = (std::fclose(f) == 0) && ok;
+  if (!ok) throw std::runtime_error("couldn't write " + filePath.string());
+}
+
 std::string Utils::readJSONFile(boost::filesystem::path filePath) {
   json returnData;
-  storageThreadLock.lock();
-
+  std::shared_lock<std::shared_timed_mutex> lk(jsonFileLock(filePath));
   if (!boost::filesystem::exists(filePath)) {
     json errorData;
     errorData["ERROR"] = "FILE DOES NOT EXIST";
-    storageThreadLock.unlock();
     return errorData.dump();
   }
   try {
@@ -345,29 +500,31 @@ std::string Utils::readJSONFile(boost::filesystem::path filePath) {
   } catch (std::exception &e) {
     json errorData;
     errorData["ERROR"] = e.what();
-    storageThreadLock.unlock();
     return errorData.dump();
   }
-
-  storageThreadLock.unlock();
   return returnData.dump();
 }
 
 std::string Utils::writeJSONFile(json obj, boost::filesystem::path filePath) {
   json returnData;
-  storageThreadLock.lock();
-
+  boost::filesystem::path tmpPath = filePath.string() + ".tmp";
   try {
-    std::ofstream os(filePath.c_str());
+    // The new contents are on disk before they replace the old ones,
+    // so a crash leaves either the old file or the new one
+    std::ostringstream os;
     os << std::setw(2) << obj << std::endl;
-    os.close();
+    std::unique_lock<std::shared_timed_mutex> lk(jsonFileLock(filePath));
+    writeFileSynced(tmpPath, os.str());
+    boost::filesystem::rename(tmpPath, filePath);
+    #ifndef _WIN32
+      // Make the rename itself durable too
+      int dir = open(filePath.parent_path().string().c_str(), O_RDONLY);
+      if (dir != -1) { fsync(dir); close(dir); }
+    #endif
   } catch (std::exception &e) {
     returnData["ERROR"] = e.what();
-    storageThreadLock.unlock();
     return returnData.dump();
   }
-
-  storageThreadLock.unlock();
   return "";
 }
 
@@ -4,6 +4,7 @@
 #ifndef UTILS_H
 #define UTILS_H
 
+#include <atomic>
 #include <cctype> // toupper()
 #include <chrono>
 #include <string>
@@ -15,6 +16,9 @@
 
 #include <openssl/rand.h>
 
+#include <core/Logger.h>
+#include <core/Metrics.h>
+
 #include <lib/devcore/CommonIO.h>
 #include <lib/devcore/FileSystem.h>
 #include <lib/devcore/SHA3.h>
@@ -77,6 +81,8 @@ typedef struct TxData {
   uint64_t unixDate;
   bool confirmed;
   bool invalid;
+  std::string raw;        // Signed transaction in hex, kept to replace it while pending
+  std::string replaces;   // Hash of the pending transaction this one replaced, if any
 } TxData;
 
 /**
@@ -84,12 +90,11 @@ typedef struct TxData {
  */
 namespace Utils {
   extern boost::filesystem::path walletFolderPath; // Top folder where the Wallet is.
-  extern std::mutex debugFileLock;  // Mutex for the debug log file.
-  extern std::mutex storageThreadLock;  // Mutex for the JSON read/write threads.
   u256 MAX_U256_VALUE();  // Maximum 256-bit unsigned int value (for error handling).
 
   /**
-   * Write information to the debug log file.
+   * Write information to the debug log file, at the Info level.
+   * This is asynchronous, see Logger for details.
    */
   void logToDebug(std::string debug);
 
@@ -97,21 +102,69 @@ namespace Utils {
    * Convert a given address to lower/camel-case (checksum), respectively.
    * Camel case process was adapted from Ethereum's EIP55:
    * https://github.com/ethereum/EIPs/issues/55
+   * Inputs that aren't valid addresses are only converted to lower-case.
    */
   std::string toLowerCaseAddress(std::string address);
   std::string toCamelCaseAddress(std::string address);
 
   /**
-   * Generate a random 16-byte Hex to be used as a tag/ID.
-   * the respective byte array
+   * Convert a list of addresses to camel-case (checksum) at once,
+   * hashing them together with dev::sha3Batch().
+   * Returns the converted addresses, in the same order.
+   */
+  std::vector<std::string> toCamelCaseAddresses(const std::vector<std::string>& addresses);
+
+  /**
+   * Parse an address in Hex (40 digits, with or without "0x", in any case)
+   * straight from a buffer, without allocating.
+   * Returns true on success, false if it's not a valid address
+   * (in which case out is left untouched).
+   */
+  bool parseAddress(const char* data, std::size_t size, Address& out);
+  bool parseAddress(const std::string& str, Address& out);
+
+  /**
+   * Write an address to a fixed buffer as "0x" followed by 40 Hex digits,
+   * either all lower-case or camel-case (EIP-55 checksum), without allocating.
+   * The buffer is NOT null-terminated.
+   */
+  void formatAddress(const Address& address, char (&out)[42], bool checksum);
+
+  /**
+   * Same as formatAddress(), but returning a string.
+   * The lower-case form is the one used for Account keys and folders,
+   * the camel-case one is used for token keys and display.
    */
-  std::string randomHexBytes();
+  std::string addressString(const Address& address, bool checksum = false);
+
+  /**
+   * Generate a unique 16-char Hex to be used as a tag/ID (e.g. for requests in the log).
+   * IDs are a random per-process prefix followed by a sequential counter,
+   * so generating one is just an atomic increment.
+   */
+  std::string newRequestID();
+
+  /**
+   * Lock/unlock the pages holding a memory region in RAM, so secrets
+   * stored there are never swapped to disk (mlock/VirtualLock).
+   * Returns true on success, false on failure.
+   */
+  bool lockMemory(const void* data, std::size_t size, bool lock);
 
   /**
    * Decode a raw transaction in Hex.
+   * If the sender is already known (e.g. the transaction was just signed by us),
+   * it can be given to skip recovering it from the signature.
    * Returns a struct with the transaction's data.
    */
-  TxData decodeRawTransaction(std::string rawTxHex);
+  TxData decodeRawTransaction(std::string rawTxHex, Address knownSender = Address());
+
+  /**
+   * Decode many raw transactions in Hex at once, recovering
+   * their senders in parallel.
+   * Returns a list of structs with the transactions' data, in the same order.
+   */
+  std::vector<TxData> decodeRawTransactions(const std::vector<std::string>& rawTxHexes);
 
   /**
    * Convert a full Wei amount to a fixed point amount and vice-versa,
@@ -172,6 +225,9 @@ namespace Utils {
    * or a stringified JSON with an error message on failure.
    * Write returns an empty string on success, or a stringified JSON with
    * an error message on failure.
+   * Writes go to a temporary file that is flushed to disk and then replaces
+   * the old one, so a crash never leaves a partial file. Reads of the same
+   * file run in parallel and wait for a write, files don't block each other.
    */
   std::string readJSONFile(boost::filesystem::path filePath);
   std::string writeJSONFile(json obj, boost::filesystem::path filePath);
@@ -3,6 +3,53 @@
 // file LICENSE or http://www.opensource.org/licenses/mit-license.php.
 #include "Wallet.h"
 
+bool Wallet::dynamicFees = true;
+double Wallet::replacementBump = 0.125;
+
+// Publish a new snapshot of some Wallet state for new readers.
+// Returns the published snapshot.
+template <typename T> static std::shared_ptr<const T> publish(std::shared_ptr<const T>& snapshot, T value) {
+  std::shared_ptr<const T> ret = std::make_shared<T>(std::move(value));
+  std::atomic_store(&snapshot, ret);
+  return ret;
+}
+
+// Convert a tx history record to JSON, as stored in the history files.
+static json txToJSON(const TxData& tx) {
+  json transaction;
+  transaction["txlink"] = tx.txlink;
+  transaction["operation"] = tx.operation;
+  transaction["hex"] = tx.hex;
+  transaction["type"] = tx.type;
+  transaction["code"] = tx.code;
+  transaction["to"] = tx.to;
+  transaction["from"] = tx.from;
+  transaction["data"] = tx.data;
+  transaction["creates"] = tx.creates;
+  transaction["value"] = tx.value;
+  transaction["nonce"] = tx.nonce;
+  transaction["gas"] = tx.gas;
+  transaction["price"] = tx.price;
+  transaction["hash"] = tx.hash;
+  transaction["v"] = tx.v;
+  transaction["r"] = tx.r;
+  transaction["s"] = tx.s;
+  transaction["humanDate"] = tx.humanDate;
+  transaction["unixDate"] = tx.unixDate;
+  transaction["confirmed"] = tx.confirmed;
+  transaction["invalid"] = tx.invalid;
+  transaction["raw"] = tx.raw;
+  transaction["replaces"] = tx.replaces;
+  return transaction;
+}
+
+// Convert a tx history to a JSON array, as stored in the history files.
+static json txsToJSON(const std::vector<TxData>& txs) {
+  json transactionsArray;
+  for (const TxData& tx : txs) transactionsArray.push_back(txToJSON(tx));
+  return transactionsArray;
+}
+
 bool Wallet::create(boost::filesystem::path folder, std::string pass) {
   // Create the paths if they don't exist yet
   boost::filesystem::path walletFile = folder.string() + "/wallet/c-avax/wallet.info";
@@ -17,6 +64,7 @@ bool Wallet::create(boost::filesystem::path folder, std::string pass) {
   try {
     w.create(pass);
     Utils::walletFolderPath = folder;
+    Logger::setLogFile(folder / "debug.log");
     return true;
   } catch (Exception const& _e) {
     Utils::logToDebug(std::string("Unable to create wallet: ") + boost::diagnostic_information(_e));
@@ -24,16 +72,41 @@ bool Wallet::create(boost::filesystem::path folder, std::string pass) {
   }
 }
 
+// Pick the keystore's scrypt parameters for a budget, see Wallet::setKDFBudget.
+static void calibrateKDF(std::chrono::milliseconds budget) {
+  try {
+    ScryptParams params = dev::calibrateScrypt(budget);
+    SecretStore::setScryptParams(params);
+    Utils::logToDebug(
+      "Keystore scrypt calibrated for " + std::to_string(budget.count()) + "ms: n=" + std::to_string(params.n)
+      + " r=" + std::to_string(params.r) + " p=" + std::to_string(params.p)
+    );
+  } catch (std::exception const& e) {
+    Utils::logToDebug(std::string("Keystore scrypt calibration failed: ") + e.what());
+  }
+}
+
 bool Wallet::load(boost::filesystem::path folder, std::string pass) {
   // Load the Wallet, hash+salt the passphrase and store both
   boost::filesystem::path walletFile = folder.string() + "/wallet/c-avax/wallet.info";
   boost::filesystem::path secretsFolder = folder.string() + "/wallet/c-avax/accounts/secrets";
   KeyManager w(walletFile, secretsFolder);
   if (w.load(pass)) {
-    this->km = w;
-    this->passSalt = h256::random();
-    this->passHash = dev::pbkdf2(pass, this->passSalt.asBytes(), this->passIterations);
+    {
+      std::lock_guard<std::mutex> lk(this->kmLock);
+      this->km = w;
+    }
+    // The folder is captured, the tracker's thread never reads the global path
+    this->tracker.setStore([this, folder](const Address& account, const std::vector<TxData>& txs){
+      storeTxs(folder, account, txs);
+    });
+    // Calibrating takes a while, so it's done in the background and new
+    // keys use the default parameters until it's finished
+    static std::once_flag kdfCalibrated;
+    std::call_once(kdfCalibrated, [&](){ std::thread(calibrateKDF, this->kdfBudget).detach(); });
+    this->sessionAuth.setPassphrase(pass);
     Utils::walletFolderPath = folder;
+    Logger::setLogFile(folder / "debug.log");
     return true;
   } else {
     return false;
@@ -41,23 +114,55 @@ bool Wallet::load(boost::filesystem::path folder, std::string pass) {
 }
 
 void Wallet::close() {
-  this->currentAccount = std::make_pair("", "");
-  this->currentAccountHistory.clear();
-  this->accounts.clear();
-  this->ledgerAccounts.clear();
-  this->passHash = bytesSec();
-  this->passSalt = h256();
-  this->km = KeyManager();
+  unwatchAccounts();
+  // Drained first, so nothing is written to the Wallet's folder once it's closed
+  this->tracker.clear();
+  {
+    std::lock_guard<std::mutex> lk(this->currentLock);
+    publish(this->current, AccountSnapshot());
+  }
+  this->nonces.clear();
+  {
+    std::lock_guard<std::mutex> lk(this->accountsLock);
+    publish(this->accounts, std::map<Address, std::string>());
+    publish(this->ledgerAccounts, std::map<Address, std::string>());
+  }
+  this->sessionAuth.clear();
+  {
+    std::lock_guard<std::mutex> lk(this->kmLock);
+    this->km = KeyManager();
+  }
+  this->session.lockAll();
+  BIP39::clearDerivationContext();
   Utils::walletFolderPath = "";
+  Logger::setLogFile("debug.log");
+}
+
+void Wallet::setKDFBudget(std::chrono::milliseconds budget) {
+  this->kdfBudget = budget;
+  calibrateKDF(budget);
 }
 
 bool Wallet::isLoaded() {
+  std::lock_guard<std::mutex> lk(this->kmLock);
   return this->km.exists();
 }
 
 bool Wallet::auth(std::string pass) {
-  bytesSec hash = dev::pbkdf2(pass, passSalt.asBytes(), passIterations);
-  return (hash.ref().toString() == passHash.ref().toString());
+  return this->sessionAuth.verify(pass);
+}
+
+std::string Wallet::issueAuthToken(std::string pass, unsigned int ttl) {
+  if (!this->sessionAuth.verify(pass)) return "";
+  return this->sessionAuth.issueToken(std::chrono::seconds(ttl));
+}
+
+bool Wallet::authToken(std::string token) {
+  return this->sessionAuth.verifyToken(token);
+}
+
+void Wallet::revokeAuthToken(std::string token) {
+  this->sessionAuth.revokeToken(token);
 }
 
 bool Wallet::loadTokenDB() {
@@ -65,7 +170,7 @@ bool Wallet::loadTokenDB() {
   return this->db.openTokenDB();
 }
 
-bool Wallet::loadHistoryDB(std::string address) {
+bool Wallet::loadHistoryDB(const Address& address) {
   if (this->db.isHistoryDBOpen()) { this->db.closeHistoryDB(); }
   return this->db.openHistoryDB(address);
 }
@@ -79,7 +184,8 @@ void Wallet::closeHistoryDB() {
 }
 
 void Wallet::loadARC20Tokens() {
-  this->ARC20Tokens.clear();
+  std::lock_guard<std::mutex> lk(this->tokensLock);
+  std::vector<ARC20Token> tokens;
   std::vector<std::string> tokenJsonList = this->db.getAllTokenDBValues();
   for (std::string tokenJson : tokenJsonList) {
     ARC20Token token;
@@ -89,16 +195,17 @@ void Wallet::loadARC20Tokens() {
     token.name = tokenData["name"].get<std::string>();
     token.decimals = tokenData["decimals"].get<int>();
     token.avaxPairContract = tokenData["avaxPairContract"].get<std::string>();
-    this->ARC20Tokens.push_back(token);
+    tokens.push_back(token);
   }
+  publish(this->ARC20Tokens, std::move(tokens));
 }
 
 bool Wallet::addARC20Token(
-  std::string address, std::string symbol, std::string name,
+  const Address& address, std::string symbol, std::string name,
   int decimals, std::string avaxPairContract
 ) {
   json token;
-  token["address"] = address;
+  token["address"] = Utils::addressString(address, true);
   token["symbol"] = symbol;
   token["name"] = name;
   token["decimals"] = decimals;
@@ -108,30 +215,92 @@ bool Wallet::addARC20Token(
   return success;
 }
 
-bool Wallet::removeARC20Token(std::string address) {
+bool Wallet::removeARC20Token(const Address& address) {
   bool success = this->db.deleteTokenDBValue(address);
   if (success) { loadARC20Tokens(); }
   return success;
 }
 
-bool Wallet::ARC20TokenWasAdded(std::string address) {
+bool Wallet::ARC20TokenWasAdded(const Address& address) {
   return this->db.tokenDBKeyExists(address);
 }
 
 void Wallet::loadAccounts() {
-  this->accounts.clear();
-  if (this->km.store().keys().empty()) { return; }
-  AddressHash got;
-  std::vector<h128> keys = this->km.store().keys();
-  for (auto const& u : keys) {
-    if (Address a = this->km.address(u)) {
-      got.insert(a);
-      this->accounts.emplace(
-        "0x" + boost::lexical_cast<std::string>(a),
-        this->km.accountName(a)
-      );
+  {
+    std::lock_guard<std::mutex> lk(this->accountsLock);
+    std::lock_guard<std::mutex> kmLk(this->kmLock);
+    std::map<Address, std::string> list;
+    std::vector<h128> keys = this->km.store().keys();
+    for (auto const& u : keys) {
+      if (Address a = this->km.address(u)) list.emplace(a, this->km.accountName(a));
     }
+    publish(this->accounts, std::move(list));
   }
+  watchAccounts();
+}
+
+void Wallet::watchAccounts() {
+  std::shared_ptr<WsClient> ws = API::getWebSocket();
+  if (ws == nullptr) return;
+  unwatchAccounts();
+  std::lock_guard<std::mutex> lk(this->watchLock);
+  this->watchWs = ws;
+
+  // New blocks drive the confirmation tracker and the fee and gas caches instead of polling
+  this->headsSub = ws->subscribe({"newHeads"}, [this](const json& head) {
+    if (head.contains("number") && head["number"].is_string()) {
+      u256 number = boost::lexical_cast<HexTo<u256>>(head["number"].get<std::string>());
+      this->tracker.notifyBlock(number);
+      FeeOracle::notifyBlock(number);
+      GasEstimator::notifyBlock(number);
+    }
+  });
+
+  // ERC20 Transfer events with one of the Accounts as sender or recipient
+  std::shared_ptr<const std::map<Address, std::string>> list = std::atomic_load(&this->accounts);
+  if (list->empty()) return;
+  static const std::string transferTopic = "0xddf252ad1be2c89b69c2b068fc378daa952ba7f163c4a11628f55a4df523b3ef";
+  json addressTopics = json::array();
+  for (const std::pair<const Address, std::string>& a : *list) {
+    addressTopics.push_back("0x" + std::string(24, '0') + a.first.hex());
+  }
+  auto onTransfer = [this](const json& log) {
+    if (!log.contains("topics") || !log["topics"].is_array()) return;
+    std::function<void(const Address&)> listener;
+    {
+      std::lock_guard<std::mutex> lk(this->watchLock);
+      listener = this->balanceListener;
+    }
+    if (!listener) return;
+    const json& topics = log["topics"];
+    for (size_t i = 1; i < topics.size() && i <= 2; i++) {
+      if (!topics[i].is_string()) continue;
+      std::string topic = topics[i].get<std::string>();
+      Address a;
+      if (topic.size() == 66 && Utils::parseAddress(topic.substr(26), a)) listener(a);
+    }
+  };
+  this->transferSubs.push_back(ws->subscribe(
+    {"logs", {{"topics", {transferTopic, addressTopics}}}}, onTransfer
+  ));
+  this->transferSubs.push_back(ws->subscribe(
+    {"logs", {{"topics", {transferTopic, nullptr, addressTopics}}}}, onTransfer
+  ));
+}
+
+void Wallet::unwatchAccounts() {
+  std::lock_guard<std::mutex> lk(this->watchLock);
+  if (this->watchWs == nullptr) return;
+  if (this->headsSub != 0) this->watchWs->unsubscribe(this->headsSub);
+  for (uint64_t id : this->transferSubs) this->watchWs->unsubscribe(id);
+  this->headsSub = 0;
+  this->transferSubs.clear();
+  this->watchWs.reset();
+}
+
+void Wallet::setBalanceListener(std::function<void(const Address&)> listener) {
+  std::lock_guard<std::mutex> lk(this->watchLock);
+  this->balanceListener = listener;
 }
 
 std::pair<std::string, std::string> Wallet::createAccount(
@@ -144,45 +313,112 @@ std::pair<std::string, std::string> Wallet::createAccount(
     std::pair<bool,std::string> seedSuccess = BIP39::loadEncryptedMnemonic(mnemonic, pass);
     if (!seedSuccess.first) { return std::make_pair("", ""); }
   }
-  std::string indexStr = boost::lexical_cast<std::string>(index);
-  bip3x::HDKey keyPair = BIP39::createKey(mnemonic.raw, "m/44'/60'/0'/0/" + indexStr);
+  if (index < 0 || index > BIP39::maxAccountIndex) {
+    Utils::logToDebug("Invalid Account index: " + std::to_string(index));
+    return std::make_pair("", "");
+  }
+  bip3x::HDKey keyPair = BIP39::getDerivationContext(mnemonic.raw)->deriveChild(index);
   KeyPair k(Secret::frombip3x(keyPair.privateKey));
-  h128 u = this->km.import(k.secret(), name, pass, "");
+  keyPair.clear();
+  {
+    std::lock_guard<std::mutex> lk(this->kmLock);
+    this->km.import(k.secret(), name, pass, "");
+    this->km.store().clearCache(); // Importing keeps the plaintext key cached
+  }
   loadAccounts();
   return std::make_pair(k.address().hex(), name);
 }
 
-void Wallet::importLedgerAccount(std::string address, std::string path) {
-  // Only import if it hasn't been imported yet
-  if (this->ledgerAccounts.find(address) == this->ledgerAccounts.end()) {
-    this->ledgerAccounts.emplace(address, "ledger-" + path);
+std::vector<std::pair<std::string, std::string>> Wallet::createAccounts(
+  std::string &seed, std::vector<std::pair<int64_t, std::string>> const& accounts, std::string &pass
+) {
+  std::vector<std::pair<std::string, std::string>> ret;
+  bip3x::Bip39Mnemonic::MnemonicResult mnemonic;
+  if (!seed.empty()) { // Using a foreign seed
+    mnemonic.raw = seed;
+  } else {  // Using the Wallet's own seed
+    std::pair<bool,std::string> seedSuccess = BIP39::loadEncryptedMnemonic(mnemonic, pass);
+    if (!seedSuccess.first) { return ret; }
   }
+
+  // Deriving is cheap, encrypting (the keystore KDF) is what runs in parallel
+  std::shared_ptr<BIP39::DerivationContext> ctx = BIP39::getDerivationContext(mnemonic.raw);
+  std::vector<std::pair<Secret, std::string>> secrets;
+  for (const std::pair<int64_t, std::string>& a : accounts) {
+    if (a.first < 0 || a.first > BIP39::maxAccountIndex) {
+      Utils::logToDebug("Invalid Account index: " + std::to_string(a.first));
+      return ret;
+    }
+  }
+  for (const std::pair<int64_t, std::string>& a : accounts) {
+    bip3x::HDKey keyPair = ctx->deriveChild(a.first);
+    secrets.emplace_back(Secret::frombip3x(keyPair.privateKey), a.second);
+    keyPair.clear();
+  }
+  try {
+    std::lock_guard<std::mutex> lk(this->kmLock);
+    this->km.import(secrets, pass, "");
+  } catch (std::exception const& e) {
+    Utils::logToDebug(std::string("Unable to import accounts: ") + e.what());
+    return ret;
+  }
+  for (const std::pair<Secret, std::string>& s : secrets) {
+    ret.emplace_back(KeyPair(s.first).address().hex(), s.second);
+  }
+  loadAccounts();
+  return ret;
 }
 
-bool Wallet::eraseAccount(std::string address) {
+void Wallet::importLedgerAccount(const Address& address, std::string path) {
+  // Only import if it hasn't been imported yet
+  std::lock_guard<std::mutex> lk(this->accountsLock);
+  std::map<Address, std::string> list = *std::atomic_load(&this->ledgerAccounts);
+  if (list.emplace(address, "ledger-" + path).second) publish(this->ledgerAccounts, std::move(list));
+}
+
+bool Wallet::eraseAccount(const Address& address) {
   if (accountExists(address)) {
-    this->km.kill(userToAddress(address));
+    {
+      std::lock_guard<std::mutex> lk(this->kmLock);
+      this->km.kill(address);
+    }
     loadAccounts();
     return true;
   }
   return false; // Account was not found
 }
 
-bool Wallet::accountExists(std::string address) {
-  return (this->accounts.find(address) != this->accounts.end());
+bool Wallet::accountExists(const Address& address) {
+  std::shared_ptr<const std::map<Address, std::string>> list = std::atomic_load(&this->accounts);
+  return (list->find(address) != list->end());
 }
 
-void Wallet::setCurrentAccount(std::string address) {
-  if (accountExists(address)) {
-    this->currentAccount = *this->accounts.find(address);
+void Wallet::setCurrentAccount(const Address& address) {
+  std::shared_ptr<const std::map<Address, std::string>> list = std::atomic_load(&this->accounts);
+  auto it = list->find(address);
+  if (it == list->end()) return;
+  AccountSnapshot next;
+  next.account = *it;
+  std::shared_ptr<const AccountSnapshot> snapshot;
+  {
+    std::lock_guard<std::mutex> lk(historyLock(address));
+    next.history = readTxHistory(address);
+    std::lock_guard<std::mutex> currentLk(this->currentLock);
+    snapshot = publish(this->current, std::move(next));
+  }
+  // Transactions still pending from previous sessions are tracked in the background
+  for (const TxData& tx : snapshot->history) {
+    if (!tx.confirmed && !tx.invalid) this->tracker.track(address, tx, false);
   }
 }
 
 bool Wallet::hasAccountSet() {
-  return (!this->currentAccount.first.empty() && !this->currentAccount.second.empty());
+  std::shared_ptr<const AccountSnapshot> snapshot = std::atomic_load(&this->current);
+  return (snapshot->account.first != Address() && !snapshot->account.second.empty());
 }
 
 Address Wallet::userToAddress(std::string const& input) {
+  std::lock_guard<std::mutex> lk(this->kmLock);
   if (h128 u = fromUUID(input)) { return this->km.address(u); }
   DEV_IGNORE_EXCEPTIONS(return toAddress(input));
   for (Address const& a: this->km.accounts()) {
@@ -192,6 +428,7 @@ Address Wallet::userToAddress(std::string const& input) {
 }
 
 Secret Wallet::getSecret(std::string const& address, std::string pass) {
+  std::lock_guard<std::mutex> lk(this->kmLock);
   if (h128 u = fromUUID(address)) {
     return Secret(this->km.store().secret(u, [&](){ return pass; }, false));
   }
@@ -206,7 +443,9 @@ Secret Wallet::getSecret(std::string const& address, std::string pass) {
       }
     }
   }
-  if (a && accountExists("0x" + boost::lexical_cast<std::string>(a))) {
+  if (a && accountExists(a)) {
+    static Metrics::Histogram& hist = Metrics::histogram("avme_kdf_seconds", "op=\"keystore_decrypt\"");
+    Metrics::Timer timer(hist);
     return this->km.secret(a, [&](){ return pass; }, false);
   } else {
     std::cerr << "Bad file, UUID or address: " << address << std::endl;
@@ -214,33 +453,64 @@ Secret Wallet::getSecret(std::string const& address, std::string pass) {
   }
 }
 
+bool Wallet::unlockAccount(std::string const& address, std::string pass, unsigned int ttl) {
+  Secret s = getSecret(address, pass);
+  if (!s) return false;
+  this->session.unlock(KeyPair(s).address(), s, std::chrono::seconds(ttl));
+  return true;
+}
+
+void Wallet::lockAccount(std::string const& address) {
+  Address a = userToAddress(address);
+  if (a) this->session.lock(a);
+}
+
+void Wallet::lockAllAccounts() {
+  this->session.lockAll();
+}
+
+unsigned int Wallet::accountUnlockedFor(std::string const& address) {
+  Address a = userToAddress(address);
+  return (a) ? this->session.remaining(a).count() : 0;
+}
+
 TransactionSkeleton Wallet::buildTransaction(
   std::string from, std::string to, std::string value,
-  std::string gasLimit, std::string gasPrice, std::string dataHex
+  std::string gasLimit, std::string gasPrice, std::string dataHex,
+  bool reserveNonce
 ) {
   TransactionSkeleton txSkel;
-  int txNonce;
-
-  // Check if nonce is valid (not an error message)
-  std::string txNonceStr = API::getNonce(from);
-  if (txNonceStr == "") {
+  Address fromAddress;
+  if (!Utils::parseAddress(from, fromAddress)) {
     txSkel.nonce = Utils::MAX_U256_VALUE();
     return txSkel;
   }
-  std::stringstream nonceStrm;
-  nonceStrm << std::hex << txNonceStr;
-  nonceStrm >> txNonce;
 
   // Building the transaction structure
   txSkel.creation = false;
-  txSkel.from = toAddress(from);
+  txSkel.from = fromAddress;
   txSkel.to = toAddress(to);
   txSkel.value = u256(value);
   if (!dataHex.empty()) { txSkel.data = fromHex(dataHex); }
-  txSkel.nonce = txNonce;
+  txSkel.nonce = 0;
   txSkel.gas = u256(gasLimit);
   txSkel.gasPrice = u256(gasPrice);
 
+  /**
+   * With EIP-1559 the given price (base fee + tip, as quoted) sets the tip,
+   * and the cap leaves room for the base fee to double before inclusion
+   * like the oracle's suggestions. Only the base fee and tip are paid.
+   */
+  if (dynamicFees) {
+    FeeEstimate fees = FeeOracle::getEstimate();
+    if (fees.eip1559) {
+      txSkel.txType = TransactionType::DynamicFee;
+      txSkel.maxPriorityFeePerGas = (txSkel.gasPrice > fees.baseFee)
+        ? txSkel.gasPrice - fees.baseFee : fees.normal.maxPriorityFeePerGas;
+      txSkel.maxFeePerGas = std::max(txSkel.gasPrice, fees.baseFee * 2 + txSkel.maxPriorityFeePerGas);
+    }
+  }
+
   // Support for EIP-155
   #ifdef TESTNET
     txSkel.chainId = 43113;
@@ -248,86 +518,285 @@ TransactionSkeleton Wallet::buildTransaction(
     txSkel.chainId = 43114;
   #endif
 
+  // Reserve the nonce locally, the node is only asked when the Account's nonces are stale.
+  // It's done last, so a transaction that fails to build never holds one
+  if (reserveNonce && !this->nonces.reserve(fromAddress, txSkel.nonce)) {
+    txSkel.nonce = Utils::MAX_U256_VALUE();
+  }
   return txSkel;
 }
 
+void Wallet::releaseNonce(const TransactionSkeleton& txSkel) {
+  this->nonces.release(txSkel.from, txSkel.nonce);
+}
+
+bool Wallet::reserveNonces(std::vector<TransactionSkeleton>& txSkels) {
+  if (txSkels.empty()) return true;
+  for (const TransactionSkeleton& txSkel : txSkels) {
+    if (txSkel.from != txSkels[0].from) {
+      Utils::logToDebug("Transaction batch has more than one sender");
+      return false;
+    }
+  }
+  u256 first;
+  if (!this->nonces.reserveRange(txSkels[0].from, txSkels.size(), first)) return false;
+  for (size_t i = 0; i < txSkels.size(); i++) txSkels[i].nonce = first + i;
+  return true;
+}
+
 std::string Wallet::signTransaction(TransactionSkeleton txSkel, std::string pass) {
-  Secret s = getSecret("0x" + boost::lexical_cast<std::string>(txSkel.from), pass);
-  std::stringstream txHexBuffer;
+  std::vector<std::string> ret = signTransactions({txSkel}, pass);
+  return ret[0];
+}
+
+std::vector<std::string> Wallet::signTransactions(
+  const std::vector<TransactionSkeleton>& txSkels, std::string pass
+) {
+  std::vector<std::string> ret(txSkels.size());
+  std::vector<TransactionBase> txs;
+  std::vector<std::pair<Secret, h256>> items;
+  std::map<Address, Secret> secrets;
 
   try {
-    TransactionBase t = TransactionBase(txSkel);
-    t.setNonce(txSkel.nonce);
-    t.sign(s);
-    txHexBuffer << toHex(t.rlp());
+    // Fetch each sender's secret once, the KDF only runs for locked Accounts
+    for (const TransactionSkeleton& txSkel : txSkels) {
+      auto it = secrets.find(txSkel.from);
+      if (it == secrets.end()) {
+        Secret s = this->session.secret(txSkel.from);
+        if (!s) s = getSecret("0x" + boost::lexical_cast<std::string>(txSkel.from), pass);
+        it = secrets.emplace(txSkel.from, s).first;
+      }
+      txs.emplace_back(txSkel);
+      txs.back().setNonce(txSkel.nonce);
+      items.emplace_back(it->second, txs.back().sha3(WithoutSignature));
+    }
   } catch (Exception& ex) {
     Utils::logToDebug(std::string("Invalid Transaction: ") + ex.what());
-    return "";
+    return ret;
+  }
+
+  // All signatures are done at once, in parallel
+  std::vector<Signature> sigs;
+  {
+    static Metrics::Histogram& hist = Metrics::histogram("avme_sign_seconds", "signer=\"wallet\"");
+    Metrics::Timer timer(hist);
+    sigs = dev::signBatch(items);
+  }
+  std::lock_guard<std::mutex> lk(this->signedSendersLock);
+  // Signed transactions that are never sent shouldn't pile up
+  if (this->signedSenders.size() + txs.size() > 256) this->signedSenders.clear();
+  for (size_t i = 0; i < txs.size(); i++) {
+    txs[i].signFromSigStruct(*(SignatureStruct const*)&sigs[i]);
+    if (!txs[i].hasSignature()) {
+      Utils::logToDebug("Invalid Transaction: signing failed");
+      continue;
+    }
+    ret[i] = toHex(txs[i].rlp());
+    this->signedSenders[txs[i].sha3()] = txSkels[i].from;
+  }
+  return ret;
+}
+
+std::string Wallet::sendTransaction(std::string txidHex, std::string operation, std::string* error) {
+  std::vector<std::string> errors;
+  std::vector<std::string> ret = sendTransactions({txidHex}, {operation}, &errors);
+  if (error != nullptr) *error = errors[0];
+  return ret[0];
+}
+
+std::vector<std::string> Wallet::sendTransactions(
+  const std::vector<std::string>& txidHexes, const std::vector<std::string>& operations,
+  std::vector<std::string>* errors
+) {
+  // Decode the transactions first, the senders and nonces are needed either way
+  std::vector<TxData> txDatas(txidHexes.size());
+  std::vector<std::string> unknownHexes;
+  std::vector<size_t> unknownIndexes;
+  {
+    std::lock_guard<std::mutex> lk(this->signedSendersLock);
+    for (size_t i = 0; i < txidHexes.size(); i++) {
+      auto it = this->signedSenders.find(dev::sha3(fromHex(txidHexes[i])));
+      if (it == this->signedSenders.end()) {
+        unknownHexes.push_back(txidHexes[i]);
+        unknownIndexes.push_back(i);
+        continue;
+      }
+      txDatas[i] = Utils::decodeRawTransaction(txidHexes[i], it->second);
+      this->signedSenders.erase(it);
+    }
+  }
+  // Senders of transactions signed elsewhere (e.g. on a Ledger) are recovered in one batch
+  std::vector<TxData> recovered = Utils::decodeRawTransactions(unknownHexes);
+  for (size_t i = 0; i < recovered.size(); i++) txDatas[unknownIndexes[i]] = recovered[i];
+  std::vector<Address> froms(txDatas.size());
+  std::vector<u256> nonces;
+  for (size_t i = 0; i < txDatas.size(); i++) {
+    Utils::parseAddress(txDatas[i].from, froms[i]);
+    nonces.push_back(boost::lexical_cast<u256>(txDatas[i].nonce));
+  }
+
+  // Send all transactions in one request
+  std::vector<std::string> broadcastErrors;
+  std::vector<std::string> txids = API::broadcastTxs(txidHexes, &broadcastErrors);
+
+  /**
+   * Failed nonces are given back highest first, so a failed tail of the
+   * batch is reused right away. If the node already saw a nonce, the local
+   * nonces are stale and have to be synced before the next transaction.
+   */
+  std::vector<std::string> ret(txidHexes.size());
+  std::vector<size_t> failed;
+  for (size_t i = 0; i < txidHexes.size(); i++) {
+    // A broadcast with no answer may still be mined, so its nonce stays in
+    // use and it's tracked by its own hash, but reported as not sent.
+    // One the node already has was sent before (e.g. a resend), so it's a success
+    bool unknown = API::isOutcomeUnknown(broadcastErrors[i]);
+    bool known = NonceManager::isKnownTxError(broadcastErrors[i]);
+    if (txids[i].empty() && !unknown && !known) { failed.push_back(i); continue; }
+    if (known) broadcastErrors[i] = "";
+    std::string txid = (txids[i].empty()) ? "0x" + txDatas[i].hex : txids[i];
+    this->nonces.markBroadcast(froms[i], nonces[i], txid);
+    #ifdef TESTNET
+      txDatas[i].txlink = "https://cchain.explorer.avax-test.network/tx/" + txid;
+    #else
+      txDatas[i].txlink = "https://cchain.explorer.avax.network/tx/" + txid;
+    #endif
+    if (unknown) {
+      broadcastErrors[i] = API::outcomeUnknown + ", check transaction " + txid;
+    } else {
+      ret[i] = txDatas[i].txlink;
+    }
+    txDatas[i].operation = (i < operations.size()) ? operations[i] : "";
+    txDatas[i].raw = txidHexes[i];
+    // History and receipts are handled in the background
+    this->tracker.track(froms[i], txDatas[i]);
   }
+  std::sort(failed.begin(), failed.end(), [&](size_t a, size_t b){ return nonces[a] > nonces[b]; });
+  for (size_t i : failed) {
+    if (NonceManager::isNonceError(broadcastErrors[i])) this->nonces.invalidate(froms[i]);
+    this->nonces.release(froms[i], nonces[i]);
+  }
+  if (errors != nullptr) *errors = broadcastErrors;
+  return ret;
+}
 
-  return txHexBuffer.str();
+std::string Wallet::speedUpTransaction(std::string txHash, std::string pass, std::string* error) {
+  return replaceTransaction(txHash, pass, false, error);
 }
 
-std::string Wallet::sendTransaction(std::string txidHex, std::string operation) {
-  // Send the transaction
-  std::string txid = API::broadcastTx(txidHex);
-  if (txid == "") { return ""; }
+std::string Wallet::cancelTransaction(std::string txHash, std::string pass, std::string* error) {
+  return replaceTransaction(txHash, pass, true, error);
+}
+
+std::string Wallet::replaceTransaction(std::string txHash, std::string pass, bool cancel, std::string* error) {
+  auto fail = [&](std::string msg) {
+    Utils::logToDebug("Couldn't replace transaction: " + msg);
+    if (error != nullptr) *error = msg;
+    return std::string();
+  };
+  if (txHash.substr(0, 2) == "0x") txHash = txHash.substr(2);
+  std::shared_ptr<const AccountSnapshot> snapshot = std::atomic_load(&this->current);
+  Address from = snapshot->account.first;
+  const std::vector<TxData>& history = snapshot->history;
+  const TxData* original = nullptr;
+  for (const TxData& tx : history) {
+    if (tx.hex == txHash) { original = &tx; break; }
+  }
+  if (original == nullptr) return fail("transaction not found in history");
+  if (original->confirmed || original->invalid) return fail("transaction is not pending anymore");
+  if (original->raw.empty()) return fail("transaction has no signed data to replace it from");
+
+  // The new fee has to beat every transaction already sent with this nonce
+  TransactionBase tx;
+  u256 gasPrice = 0, tip = 0;
+  try {
+    tx = TransactionBase(fromHex(original->raw), CheckTransaction::None);
+    for (const TxData& other : history) {
+      if (other.nonce != original->nonce || other.raw.empty() || other.confirmed || other.invalid) continue;
+      TransactionBase sent(fromHex(other.raw), CheckTransaction::None);
+      gasPrice = std::max(gasPrice, sent.gasPrice());
+      tip = std::max(tip, sent.maxPriorityFeePerGas());
+    }
+  } catch (std::exception const& e) {
+    return fail(std::string("invalid transaction in history: ") + e.what());
+  }
+  u256 bump = u256(1000 + unsigned(replacementBump * 1000));
+  FeeSuggestion fast = FeeOracle::suggest(FeeSpeed::Fast);
+
+  // Same nonce, either the same call or a 0-value transfer to the Account itself
+  TransactionSkeleton txSkel;
+  txSkel.creation = (!cancel && tx.isCreation());
+  txSkel.from = from;
+  txSkel.to = cancel ? from : tx.to();
+  txSkel.value = cancel ? 0 : tx.value();
+  if (!cancel) txSkel.data = tx.data();
+  txSkel.nonce = tx.nonce();
+  txSkel.gas = cancel ? u256(21000) : tx.gas();
+  txSkel.txType = tx.txType();
+  if (tx.isDynamicFee()) {
+    txSkel.maxPriorityFeePerGas = std::max((tip * bump + 999) / 1000, fast.maxPriorityFeePerGas);
+    txSkel.maxFeePerGas = std::max((gasPrice * bump + 999) / 1000, fast.maxFeePerGas);
+    txSkel.maxFeePerGas = std::max(txSkel.maxFeePerGas, txSkel.maxPriorityFeePerGas);
+  } else {
+    txSkel.gasPrice = std::max((gasPrice * bump + 999) / 1000, fast.gasPrice);
+  }
   #ifdef TESTNET
-    std::string txLink = "https://cchain.explorer.avax-test.network/tx/" + txid;
+    txSkel.chainId = 43113;
   #else
-    std::string txLink = "https://cchain.explorer.avax.network/tx/" + txid;
+    txSkel.chainId = 43114;
   #endif
 
-  /**
-   * Store the successful transaction in the Account's history.
-   * Since the AVAX chain is pretty fast, we can ask if the transaction was
-   * already confirmed even immediately after sending it.
-   */
-  TxData txData = Utils::decodeRawTransaction(txidHex);
-  txData.txlink = txLink;
-  txData.operation = operation;
-  saveTxToHistory(txData);
-  updateAllTxStatus();
-  return txLink;
+  std::string raw = signTransaction(txSkel, pass);
+  if (raw.empty()) return fail("signing failed");
+  {
+    std::lock_guard<std::mutex> lk(this->signedSendersLock);
+    this->signedSenders.erase(dev::sha3(fromHex(raw)));
+  }
+  std::string broadcastError;
+  std::string txid = API::broadcastTx(raw, &broadcastError);
+  bool unknown = API::isOutcomeUnknown(broadcastError);
+  bool known = NonceManager::isKnownTxError(broadcastError);
+  if (txid.empty() && !unknown && !known) {
+    // The nonce was used in the meantime, so the original (or a replacement) was mined
+    if (NonceManager::isNonceError(broadcastError)) this->tracker.pollNow();
+    return fail(broadcastError.empty() ? "broadcast failed" : broadcastError);
+  }
+
+  // The original is settled by the tracker once either of them is mined
+  TxData txData = Utils::decodeRawTransaction(raw, from);
+  if (txid.empty()) txid = "0x" + txData.hex;
+  this->nonces.markBroadcast(from, txSkel.nonce, txid);
+  #ifdef TESTNET
+    txData.txlink = "https://cchain.explorer.avax-test.network/tx/" + txid;
+  #else
+    txData.txlink = "https://cchain.explorer.avax.network/tx/" + txid;
+  #endif
+  txData.operation = cancel ? "Cancel " + original->operation : original->operation;
+  txData.raw = raw;
+  txData.replaces = original->hex;
+  this->tracker.track(from, txData);
+  if (unknown) return fail(API::outcomeUnknown + ", check transaction " + txid);
+  return txData.txlink;
 }
 
 json Wallet::txDataToJSON() {
-  json transactionsArray;
-  for (TxData savedTxData : this->currentAccountHistory) {
-    json savedTransaction;
-    savedTransaction["txlink"] = savedTxData.txlink;
-    savedTransaction["operation"] = savedTxData.operation;
-    savedTransaction["hex"] = savedTxData.hex;
-    savedTransaction["type"] = savedTxData.type;
-    savedTransaction["code"] = savedTxData.code;
-    savedTransaction["to"] = savedTxData.to;
-    savedTransaction["from"] = savedTxData.from;
-    savedTransaction["data"] = savedTxData.data;
-    savedTransaction["creates"] = savedTxData.creates;
-    savedTransaction["value"] = savedTxData.value;
-    savedTransaction["nonce"] = savedTxData.nonce;
-    savedTransaction["gas"] = savedTxData.gas;
-    savedTransaction["price"] = savedTxData.price;
-    savedTransaction["hash"] = savedTxData.hash;
-    savedTransaction["v"] = savedTxData.v;
-    savedTransaction["r"] = savedTxData.r;
-    savedTransaction["s"] = savedTxData.s;
-    savedTransaction["humanDate"] = savedTxData.humanDate;
-    savedTransaction["unixDate"] = savedTxData.unixDate;
-    savedTransaction["confirmed"] = savedTxData.confirmed;
-    savedTransaction["invalid"] = savedTxData.invalid;
-    transactionsArray.push_back(savedTransaction);
-  }
-  return transactionsArray;
+  return txsToJSON(std::atomic_load(&this->current)->history);
 }
 
-void Wallet::loadTxHistory() {
+std::mutex& Wallet::historyLock(const Address& account) {
+  std::lock_guard<std::mutex> lk(this->historyLocksLock);
+  std::unique_ptr<std::mutex>& m = this->historyLocks[account];
+  if (m == nullptr) m.reset(new std::mutex());
+  return *m;
+}
+
+std::vector<TxData> Wallet::readTxHistory(const Address& account) {
+  std::vector<TxData> ret;
   boost::filesystem::path txFilePath = Utils::walletFolderPath.string()
-    + "/wallet/c-avax/accounts/transactions/" + this->currentAccount.first.c_str();
+    + "/wallet/c-avax/accounts/transactions/" + Utils::addressString(account);
   json txData = json::parse(Utils::readJSONFile(txFilePath));
   try {
     json txArray = txData["transactions"];
-    this->currentAccountHistory.clear();
     for (auto& tx : txArray) {
       TxData txData;
       txData.txlink = tx["txlink"].get<std::string>();
@@ -351,80 +820,114 @@ void Wallet::loadTxHistory() {
       txData.unixDate = tx["unixDate"].get<uint64_t>();
       txData.confirmed = tx["confirmed"].get<bool>();
       txData.invalid = tx["invalid"].get<bool>();
-      this->currentAccountHistory.push_back(txData);
+      // Older records don't have these
+      txData.raw = tx.value("raw", std::string());
+      txData.replaces = tx.value("replaces", std::string());
+      ret.push_back(txData);
     }
   } catch (std::exception &e) {
     Utils::logToDebug(std::string("Couldn't load history for account ")
-      + this->currentAccount.first + " : " + txData["ERROR"].get<std::string>());
+      + Utils::addressString(account) + " : " + txData.value("ERROR", std::string(e.what())));
     // Uncomment to see output
-    //std::cout << "Couldn't load history for Account " << this->currentAccount.first
+    //std::cout << "Couldn't load history for Account " << account
     //          << ": " << txData["ERROR"].get<std::string>() << std::endl;
   }
+  return ret;
 }
 
-bool Wallet::saveTxToHistory(TxData TxData) {
-  loadTxHistory();
-  json transactionsRoot, transactionsArray, transaction;
-  transactionsArray = txDataToJSON();
-  boost::filesystem::path txFilePath = Utils::walletFolderPath.string()
-    + "/wallet/c-avax/accounts/transactions/" + this->currentAccount.first.c_str();
-
-  transaction["txlink"] = TxData.txlink;
-  transaction["operation"] = TxData.operation;
-  transaction["hex"] = TxData.hex;
-  transaction["type"] = TxData.type;
-  transaction["code"] = TxData.code;
-  transaction["to"] = TxData.to;
-  transaction["from"] = TxData.from;
-  transaction["data"] = TxData.data;
-  transaction["creates"] = TxData.creates;
-  transaction["value"] = TxData.value;
-  transaction["nonce"] = TxData.nonce;
-  transaction["gas"] = TxData.gas;
-  transaction["price"] = TxData.price;
-  transaction["hash"] = TxData.hash;
-  transaction["v"] = TxData.v;
-  transaction["r"] = TxData.r;
-  transaction["s"] = TxData.s;
-  transaction["humanDate"] = TxData.humanDate;
-  transaction["unixDate"] = TxData.unixDate;
-  transaction["confirmed"] = TxData.confirmed;
-  transaction["invalid"] = TxData.invalid;
-  transactionsArray.push_back(transaction);
+void Wallet::publishTxHistory(const Address& account, std::vector<TxData> history) {
+  std::lock_guard<std::mutex> lk(this->currentLock);
+  std::shared_ptr<const AccountSnapshot> snapshot = std::atomic_load(&this->current);
+  if (snapshot->account.first != account) return;
+  publish(this->current, AccountSnapshot{snapshot->account, std::move(history)});
+}
 
+void Wallet::loadTxHistory() {
+  Address account = std::atomic_load(&this->current)->account.first;
+  std::lock_guard<std::mutex> lk(historyLock(account));
+  publishTxHistory(account, readTxHistory(account));
+}
+
+bool Wallet::saveTxToHistory(TxData tx) {
+  return saveTxsToHistory({tx});
+}
+
+bool Wallet::saveTxsToHistory(const std::vector<TxData>& txs) {
+  return storeTxs(Utils::walletFolderPath, std::atomic_load(&this->current)->account.first, txs);
+}
+
+bool Wallet::storeTxs(
+  const boost::filesystem::path& folder, const Address& account, const std::vector<TxData>& txs
+) {
+  if (folder.empty()) return false; // Wallet was closed
+  std::lock_guard<std::mutex> lk(historyLock(account));
+  boost::filesystem::path txFilePath = folder.string()
+    + "/wallet/c-avax/accounts/transactions/" + Utils::addressString(account);
+  json transactionsRoot = json::parse(Utils::readJSONFile(txFilePath));
+  json transactionsArray = (transactionsRoot.contains("transactions")
+    && transactionsRoot["transactions"].is_array()) ? transactionsRoot["transactions"] : json::array();
+
+  // Records are matched by hash, so a transaction is either updated in place or added
+  for (const TxData& tx : txs) {
+    json transaction = txToJSON(tx);
+    bool found = false;
+    for (json& saved : transactionsArray) {
+      if (saved.contains("hex") && saved["hex"].is_string() && saved["hex"].get<std::string>() == tx.hex) {
+        saved = transaction;
+        found = true;
+        break;
+      }
+    }
+    if (!found) transactionsArray.push_back(transaction);
+  }
+  transactionsRoot = json();
   transactionsRoot["transactions"] = transactionsArray;
   std::string success = Utils::writeJSONFile(transactionsRoot, txFilePath);
 
   // Try/Catch logic is "inverted" - if there's no error it will throw,
   // meaning that it was successful.
+  bool ret = false;
   try {
     json err = json::parse(success);
     std::string errMsg = err["ERROR"].get<std::string>();
     Utils::logToDebug("Error happened when writing JSON file: " + errMsg);
   } catch (std::exception &e) {
-    loadTxHistory();
-    return true;
+    ret = true;
   }
-  loadTxHistory();
-  return false;
+  if (account == std::atomic_load(&this->current)->account.first) {
+    publishTxHistory(account, readTxHistory(account));
+  }
+  return ret;
 }
 
 bool Wallet::updateAllTxStatus() {
+  Address account = std::atomic_load(&this->current)->account.first;
+  std::lock_guard<std::mutex> lk(historyLock(account));
   boost::filesystem::path txFilePath = Utils::walletFolderPath.string()
-    + "/wallet/c-avax/accounts/transactions/" + this->currentAccount.first.c_str();
-  loadTxHistory();
-  u256 currentBlock = boost::lexical_cast<HexTo<u256>>(API::getCurrentBlock());
+    + "/wallet/c-avax/accounts/transactions/" + Utils::addressString(account);
+  std::vector<TxData> history = readTxHistory(account);
   try {
-    for (TxData &txData : this->currentAccountHistory) {
+    // Receipts of all unconfirmed transactions are fetched in one request
+    std::vector<TxData*> unconfirmed;
+    std::vector<std::string> hashes;
+    for (TxData &txData : history) {
       if (!txData.invalid && !txData.confirmed) {
-        const auto p1 = std::chrono::system_clock::now();
-        uint64_t now = std::chrono::duration_cast<std::chrono::seconds>(p1.time_since_epoch()).count();
-        std::string status = API::getTxStatus(txData.hex);
-        if (status == "0x1") txData.confirmed = true;
+        unconfirmed.push_back(&txData);
+        hashes.push_back(txData.hex);
+      }
+    }
+    if (!unconfirmed.empty()) {
+      u256 currentBlock = boost::lexical_cast<HexTo<u256>>(API::getCurrentBlock());
+      std::vector<json> receipts = API::getTxReceipts(hashes);
+      for (size_t i = 0; i < unconfirmed.size(); i++) {
+        const json& receipt = receipts[i];
+        if (!receipt.is_object() || !receipt.contains("status")) continue;
+        std::string status = receipt["status"].get<std::string>();
+        if (status == "0x1") unconfirmed[i]->confirmed = true;
         if (status == "0x0") {
-          u256 transactionBlock = boost::lexical_cast<HexTo<u256>>(API::getTxBlock(txData.hex));
+          u256 transactionBlock = boost::lexical_cast<HexTo<u256>>(receipt["blockNumber"].get<std::string>());
           if (currentBlock > transactionBlock) {
-            txData.invalid = true;
+            unconfirmed[i]->invalid = true;
           }
         }
       }
@@ -433,7 +936,7 @@ bool Wallet::updateAllTxStatus() {
     Utils::logToDebug(std::string("Error when updating AllTxStatus: ") + e.what());
   }
   json transactionsRoot, transactionsArray;
-  transactionsArray = txDataToJSON();
+  transactionsArray = txsToJSON(history);
   transactionsRoot["transactions"] = transactionsArray;
   std::string success = Utils::writeJSONFile(transactionsRoot, txFilePath);
   // Try/Catch logic is "inverted" - if there's no error it will throw,
@@ -443,10 +946,10 @@ bool Wallet::updateAllTxStatus() {
     std::string error = err["ERROR"].get<std::string>();
     Utils::logToDebug(std::string("Error happened when writing JSON file: ") + error);
   } catch (std::exception &e) {
-    loadTxHistory();
+    publishTxHistory(account, readTxHistory(account));
     return true;
   }
-  loadTxHistory();
+  publishTxHistory(account, readTxHistory(account));
   return false;
 }
 
@@ -4,10 +4,13 @@
 #ifndef WALLET_H
 #define WALLET_H
 
+#include <algorithm>
 #include <atomic>
 #include <fstream>
 #include <iosfwd>
 #include <iostream>
+#include <map>
+#include <memory>
 #include <mutex>
 #include <string>
 #include <thread>
@@ -29,8 +32,14 @@
 #include <lib/ethcore/TransactionBase.h>
 
 #include <network/API.h>
+#include <network/FeeOracle.h>
+#include <network/GasEstimator.h>
 #include <core/BIP39.h>
 #include <core/Database.h>
+#include <core/NonceManager.h>
+#include <core/SessionAuth.h>
+#include <core/SigningSession.h>
+#include <core/TxTracker.h>
 #include <core/Utils.h>
 
 using namespace dev;  // u256
@@ -38,6 +47,12 @@ using namespace dev::eth; // TransactionBase
 using namespace boost::algorithm;
 using namespace boost::filesystem;
 
+// The current Account (address and name) and its tx history, replaced as a whole.
+typedef struct AccountSnapshot {
+  std::pair<Address, std::string> account;
+  std::vector<TxData> history;
+} AccountSnapshot;
+
 /**
  * Class for the Wallet and related functions.
  * e.g. create/load, authenticate, manage Accounts and their tx history,
@@ -49,29 +64,126 @@ class Wallet {
     KeyManager km;
     Database db;
 
-    // Password hash, salt and the number of iterations used to create the hash.
-    bytesSec passHash;
-    h256 passSalt;
-    int passIterations = 100000;
+    // Session verifier for the passphrase (hash, salt and unlock tokens).
+    SessionAuth sessionAuth;
+
+    /**
+     * Registered ARC20 tokens, Accounts being used (by address) and the
+     * current Account, each published as an immutable snapshot (RCU-style).
+     * Readers atomically take the latest snapshot and keep it for as long as
+     * they need, without ever waiting on a writer. Writers build a new one
+     * and swap it in, serialized by the locks below.
+     */
+    std::shared_ptr<const std::vector<ARC20Token>> ARC20Tokens = std::make_shared<std::vector<ARC20Token>>();
+    std::shared_ptr<const std::map<Address, std::string>> accounts = std::make_shared<std::map<Address, std::string>>();
+    std::shared_ptr<const std::map<Address, std::string>> ledgerAccounts = std::make_shared<std::map<Address, std::string>>();
+    std::shared_ptr<const AccountSnapshot> current = std::make_shared<AccountSnapshot>();
+
+    // Serialize the writers of the token list, the Account lists and the
+    // current Account, respectively.
+    std::mutex tokensLock;
+    std::mutex accountsLock;
+    std::mutex currentLock;
+
+    // Guards every use of the KeyManager, even reads: decrypting a key
+    // caches it in the store. Taken after accountsLock when both are held.
+    std::mutex kmLock;
+
+    // Secrets of Accounts unlocked for signing without rerunning the KDF.
+    SigningSession session;
+
+    // Local nonces of the Accounts, and their in-flight transactions.
+    NonceManager nonces;
+
+    // Senders of transactions signed here but not sent yet, by tx hash,
+    // so sendTransaction() doesn't have to recover them from the signature.
+    std::map<h256, Address> signedSenders;
+    std::mutex signedSendersLock;
+
+    // Wall-clock budget for encrypting a new Account key (keystore scrypt).
+    std::chrono::milliseconds kdfBudget{1000};
+
+    // Serialize read-modify-write cycles of the history files, one lock per Account.
+    std::map<Address, std::unique_ptr<std::mutex>> historyLocks;
+    std::mutex historyLocksLock;
+
+    /**
+     * Get the history lock of an Account, creating it on first use.
+     */
+    std::mutex& historyLock(const Address& account);
+
+    /**
+     * Read an Account's tx history from its file.
+     * Returns the transactions, or an empty list on failure.
+     */
+    std::vector<TxData> readTxHistory(const Address& account);
+
+    /**
+     * Publish a new tx history for the current Account, unless another
+     * Account was set in the meantime. Must be called with the Account's history lock held.
+     */
+    void publishTxHistory(const Address& account, std::vector<TxData> history);
+
+    // Chain subscriptions on the API's WebSocket (new blocks and the Accounts'
+    // token transfers), the function called when a balance changes, and their mutex.
+    std::shared_ptr<WsClient> watchWs;
+    uint64_t headsSub = 0;
+    std::vector<uint64_t> transferSubs;
+    std::function<void(const Address&)> balanceListener;
+    std::mutex watchLock;
+
+    /**
+     * (Re)subscribe to token transfers from/to the loaded Accounts, and to
+     * new blocks if not done yet. Does nothing if the WebSocket isn't enabled.
+     */
+    void watchAccounts();
+
+    /**
+     * Cancel all chain subscriptions.
+     */
+    void unwatchAccounts();
 
-    // List of registered ARC20 tokens.
-    std::vector<ARC20Token> ARC20Tokens;
+    // Background tracker that stores sent transactions and waits for their receipts.
+    // Declared last so its thread stops before the members it writes to are destroyed.
+    TxTracker tracker;
 
-    // Current Account and its tx history.
-    std::pair<std::string, std::string> currentAccount;
-    std::vector<TxData> currentAccountHistory;
+    /**
+     * Insert or update (by hash) transactions in an Account's history file
+     * inside the given Wallet folder, reloading the list if it's the current Account.
+     * Returns true on success, false on failure.
+     */
+    bool storeTxs(
+      const boost::filesystem::path& folder, const Address& account, const std::vector<TxData>& txs
+    );
 
-    // Lists of Accounts being used.
-    std::map<std::string, std::string> accounts;
-    std::map<std::string, std::string> ledgerAccounts;
+    /**
+     * Re-sign and broadcast a pending transaction with a higher fee,
+     * for speedUpTransaction() and cancelTransaction().
+     */
+    std::string replaceTransaction(std::string txHash, std::string pass, bool cancel, std::string* error);
 
   public:
-    // Getters for private vars
-    std::vector<ARC20Token> getARC20Tokens() { return this->ARC20Tokens; }
-    std::pair<std::string, std::string> getCurrentAccount() { return this->currentAccount; }
-    std::vector<TxData> getCurrentAccountHistory() { return this->currentAccountHistory; }
-    std::map<std::string, std::string> getAccounts() { return this->accounts; }
-    std::map<std::string, std::string> getLedgerAccounts() { return this->ledgerAccounts; }
+    // Whether transactions are built as EIP-1559 ones when the chain supports it.
+    static bool dynamicFees;
+
+    // Least fee increase for a replacement transaction (nodes require 10%).
+    static double replacementBump;
+
+    // Chain subscriptions point back to this Wallet, so they're cancelled first.
+    ~Wallet() { unwatchAccounts(); }
+
+    // Getters for private vars, copied from their latest snapshots
+    std::vector<ARC20Token> getARC20Tokens() { return *std::atomic_load(&this->ARC20Tokens); }
+    std::pair<Address, std::string> getCurrentAccount() { return std::atomic_load(&this->current)->account; }
+    std::vector<TxData> getCurrentAccountHistory() { return std::atomic_load(&this->current)->history; }
+    std::map<Address, std::string> getAccounts() { return *std::atomic_load(&this->accounts); }
+    std::map<Address, std::string> getLedgerAccounts() { return *std::atomic_load(&this->ledgerAccounts); }
+
+    /**
+     * Get the current Account and its tx history as one consistent snapshot,
+     * without copying them.
+     */
+    std::shared_ptr<const AccountSnapshot> getCurrentAccountSnapshot() { return std::atomic_load(&this->current); }
 
     // ======================================================================
     // WALLET MANAGEMENT
@@ -102,17 +214,47 @@ class Wallet {
      */
     bool isLoaded();
 
+    /**
+     * Set the wall-clock budget for encrypting new Account keys and pick the
+     * keystore's scrypt parameters for it on this machine. Strength never goes
+     * below the default (n = 2^18, r = 8, p = 1), a larger budget adds more
+     * memory/rounds (up to 1GB per key).
+     * Done automatically with the default budget, in the background, when the
+     * first Wallet is loaded.
+     */
+    void setKDFBudget(std::chrono::milliseconds budget);
+
     /**
      * Check if the passphrase input matches the stored hash.
      * Returns true on success, false on failure.
      */
     bool auth(std::string pass);
 
+    /**
+     * Set the KDF cost (PBKDF2 iterations) of the session verifier.
+     * Takes effect on the next Wallet load.
+     */
+    void setAuthIterations(unsigned int iterations) { this->sessionAuth.setIterations(iterations); }
+
+    /**
+     * Check the passphrase and, if it's correct, issue an unlock token
+     * valid for a given number of seconds, to be checked with authToken().
+     * Returns the token, or an empty string on failure.
+     */
+    std::string issueAuthToken(std::string pass, unsigned int ttl = 60);
+
+    /**
+     * Check if an unlock token is still valid / revoke it, respectively.
+     * Returns true on success, false on failure.
+     */
+    bool authToken(std::string token);
+    void revokeAuthToken(std::string token);
+
     /**
      * (Re)Load and close the token and tx history databases, respectively.
      */
     bool loadTokenDB();
-    bool loadHistoryDB(std::string address);
+    bool loadHistoryDB(const Address& address);
     void closeTokenDB();
     void closeHistoryDB();
 
@@ -129,19 +271,19 @@ class Wallet {
      * Register a new ARC20 token into the Wallet.
      */
     bool addARC20Token(
-      std::string address, std::string symbol, std::string name,
+      const Address& address, std::string symbol, std::string name,
       int decimals, std::string avaxPairContract
     );
 
     /**
      * Remove an ARC20 token from the Wallet.
      */
-    bool removeARC20Token(std::string address);
+    bool removeARC20Token(const Address& address);
 
     /**
      * Check if a token was already added.
      */
-    bool ARC20TokenWasAdded(std::string address);
+    bool ARC20TokenWasAdded(const Address& address);
 
     // ======================================================================
     // ACCOUNT MANAGEMENT
@@ -163,28 +305,39 @@ class Wallet {
       std::string &seed, int64_t index, std::string name, std::string &pass
     );
 
+    /**
+     * Create/import many Accounts at once from the same seed, given their
+     * indexes and names. Keys are encrypted in parallel and written in one pass.
+     * Automatically reloads the Account list on success.
+     * Returns a list of address/name pairs, or an empty list on failure.
+     */
+    std::vector<std::pair<std::string, std::string>> createAccounts(
+      std::string &seed, std::vector<std::pair<int64_t, std::string>> const& accounts, std::string &pass
+    );
+
     /**
      * Import a Ledger account to the Wallet's account vector.
      */
-    void importLedgerAccount(std::string address, std::string path);
+    void importLedgerAccount(const Address& address, std::string path);
 
     /**
      * Erase an Account from the Wallet.
      * Automatically reloads the Account list on success.
      * Returns true on success, false on failure.
      */
-    bool eraseAccount(std::string address);
+    bool eraseAccount(const Address& address);
 
     /**
      * Check if an Account exists (is loaded on the list).
      * Returns true on success, false on failure.
      */
-    bool accountExists(std::string address);
+    bool accountExists(const Address& address);
 
     /**
      * Set the current Account to be used by the Wallet.
+     * Its pending transactions are tracked until confirmed.
      */
-    void setCurrentAccount(std::string address);
+    void setCurrentAccount(const Address& address);
 
     /**
      * Check if there's an Account being used by the Wallet.
@@ -206,6 +359,26 @@ class Wallet {
      */
     Secret getSecret(std::string const& account, std::string pass);
 
+    /**
+     * Unlock an Account for signing during a given number of seconds.
+     * Decrypts the key once (running the KDF) and keeps the secret in
+     * locked memory, so signTransaction() can skip decryption until it expires.
+     * Returns true on success, false on failure (e.g. wrong passphrase).
+     */
+    bool unlockAccount(std::string const& address, std::string pass, unsigned int ttl = 300);
+
+    /**
+     * Lock an Account / all Accounts again, wiping their secrets from memory.
+     */
+    void lockAccount(std::string const& address);
+    void lockAllAccounts();
+
+    /**
+     * Get the remaining unlocked time for an Account.
+     * Returns the number of seconds left, or 0 if the Account is locked.
+     */
+    unsigned int accountUnlockedFor(std::string const& address);
+
     // ======================================================================
     // TRANSACTION MANAGEMENT
     // ======================================================================
@@ -216,30 +389,129 @@ class Wallet {
      * being the destination address.
      * Token transactions would have a filled dataHex, 0 txValue and
      * the "to" address being the token contract's address.
-     * Returns a skeleton filled with data for the transaction, which has to be signed.
+     * The nonce is reserved for this transaction until it's sent, so if it
+     * won't be sent after all it has to be given back with releaseNonce().
+     * If reserveNonce is false the nonce is left for reserveNonces() to assign.
+     * With dynamicFees on an EIP-1559 chain, the part of gasPrice above the
+     * current base fee becomes the tip (maxPriorityFeePerGas), and the fee
+     * cap (maxFeePerGas) is twice the base fee plus the tip, like the fee
+     * oracle's, so the transaction isn't stuck if the base fee rises.
+     * Only the base fee at inclusion plus the tip is actually paid.
+     * Returns a skeleton filled with data for the transaction, which has to be signed,
+     * or a skeleton with the nonce set to Utils::MAX_U256_VALUE() on failure.
      */
     TransactionSkeleton buildTransaction(
       std::string from, std::string to, std::string value,
-      std::string gasLimit, std::string gasPrice, std::string dataHex = ""
+      std::string gasLimit, std::string gasPrice, std::string dataHex = "",
+      bool reserveNonce = true
     );
 
+    /**
+     * Give back the nonce reserved for a transaction that won't be sent.
+     */
+    void releaseNonce(const TransactionSkeleton& txSkel);
+
+    /**
+     * Assign consecutive nonces to an ordered list of transactions from
+     * the same Account (e.g. an approval followed by a swap, or payouts),
+     * reserving them all at once. Unused ones have to be given back with releaseNonce().
+     * Returns true on success, false on failure.
+     */
+    bool reserveNonces(std::vector<TransactionSkeleton>& txSkels);
+
     /**
      * Sign a transaction with user credentials.
+     * If the sender Account is unlocked, its session secret is used
+     * and the passphrase is not checked.
      * Returns a string with the raw signed transaction in Hex,
      * or an empty string on failure.
      */
     std::string signTransaction(TransactionSkeleton txSkel, std::string pass);
 
     /**
-     * Send a signed transaction for broadcast and store it in history if successful.
+     * Sign many transactions with user credentials, in parallel.
+     * Each sender's secret is fetched only once.
+     * Returns the raw signed transactions in Hex in the same order,
+     * with an empty string for each transaction that failed.
+     */
+    std::vector<std::string> signTransactions(
+      const std::vector<TransactionSkeleton>& txSkels, std::string pass
+    );
+
+    /**
+     * Send a signed transaction for broadcast.
+     * Returns as soon as the node accepts it, the transaction is stored in
+     * history and tracked until confirmed in the background.
+     * Its nonce is marked as in flight, or given back if the broadcast failed.
+     * If given, error is set to the node's error message on failure.
      * Returns a link to the transaction in the blockchain, or an empty string on failure.
      */
-    std::string sendTransaction(std::string txidHex, std::string operation);
+    std::string sendTransaction(std::string txidHex, std::string operation, std::string* error = nullptr);
+
+    /**
+     * Send many signed transactions for broadcast in one request.
+     * Returns as soon as the node accepts them, the successful ones are
+     * stored in history and tracked until confirmed in the background.
+     * Nonces of failed transactions are given back.
+     * Transactions whose broadcast went unanswered (API::outcomeUnknown) count
+     * as failed, but keep their nonces and are tracked by hash like sent ones.
+     * Ones the node already has ("already known") count as sent.
+     * If given, errors is set to the node's error message for each transaction.
+     * Returns the links to the transactions in the same order, with an
+     * empty string for each transaction that failed.
+     */
+    std::vector<std::string> sendTransactions(
+      const std::vector<std::string>& txidHexes, const std::vector<std::string>& operations,
+      std::vector<std::string>* errors = nullptr
+    );
+
+    /**
+     * Replace a pending transaction of the current Account with one using the
+     * same nonce and a higher fee, so it's mined sooner (speed up) or not at
+     * all (cancel, with a 0-value transfer to itself instead).
+     * The fee is raised by at least replacementBump over the highest fee
+     * already sent with that nonce, and to at least the fee oracle's "fast" one.
+     * The new transaction is tracked and stored in history linked to the
+     * original, and whichever of them is mined settles the other.
+     * If given, error is set to the reason on failure.
+     * Returns a link to the new transaction in the blockchain, or an empty string on failure.
+     */
+    std::string speedUpTransaction(std::string txHash, std::string pass, std::string* error = nullptr);
+    std::string cancelTransaction(std::string txHash, std::string pass, std::string* error = nullptr);
 
     // ======================================================================
     // HISTORY MANAGEMENT
     // ======================================================================
 
+    /**
+     * Set the function called for each sent transaction once it's confirmed
+     * or failed, with the sender Account and the updated history record.
+     */
+    void setTxListener(TxListener listener) { this->tracker.setListener(listener); }
+
+    /**
+     * Get the number of sent transactions still waiting to be confirmed.
+     */
+    size_t pendingTxCount() { return this->tracker.pending(); }
+
+    /**
+     * Set the function called with an Account's address when one of its token
+     * balances changed (pushed through the WebSocket, if it's enabled).
+     */
+    void setBalanceListener(std::function<void(const Address&)> listener);
+
+    /**
+     * Check the statuses of all pending transactions right away,
+     * instead of waiting for the next block or their backoff.
+     */
+    void checkPendingTxs() { this->tracker.pollNow(); }
+
+    /**
+     * Report a new block from a push source (e.g. a newHeads subscription),
+     * so pending transactions are checked without polling for blocks.
+     */
+    void notifyBlock(const u256& number) { this->tracker.notifyBlock(number); }
+
     /**
      * Convert the transaction history from the current Account to a JSON array.
      */
@@ -256,9 +528,17 @@ class Wallet {
      */
     bool saveTxToHistory(TxData tx);
 
+    /**
+     * Save many new transactions to the history at once and reload the list.
+     * Returns true on success, false on failure.
+     */
+    bool saveTxsToHistory(const std::vector<TxData>& txs);
+
     /**
      * Query the confirmed status of *all* transactions made from the
      * current Account in the API and update accordingly, then reload the list.
+     * Pending transactions are already kept up to date in the background,
+     * so this is only needed to re-check the whole history.
      * Returns true on success, false on failure.
      */
     bool updateAllTxStatus();
@@ -0,0 +1,460 @@
+// Copyright (c) 2020-2021 AVME Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+#include "DaemonRPC.h"
+
+#include <set>
+
+// JSON-RPC error codes, the last two are the daemon's own
+static const int INVALID_REQUEST = -32600;
+static const int METHOD_NOT_FOUND = -32601;
+static const int INVALID_PARAMS = -32602;
+static const int INTERNAL_ERROR = -32603;
+static const int WALLET_ERROR = -32000;
+static const int NOT_LOADED = -32001;
+
+// Get a string param (numbers are taken as their decimal form).
+static std::string getString(
+  const json& params, const std::string& name, bool required = true, std::string def = ""
+) {
+  if (!params.contains(name) || params[name].is_null()) {
+    if (required) throw RPCError(INVALID_PARAMS, "missing param: " + name);
+    return def;
+  }
+  const json& value = params[name];
+  if (value.is_string()) return value.get<std::string>();
+  if (value.is_number_unsigned()) return std::to_string(value.get<uint64_t>());
+  throw RPCError(INVALID_PARAMS, "invalid param: " + name);
+}
+
+// Get an address param.
+static Address getAddress(const json& params, const std::string& name) {
+  Address ret;
+  if (!Utils::parseAddress(getString(params, name), ret)) {
+    throw RPCError(INVALID_PARAMS, "invalid address: " + name);
+  }
+  return ret;
+}
+
+// Get an amount param in Wei, as a decimal string.
+static std::string getWei(const json& params, const std::string& name, bool required = true) {
+  std::string ret = getString(params, name, required, "0");
+  if (ret.empty() || ret.size() > 78 || ret.find_first_not_of("0123456789") != std::string::npos) {
+    throw RPCError(INVALID_PARAMS, "invalid amount in Wei: " + name);
+  }
+  return ret;
+}
+
+// Check a transaction from the params and normalize its fields.
+// Gas limit and price are left out if not given, to be filled by fillGas().
+static json parseTx(const json& tx) {
+  if (!tx.is_object()) throw RPCError(INVALID_PARAMS, "transactions must be objects");
+  json ret;
+  ret["from"] = Utils::addressString(getAddress(tx, "from"));
+  ret["to"] = Utils::addressString(getAddress(tx, "to"));
+  ret["value"] = getWei(tx, "value", false);
+  ret["data"] = getString(tx, "data", false);
+  ret["operation"] = getString(tx, "operation", false, "Send AVAX");
+  if (tx.contains("gas")) ret["gas"] = getWei(tx, "gas");
+  if (tx.contains("gasPrice")) ret["gasPrice"] = getWei(tx, "gasPrice");
+  std::string data = ret["data"].get<std::string>();
+  if (data.substr(0, 2) == "0x") data = data.substr(2);
+  if (data.size() % 2 != 0 || data.find_first_not_of("0123456789abcdefABCDEF") != std::string::npos) {
+    throw RPCError(INVALID_PARAMS, "invalid param: data");
+  }
+  return ret;
+}
+
+// Hash of a signed transaction in Hex.
+static std::string txHash(const std::string& signedTx) {
+  TransactionBase tx(fromHex(signedTx), CheckTransaction::None);
+  return "0x" + toHex(tx.sha3());
+}
+
+DaemonRPC::DaemonRPC() {
+  // Wallet management
+  methods["avme_load"] = [this](const json& params) {
+    std::string folder = getString(params, "folder");
+    std::string pass = getString(params, "pass");
+    std::unique_lock<std::shared_timed_mutex> lk(this->walletLock);
+    if (this->w.isLoaded()) { this->w.close(); this->w.closeTokenDB(); }
+    if (!this->w.load(folder, pass)) throw RPCError(WALLET_ERROR, "couldn't load the Wallet");
+    if (!this->w.loadTokenDB()) {
+      this->w.close();
+      throw RPCError(WALLET_ERROR, "couldn't open the token database");
+    }
+    this->w.loadARC20Tokens();
+    this->w.loadAccounts();
+    return json({{"accounts", this->w.getAccounts().size()}});
+  };
+  methods["avme_close"] = [this](const json&) {
+    std::unique_lock<std::shared_timed_mutex> lk(this->walletLock);
+    if (this->w.isLoaded()) { this->w.close(); this->w.closeTokenDB(); }
+    return json(true);
+  };
+  methods["avme_status"] = [this](const json&) {
+    std::shared_lock<std::shared_timed_mutex> lk(this->walletLock);
+    json ret;
+    ret["loaded"] = this->w.isLoaded();
+    ret["accounts"] = this->w.getAccounts().size();
+    ret["pendingTxs"] = this->w.pendingTxCount();
+    return ret;
+  };
+
+  // Accounts
+  methods["avme_accounts"] = [this](const json&) {
+    std::shared_lock<std::shared_timed_mutex> lk(this->walletLock);
+    requireLoaded();
+    json ret = json::array();
+    for (const std::pair<const Address, std::string>& acc : this->w.getAccounts()) {
+      std::string address = Utils::addressString(acc.first, true);
+      ret.push_back({
+        {"address", address}, {"name", acc.second},
+        {"unlockedFor", this->w.accountUnlockedFor(address)}
+      });
+    }
+    return ret;
+  };
+  methods["avme_unlock"] = [this](const json& params) {
+    Address address = getAddress(params, "address");
+    std::string pass = getString(params, "pass");
+    unsigned int ttl = std::stoul(getString(params, "ttl", false, "300"));
+    std::shared_lock<std::shared_timed_mutex> lk(this->walletLock);
+    requireLoaded();
+    if (!this->w.accountExists(address)) throw RPCError(WALLET_ERROR, "unknown Account");
+    if (!this->w.unlockAccount(Utils::addressString(address), pass, ttl)) {
+      throw RPCError(WALLET_ERROR, "couldn't unlock the Account");
+    }
+    return json({{"unlockedFor", this->w.accountUnlockedFor(Utils::addressString(address))}});
+  };
+  methods["avme_lock"] = [this](const json& params) {
+    std::shared_lock<std::shared_timed_mutex> lk(this->walletLock);
+    requireLoaded();
+    if (params.contains("address")) {
+      this->w.lockAccount(Utils::addressString(getAddress(params, "address")));
+    } else {
+      this->w.lockAllAccounts();
+    }
+    return json(true);
+  };
+  methods["avme_getBalance"] = [this](const json& params) {
+    Address address = getAddress(params, "address");
+    std::shared_lock<std::shared_timed_mutex> lk(this->walletLock);
+    requireLoaded();
+    return getBalance(address);
+  };
+
+  // Transactions
+  methods["avme_send"] = [this](const json& params) {
+    json txs = json::array({parseTx(params)});
+    std::string pass = getString(params, "pass", false);
+    std::string speed = getString(params, "speed", false, "normal");
+    std::shared_lock<std::shared_timed_mutex> lk(this->walletLock);
+    requireLoaded();
+    Address from;
+    Utils::parseAddress(txs[0]["from"].get<std::string>(), from);
+    if (!this->w.accountExists(from)) throw RPCError(WALLET_ERROR, "unknown Account");
+    std::lock_guard<std::mutex> accLk(accountLock(from));
+    fillGas(txs, speed);
+    return send(txs[0], pass);
+  };
+  methods["avme_sendBatch"] = [this](const json& params) {
+    if (!params.contains("txs") || !params["txs"].is_array() || params["txs"].empty()) {
+      throw RPCError(INVALID_PARAMS, "missing param: txs");
+    }
+    json txs = json::array();
+    for (const json& tx : params["txs"]) txs.push_back(parseTx(tx));
+    std::string pass = getString(params, "pass", false);
+    std::string speed = getString(params, "speed", false, "normal");
+    std::shared_lock<std::shared_timed_mutex> lk(this->walletLock);
+    requireLoaded();
+
+    // Senders are locked in address order, so two batches can't deadlock
+    std::set<Address> senders;
+    for (const json& tx : txs) {
+      Address from;
+      Utils::parseAddress(tx["from"].get<std::string>(), from);
+      if (!this->w.accountExists(from)) throw RPCError(WALLET_ERROR, "unknown Account");
+      senders.insert(from);
+    }
+    std::vector<std::unique_lock<std::mutex>> accLks;
+    for (const Address& from : senders) accLks.emplace_back(accountLock(from));
+    fillGas(txs, speed);
+    return sendBatch(txs, pass);
+  };
+  methods["avme_speedUp"] = [this](const json& params) { return replace(params, false); };
+  methods["avme_cancel"] = [this](const json& params) { return replace(params, true); };
+
+  // History, which is read through the current Account
+  methods["avme_history"] = [this](const json& params) {
+    Address address = getAddress(params, "address");
+    std::unique_lock<std::shared_timed_mutex> lk(this->walletLock);
+    requireLoaded();
+    if (!this->w.accountExists(address)) throw RPCError(WALLET_ERROR, "unknown Account");
+    this->w.setCurrentAccount(address);
+    json ret = this->w.txDataToJSON();
+    return (ret.is_null()) ? json::array() : ret;
+  };
+
+  // Tokens
+  methods["avme_tokens"] = [this](const json&) {
+    std::shared_lock<std::shared_timed_mutex> lk(this->walletLock);
+    requireLoaded();
+    json ret = json::array();
+    for (const ARC20Token& token : this->w.getARC20Tokens()) {
+      ret.push_back({
+        {"address", token.address}, {"symbol", token.symbol}, {"name", token.name},
+        {"decimals", token.decimals}, {"avaxPairContract", token.avaxPairContract}
+      });
+    }
+    return ret;
+  };
+  methods["avme_addToken"] = [this](const json& params) {
+    Address address = getAddress(params, "address");
+    std::string symbol = getString(params, "symbol");
+    std::string name = getString(params, "name");
+    int decimals = std::stoi(getString(params, "decimals"));
+    std::string pair = getString(params, "avaxPairContract", false);
+    std::unique_lock<std::shared_timed_mutex> lk(this->walletLock);
+    requireLoaded();
+    if (this->w.ARC20TokenWasAdded(address)) throw RPCError(WALLET_ERROR, "token already added");
+    if (!this->w.addARC20Token(address, symbol, name, decimals, pair)) {
+      throw RPCError(WALLET_ERROR, "couldn't add the token");
+    }
+    return json(true);
+  };
+  methods["avme_removeToken"] = [this](const json& params) {
+    Address address = getAddress(params, "address");
+    std::unique_lock<std::shared_timed_mutex> lk(this->walletLock);
+    requireLoaded();
+    if (!this->w.removeARC20Token(address)) throw RPCError(WALLET_ERROR, "couldn't remove the token");
+    return json(true);
+  };
+}
+
+std::mutex& DaemonRPC::accountLock(const Address& address) {
+  std::lock_guard<std::mutex> lk(this->accountLocksLock);
+  std::unique_ptr<std::mutex>& m = this->accountLocks[address];
+  if (m == nullptr) m.reset(new std::mutex());
+  return *m;
+}
+
+void DaemonRPC::requireLoaded() {
+  if (!this->w.isLoaded()) throw RPCError(NOT_LOADED, "no Wallet loaded");
+}
+
+json DaemonRPC::getBalance(const Address& address) {
+  // Same requests as the GUI: eth_getBalance plus a balanceOf call per token
+  std::string addressStr = Utils::addressString(address);
+  std::vector<ARC20Token> tokenList = this->w.getARC20Tokens();
+  std::vector<Request> reqs;
+  reqs.push_back({1, "2.0", "eth_getBalance", {addressStr, "latest"}});
+  for (const ARC20Token& token : tokenList) {
+    json params;
+    params["to"] = token.address;
+    params["data"] = "0x70a08231000000000000000000000000" + addressStr.substr(2);
+    reqs.push_back({reqs.size() + size_t(1), "2.0", "eth_call", {params, "latest"}});
+  }
+  std::string resp = API::httpGetRequest(API::buildMultiRequest(reqs));
+
+  // Batch answers may come in any order, so match them by id
+  std::map<uint64_t, u256> balances;
+  try {
+    json respArr = json::parse(resp);
+    if (!respArr.is_array()) throw std::runtime_error("not a batch response");
+    for (const json& r : respArr) {
+      if (!r.contains("id") || !r["id"].is_number() || !r.contains("result") || !r["result"].is_string()) continue;
+      u256 balance = boost::lexical_cast<HexTo<u256>>(r["result"].get<std::string>());
+      balances[r["id"].get<uint64_t>()] = balance;
+    }
+  } catch (std::exception const& e) {
+    Utils::logToDebug(std::string("Balance request failed: ") + e.what());
+  }
+  if (!balances.count(1)) throw RPCError(WALLET_ERROR, "no answer from the node");
+
+  json ret;
+  std::string wei = boost::lexical_cast<std::string>(balances[1]);
+  ret["address"] = Utils::addressString(address, true);
+  ret["balance"] = wei;
+  ret["amount"] = Utils::weiToFixedPoint(wei, 18);
+  ret["tokens"] = json::array();
+  for (size_t i = 0; i < tokenList.size(); i++) {
+    auto it = balances.find(i + 2);
+    json token;
+    token["address"] = tokenList[i].address;
+    token["symbol"] = tokenList[i].symbol;
+    if (it != balances.end()) {
+      std::string tokenWei = boost::lexical_cast<std::string>(it->second);
+      token["balance"] = tokenWei;
+      token["amount"] = Utils::weiToFixedPoint(tokenWei, tokenList[i].decimals);
+    } else {
+      token["error"] = "no answer from the node";
+    }
+    ret["tokens"].push_back(token);
+  }
+  return ret;
+}
+
+void DaemonRPC::fillGas(json& txs, const std::string& speed) {
+  std::vector<GasQuery> queries;
+  std::vector<size_t> indexes;
+  bool needsPrice = false;
+  for (size_t i = 0; i < txs.size(); i++) {
+    const json& tx = txs[i];
+    if (!tx.contains("gasPrice")) needsPrice = true;
+    if (tx.contains("gas")) continue;
+    std::string value = tx["value"].get<std::string>();
+    std::string data = tx["data"].get<std::string>();
+    queries.push_back({
+      tx["from"].get<std::string>(), tx["to"].get<std::string>(),
+      (value == "0") ? "" : "0x" + Utils::uintToHex(value, false),
+      (data.empty() || data.substr(0, 2) == "0x") ? data : "0x" + data
+    });
+    indexes.push_back(i);
+  }
+  if (!queries.empty()) {
+    std::vector<std::string> errors;
+    std::vector<u256> limits = GasEstimator::estimate(queries, &errors);
+    for (size_t i = 0; i < indexes.size(); i++) {
+      if (limits[i] == 0) {
+        throw RPCError(WALLET_ERROR,
+          "couldn't estimate gas for transaction " + std::to_string(indexes[i]) + ": " + errors[i]
+        );
+      }
+      txs[indexes[i]]["gas"] = boost::lexical_cast<std::string>(limits[i]);
+    }
+  }
+  if (needsPrice) {
+    // On EIP-1559 chains the Wallet splits the quoted price into base fee and tip
+    FeeEstimate fees = FeeOracle::getEstimate();
+    FeeSpeed feeSpeed = FeeOracle::speedFromString(speed);
+    FeeSuggestion fee = (feeSpeed == FeeSpeed::Slow) ? fees.slow
+      : (feeSpeed == FeeSpeed::Fast) ? fees.fast : fees.normal;
+    for (json& tx : txs) {
+      if (!tx.contains("gasPrice")) tx["gasPrice"] = boost::lexical_cast<std::string>(fee.gasPrice);
+    }
+  }
+}
+
+json DaemonRPC::send(const json& tx, const std::string& pass) {
+  std::string from = tx["from"].get<std::string>();
+  auto attempt = [&](std::string& signedTx, std::string& error) {
+    TransactionSkeleton txSkel = this->w.buildTransaction(
+      from, tx["to"].get<std::string>(), tx["value"].get<std::string>(),
+      tx["gas"].get<std::string>(), tx["gasPrice"].get<std::string>(), tx["data"].get<std::string>()
+    );
+    if (txSkel.nonce == Utils::MAX_U256_VALUE()) {
+      error = "couldn't build the transaction";
+      return std::string();
+    }
+    signedTx = this->w.signTransaction(txSkel, pass);
+    if (signedTx.empty()) {
+      this->w.releaseNonce(txSkel);
+      error = "couldn't sign the transaction (wrong passphrase?)";
+      return std::string();
+    }
+    return this->w.sendTransaction(signedTx, tx["operation"].get<std::string>(), &error);
+  };
+
+  // If the node says the nonce was already used, the Wallet resyncs the
+  // Account's nonces, so rebuilding once is enough to get a fresh one
+  std::string signedTx, error;
+  std::string txLink = attempt(signedTx, error);
+  if (txLink.empty() && NonceManager::isNonceError(error)) {
+    error.clear();
+    txLink = attempt(signedTx, error);
+  }
+  if (txLink.empty()) throw RPCError(WALLET_ERROR, (error.empty()) ? "couldn't send the transaction" : error);
+  return json({{"hash", txHash(signedTx)}, {"link", txLink}});
+}
+
+json DaemonRPC::sendBatch(const json& txs, const std::string& pass) {
+  // Build all transactions, then reserve their nonces at once
+  std::vector<TransactionSkeleton> txSkels;
+  std::vector<std::string> operations;
+  for (const json& tx : txs) {
+    txSkels.push_back(this->w.buildTransaction(
+      tx["from"].get<std::string>(), tx["to"].get<std::string>(), tx["value"].get<std::string>(),
+      tx["gas"].get<std::string>(), tx["gasPrice"].get<std::string>(), tx["data"].get<std::string>(), false
+    ));
+    operations.push_back(tx["operation"].get<std::string>());
+  }
+  bool buildSuccess = (std::none_of(txSkels.begin(), txSkels.end(),
+    [](const TransactionSkeleton& txSkel){ return txSkel.nonce == Utils::MAX_U256_VALUE(); }
+  ) && this->w.reserveNonces(txSkels));
+  if (!buildSuccess) throw RPCError(WALLET_ERROR, "couldn't build the transactions");
+
+  // A transaction that couldn't be signed breaks the nonce sequence,
+  // so the batch is only sent if every transaction was signed
+  std::vector<std::string> signedTxs = this->w.signTransactions(txSkels, pass);
+  if (std::any_of(signedTxs.begin(), signedTxs.end(), [](const std::string& tx){ return tx.empty(); })) {
+    for (auto it = txSkels.rbegin(); it != txSkels.rend(); it++) this->w.releaseNonce(*it);
+    throw RPCError(WALLET_ERROR, "couldn't sign the transactions (wrong passphrase?)");
+  }
+
+  // Send all transactions in one request, each one reports its own outcome
+  std::vector<std::string> errors;
+  std::vector<std::string> txLinks = this->w.sendTransactions(signedTxs, operations, &errors);
+  json ret = json::array();
+  for (size_t i = 0; i < txLinks.size(); i++) {
+    json result;
+    result["hash"] = txHash(signedTxs[i]);
+    if (!txLinks[i].empty()) {
+      result["link"] = txLinks[i];
+    } else {
+      result["error"] = (i < errors.size() && !errors[i].empty()) ? errors[i] : "couldn't send the transaction";
+    }
+    ret.push_back(result);
+  }
+  return ret;
+}
+
+json DaemonRPC::replace(const json& params, bool cancel) {
+  Address address = getAddress(params, "address");
+  std::string hash = getString(params, "hash");
+  std::string pass = getString(params, "pass", false);
+  std::unique_lock<std::shared_timed_mutex> lk(this->walletLock);
+  requireLoaded();
+  if (!this->w.accountExists(address)) throw RPCError(WALLET_ERROR, "unknown Account");
+  std::lock_guard<std::mutex> accLk(accountLock(address));
+  this->w.setCurrentAccount(address);
+  std::string error;
+  std::string txLink = (cancel)
+    ? this->w.cancelTransaction(hash, pass, &error)
+    : this->w.speedUpTransaction(hash, pass, &error);
+  if (txLink.empty()) throw RPCError(WALLET_ERROR, error);
+  return json({{"link", txLink}});
+}
+
+json DaemonRPC::handle(const json& req) {
+  json ret;
+  ret["jsonrpc"] = "2.0";
+  ret["id"] = (req.is_object() && req.contains("id")) ? req["id"] : json(nullptr);
+  std::string method = (req.is_object() && req.contains("method") && req["method"].is_string())
+    ? req["method"].get<std::string>() : "";
+  auto it = this->methods.find(method);
+  std::string label = "method=\"" + ((it != this->methods.end()) ? method : "unknown") + "\"";
+  Metrics::Timer timer(Metrics::histogram("avme_daemon_request_seconds", label));
+  try {
+    if (method.empty()) throw RPCError(INVALID_REQUEST, "invalid request");
+    if (it == this->methods.end()) throw RPCError(METHOD_NOT_FOUND, "method not found: " + method);
+    json params = (req.contains("params")) ? req["params"] : json::object();
+    if (!params.is_object()) throw RPCError(INVALID_PARAMS, "params must be an object");
+    ret["result"] = it->second(params);
+  } catch (RPCError const& e) {
+    ret["error"] = {{"code", e.code}, {"message", e.what()}};
+  } catch (std::invalid_argument const& e) {
+    ret["error"] = {{"code", INVALID_PARAMS}, {"message", std::string("invalid param: ") + e.what()}};
+  } catch (std::exception const& e) {
+    ret["error"] = {{"code", INTERNAL_ERROR}, {"message", e.what()}};
+  }
+  Metrics::counter("avme_daemon_requests_total",
+    label + ",result=\"" + (ret.contains("error") ? "error" : "ok") + "\""
+  ).inc();
+  return ret;
+}
+
+void DaemonRPC::close() {
+  std::unique_lock<std::shared_timed_mutex> lk(this->walletLock);
+  if (this->w.isLoaded()) { this->w.close(); this->w.closeTokenDB(); }
+}
@@ -0,0 +1,97 @@
+// Copyright (c) 2020-2021 AVME Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+#ifndef DAEMONRPC_H
+#define DAEMONRPC_H
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <core/Metrics.h>
+#include <core/Utils.h>
+#include <core/Wallet.h>
+#include <network/API.h>
+#include <network/FeeOracle.h>
+#include <network/GasEstimator.h>
+
+// Error answered to a JSON-RPC request, with its code.
+class RPCError : public std::runtime_error {
+  public:
+    int code;
+    RPCError(int code, const std::string& message) : std::runtime_error(message), code(code) {}
+};
+
+/**
+ * JSON-RPC methods of the daemon, over a single Wallet.
+ * The Wallet is effectively one per process (its folder path is global),
+ * so a client loads one at a time with avme_load.
+ * Methods can be called from any number of threads:
+ * - Loading/closing the Wallet, adding/removing tokens (check-then-add
+ *   over the token database) and anything that switches the current
+ *   Account (history, speed up/cancel) takes the Wallet lock exclusively.
+ * - Everything else (balances, listing tokens, unlocking, sending) shares
+ *   it, the Wallet serializes its own shared state (e.g. the keystore)
+ *   internally.
+ * - Transactions from the same Account are also built, signed and sent
+ *   one request at a time, so they reach the node in nonce order and a
+ *   nonce resync after a failure can't pull nonces from under another send.
+ * Amounts are in Wei (decimal strings), parameters are given by name.
+ */
+class DaemonRPC {
+  private:
+    Wallet w;
+
+    // Guards the Wallet's state, see above.
+    std::shared_timed_mutex walletLock;
+
+    // Send locks by Account, created on first use, and their mutex.
+    std::map<Address, std::unique_ptr<std::mutex>> accountLocks;
+    std::mutex accountLocksLock;
+
+    // Method handlers by name, each taking the request's params.
+    std::map<std::string, std::function<json(const json&)>> methods;
+
+    // Get the send lock of an Account.
+    std::mutex& accountLock(const Address& address);
+
+    // Throw if no Wallet is loaded. Must be called with walletLock held.
+    void requireLoaded();
+
+    // Get the balances of an Account's coin and registered tokens in one request.
+    json getBalance(const Address& address);
+
+    // Fill in the gas limits and prices missing from a list of transactions,
+    // in one request each for the gas estimator and the fee oracle.
+    void fillGas(json& txs, const std::string& speed);
+
+    // Build, sign and send a transaction, rebuilding it once on a nonce error.
+    json send(const json& tx, const std::string& pass);
+
+    // Build, sign and send a list of transactions with consecutive nonces.
+    json sendBatch(const json& txs, const std::string& pass);
+
+    // Replace a pending transaction, for avme_speedUp and avme_cancel.
+    json replace(const json& params, bool cancel);
+
+  public:
+    DaemonRPC();
+
+    /**
+     * Answer a single JSON-RPC request object.
+     * Returns the answer, with either "result" or "error" set.
+     */
+    json handle(const json& req);
+
+    /**
+     * Close the Wallet, stopping its background tracker and subscriptions.
+     */
+    void close();
+};
+
+#endif // DAEMONRPC_H
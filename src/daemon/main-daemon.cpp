@@ -0,0 +1,386 @@
+// Copyright (c) 2020-2021 AVME Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+
+#include <openssl/crypto.h>
+#include <openssl/rand.h>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+#include <core/Metrics.h>
+#include <core/Utils.h>
+#include <network/API.h>
+#include <network/Graph.h>
+#include <network/MetricsServer.h>
+
+#include "DaemonRPC.h"
+
+using tcp = boost::asio::ip::tcp;
+namespace http = boost::beast::http;
+
+/**
+ * Headless AVME Wallet, serving a local JSON-RPC API for scripts and servers
+ * (see DaemonRPC for the methods). Listens on HTTP at 127.0.0.1:<port>, or
+ * on a Unix socket (still HTTP, e.g. `curl --unix-socket`) that only the
+ * owner can access. Every POST body is a JSON-RPC request or batch.
+ * Connections are read on their own lightweight threads, while requests
+ * (and each entry of a batch) are handled by a fixed pool of workers, so
+ * slow operations (key derivation, node round trips) run at most
+ * --workers at a time.
+ * Requests have to send the token as "Authorization: Bearer <token>". Over
+ * TCP one is always required: if none is given, a random one is written to
+ * a file only the owner can read. Since any web page can POST to localhost,
+ * requests with an Origin header, a Content-Type other than JSON or a Host
+ * that isn't loopback (DNS rebinding) are refused.
+ * Endpoints and metrics are configured with the same environment
+ * variables as avme-gui (AVME_API_URL, AVME_WS_URL, AVME_METRICS_PORT, ...).
+ */
+
+// Runtime options
+struct DaemonOptions {
+  unsigned short port = 8550;
+  std::string socketPath; // Unix socket instead of TCP if set
+  unsigned workers = std::max(2u, std::thread::hardware_concurrency());
+  std::string token;
+  std::string tokenFile = (Utils::getDataDir() / "daemon.token").string();
+};
+
+/**
+ * Fixed pool of threads running queued jobs in order.
+ */
+class WorkerPool {
+  private:
+    std::vector<std::thread> threads;
+    std::deque<std::function<void()>> jobs;
+    std::mutex lock;
+    std::condition_variable cv;
+    bool stopping = false;
+
+  public:
+    explicit WorkerPool(unsigned size) {
+      for (unsigned i = 0; i < size; i++) {
+        threads.emplace_back([this]{
+          for (;;) {
+            std::function<void()> job;
+            {
+              std::unique_lock<std::mutex> lk(lock);
+              cv.wait(lk, [this]{ return stopping || !jobs.empty(); });
+              if (jobs.empty()) return;
+              job = std::move(jobs.front());
+              jobs.pop_front();
+            }
+            job();
+          }
+        });
+      }
+    }
+
+    // Finishes the queued jobs before stopping.
+    ~WorkerPool() {
+      {
+        std::lock_guard<std::mutex> lk(lock);
+        stopping = true;
+      }
+      cv.notify_all();
+      for (std::thread& t : threads) t.join();
+    }
+
+    // Queue a job, returning a future for its result.
+    template <typename F> std::future<json> submit(F f) {
+      auto task = std::make_shared<std::packaged_task<json()>>(std::move(f));
+      std::future<json> ret = task->get_future();
+      {
+        std::lock_guard<std::mutex> lk(lock);
+        jobs.push_back([task]{ (*task)(); });
+      }
+      cv.notify_one();
+      return ret;
+    }
+};
+
+static DaemonOptions opts;
+static std::unique_ptr<DaemonRPC> rpc;
+static std::unique_ptr<WorkerPool> pool;
+
+// Open connections by id (with a function to shut each one down), and a
+// signal for when the last one is gone.
+static std::map<uint64_t, std::function<void()>> connections;
+static uint64_t nextConnection = 0;
+static std::mutex connectionsLock;
+static std::condition_variable connectionsDone;
+
+// Compare the request's token with ours, in constant time.
+static bool checkToken(const http::request<http::string_body>& req) {
+  if (opts.token.empty()) return true;
+  std::string expected = "Bearer " + opts.token;
+  boost::beast::string_view header = req[http::field::authorization];
+  std::string given(header.data(), header.size());
+  unsigned char diff = (given.size() != expected.size());
+  for (size_t i = 0; i < expected.size(); i++) {
+    diff |= expected[i] ^ ((i < given.size()) ? given[i] : 0);
+  }
+  return (diff == 0);
+}
+
+// Check that a request can't have come from a browser: no Origin, a JSON
+// Content-Type (other types skip the CORS preflight) and a loopback Host.
+static bool checkOrigin(const http::request<http::string_body>& req) {
+  if (req.find(http::field::origin) != req.end()) return false;
+  boost::beast::string_view typeHeader = req[http::field::content_type];
+  std::string type(typeHeader.data(), typeHeader.size());
+  type = type.substr(0, type.find(';'));
+  boost::algorithm::trim(type);
+  boost::algorithm::to_lower(type);
+  if (type != "application/json") return false;
+  boost::beast::string_view hostHeader = req[http::field::host];
+  std::string host(hostHeader.data(), hostHeader.size());
+  if (host.empty() || host[0] == '[') {
+    host = host.substr(0, host.find(']') + 1);
+  } else {
+    host = host.substr(0, host.find(':'));
+  }
+  boost::algorithm::to_lower(host);
+  return (host == "localhost" || host == "127.0.0.1" || host == "[::1]");
+}
+
+// Generate a random token and write it to a file only the owner can read.
+// Returns false on failure.
+static bool writeTokenFile(std::string& token, const std::string& path) {
+  unsigned char bytes[32];
+  if (RAND_bytes(bytes, sizeof(bytes)) != 1) return false;
+  token = toHex(bytesConstRef(bytes, sizeof(bytes)));
+  OPENSSL_cleanse(bytes, sizeof(bytes));
+  boost::system::error_code ec;
+  boost::filesystem::remove(path, ec);
+  #ifndef _WIN32
+    mode_t oldMask = umask(0077);
+  #endif
+  std::ofstream file(path);
+  file << token << std::endl;
+  file.close();
+  #ifndef _WIN32
+    umask(oldMask);
+  #endif
+  return !file.fail();
+}
+
+// Answer a request body, handing each request to the worker pool.
+static json handleBody(const std::string& body) {
+  json req = json::parse(body, nullptr, false);
+  if (req.is_discarded()) {
+    return {{"jsonrpc", "2.0"}, {"id", nullptr}, {"error", {{"code", -32700}, {"message", "parse error"}}}};
+  }
+  if (!req.is_array()) return pool->submit([req]{ return rpc->handle(req); }).get();
+  std::vector<std::future<json>> futures;
+  for (const json& r : req) futures.push_back(pool->submit([r]{ return rpc->handle(r); }));
+  json ret = json::array();
+  for (std::future<json>& f : futures) ret.push_back(f.get());
+  return ret;
+}
+
+// Serve every request on a connection until the client closes it (or we stop).
+template <typename Socket> static void session(std::shared_ptr<Socket> socket, uint64_t id) {
+  static Metrics::Gauge& open = Metrics::gauge("avme_daemon_connections");
+  open.add(1);
+  try {
+    boost::beast::flat_buffer buffer;
+    for (;;) {
+      http::request<http::string_body> req;
+      boost::system::error_code ec;
+      http::read(*socket, buffer, req, ec);
+      if (ec) break;
+
+      http::response<http::string_body> res{http::status::ok, req.version()};
+      res.set(http::field::server, "avme-daemon");
+      res.set(http::field::content_type, "application/json");
+      res.keep_alive(req.keep_alive());
+      if (!checkOrigin(req)) {
+        res.result(http::status::forbidden);
+        res.body() = "{\"error\": \"requests must be local, without Origin and with Content-Type application/json\"}";
+      } else if (!checkToken(req)) {
+        res.result(http::status::unauthorized);
+        res.body() = "{\"error\": \"unauthorized\"}";
+      } else if (req.method() != http::verb::post) {
+        res.result(http::status::method_not_allowed);
+        res.body() = "{\"error\": \"use POST\"}";
+      } else {
+        res.body() = handleBody(req.body()).dump();
+      }
+      res.prepare_payload();
+      http::write(*socket, res, ec);
+      if (ec || !res.keep_alive()) break;
+    }
+    boost::system::error_code ec;
+    socket->shutdown(Socket::shutdown_send, ec);
+  } catch (std::exception const& e) {
+    Utils::logToDebug(std::string("Daemon session error: ") + e.what());
+  }
+  open.add(-1);
+  std::lock_guard<std::mutex> lk(connectionsLock);
+  connections.erase(id);
+  if (connections.empty()) connectionsDone.notify_all();
+}
+
+// Accept connections until the acceptor is closed, each on its own thread.
+// Connections are registered here, so shutdown can't miss one that's starting.
+template <typename Acceptor> static void accept(Acceptor& acceptor) {
+  typedef typename Acceptor::protocol_type::socket Socket;
+  auto socket = std::make_shared<Socket>(acceptor.get_executor());
+  acceptor.async_accept(*socket, [&acceptor, socket](boost::system::error_code ec) {
+    if (ec == boost::asio::error::operation_aborted) return;
+    if (!ec) {
+      std::lock_guard<std::mutex> lk(connectionsLock);
+      uint64_t id = nextConnection++;
+      connections[id] = [socket]{
+        boost::system::error_code ec;
+        socket->shutdown(Socket::shutdown_both, ec);
+      };
+      std::thread(session<Socket>, socket, id).detach();
+    }
+    accept(acceptor);
+  });
+}
+
+int main(int argc, char *argv[]) {
+  const char* tokenEnv = std::getenv("AVME_DAEMON_TOKEN");
+  if (tokenEnv != nullptr) opts.token = tokenEnv;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    std::string next = (i + 1 < argc) ? argv[i + 1] : "";
+    if (arg == "--port") { opts.port = std::atoi(next.c_str()); i++; }
+    else if (arg == "--socket") { opts.socketPath = next; i++; }
+    else if (arg == "--workers") { opts.workers = std::max(1, std::atoi(next.c_str())); i++; }
+    else if (arg == "--token") { opts.token = next; i++; }
+    else if (arg == "--token-file") { opts.tokenFile = next; i++; }
+    else {
+      std::cout << "Usage: " << argv[0] << " [--port 8550 | --socket PATH] [--workers N]"
+        << " [--token TOKEN | --token-file PATH]" << std::endl
+        << "The token can also be given in AVME_DAEMON_TOKEN. Over TCP, if none is given,"
+        << " a random one is written to the token file." << std::endl;
+      return (arg == "--help") ? 0 : 1;
+    }
+  }
+
+  // Optionally override the API/Graph endpoints, like avme-gui
+  try {
+    const char* apiURL = std::getenv("AVME_API_URL");
+    const char* graphURL = std::getenv("AVME_GRAPH_URL");
+    const char* tlsVerify = std::getenv("AVME_TLS_VERIFY");
+    bool verify = (tlsVerify != nullptr && std::string(tlsVerify) == "1");
+    Endpoint apiEndpoint = (apiURL != nullptr) ? Endpoint::fromURL(apiURL) : API::getEndpoint();
+    Endpoint graphEndpoint = (graphURL != nullptr) ? Endpoint::fromURL(graphURL) : Graph::getEndpoint();
+    apiEndpoint.verifyTLS = verify;
+    graphEndpoint.verifyTLS = verify;
+    API::setEndpoint(apiEndpoint);
+    Graph::setEndpoint(graphEndpoint);
+    const char* wsURL = std::getenv("AVME_WS_URL");
+    if (wsURL != nullptr) {
+      Endpoint wsEndpoint = Endpoint::fromURL(wsURL);
+      wsEndpoint.verifyTLS = verify;
+      API::startWebSocket(wsEndpoint);
+    }
+  } catch (std::exception const& e) {
+    std::cerr << "Invalid endpoint override: " << e.what() << std::endl;
+    return 1;
+  }
+  const char* metricsPort = std::getenv("AVME_METRICS_PORT");
+  const char* metricsFile = std::getenv("AVME_METRICS_FILE");
+  if (metricsPort != nullptr) MetricsServer::start(std::atoi(metricsPort));
+
+  rpc.reset(new DaemonRPC());
+  pool.reset(new WorkerPool(opts.workers));
+  boost::asio::io_context ioc;
+  boost::asio::signal_set signals(ioc, SIGINT, SIGTERM);
+  std::unique_ptr<tcp::acceptor> tcpAcceptor;
+  #if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+    std::unique_ptr<boost::asio::local::stream_protocol::acceptor> localAcceptor;
+  #endif
+  try {
+    if (!opts.socketPath.empty()) {
+      #if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+        // A stale socket from a previous run would make bind() fail.
+        // The socket is created owner-only, so there's no window where others can connect
+        boost::filesystem::remove(opts.socketPath);
+        boost::asio::local::stream_protocol::endpoint endpoint(opts.socketPath);
+        localAcceptor.reset(new boost::asio::local::stream_protocol::acceptor(ioc));
+        localAcceptor->open(endpoint.protocol());
+        boost::system::error_code bindEc;
+        #ifndef _WIN32
+          mode_t oldMask = umask(0177);
+          localAcceptor->bind(endpoint, bindEc);
+          umask(oldMask);
+        #else
+          localAcceptor->bind(endpoint, bindEc);
+        #endif
+        if (bindEc) throw boost::system::system_error(bindEc);
+        localAcceptor->listen();
+        accept(*localAcceptor);
+        std::cout << "Listening on " << opts.socketPath << std::endl;
+      #else
+        std::cerr << "Unix sockets are not supported on this platform" << std::endl;
+        return 1;
+      #endif
+    } else {
+      if (opts.token.empty()) {
+        if (!writeTokenFile(opts.token, opts.tokenFile)) {
+          std::cerr << "Couldn't write the token file " << opts.tokenFile << std::endl;
+          return 1;
+        }
+        std::cout << "Token written to " << opts.tokenFile << std::endl;
+      }
+      tcpAcceptor.reset(new tcp::acceptor(
+        ioc, tcp::endpoint(boost::asio::ip::address_v4::loopback(), opts.port)
+      ));
+      accept(*tcpAcceptor);
+      std::cout << "Listening on http://127.0.0.1:" << opts.port << "/" << std::endl;
+    }
+  } catch (std::exception const& e) {
+    std::cerr << "Couldn't listen: " << e.what() << std::endl;
+    return 1;
+  }
+
+  // Stop accepting on SIGINT/SIGTERM, then close every open connection
+  signals.async_wait([&](boost::system::error_code, int) {
+    boost::system::error_code ec;
+    if (tcpAcceptor != nullptr) tcpAcceptor->close(ec);
+    #if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+      if (localAcceptor != nullptr) localAcceptor->close(ec);
+    #endif
+  });
+  ioc.run();
+  {
+    std::unique_lock<std::mutex> lk(connectionsLock);
+    for (std::pair<const uint64_t, std::function<void()>>& conn : connections) conn.second();
+    connectionsDone.wait(lk, []{ return connections.empty(); });
+  }
+  pool.reset();
+  rpc->close();
+  rpc.reset();
+  if (!opts.socketPath.empty()) boost::filesystem::remove(opts.socketPath);
+  if (metricsFile != nullptr) Metrics::writeToFile(metricsFile);
+  MetricsServer::stop();
+  API::stopWebSocket();
+  Logger::flush();
+  return 0;
+}
@@ -7,8 +7,182 @@
 
 #include <ethash/keccak.hpp>
 
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+
 namespace dev
 {
+namespace
+{
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DEV_SHA3_LANES 1
+
+/// Rate of Keccak-256 in bytes (the size of each absorbed block).
+size_t const c_keccakRate = 136;
+
+uint64_t const c_keccakRoundConstants[24] = {
+    0x0000000000000001, 0x0000000000008082, 0x800000000000808a, 0x8000000080008000,
+    0x000000000000808b, 0x0000000080000001, 0x8000000080008081, 0x8000000000008009,
+    0x000000000000008a, 0x0000000000000088, 0x0000000080008009, 0x000000008000000a,
+    0x000000008000808b, 0x800000000000008b, 0x8000000000008089, 0x8000000000008003,
+    0x8000000000008002, 0x8000000000000080, 0x000000000000800a, 0x800000008000000a,
+    0x8000000080008081, 0x8000000000008080, 0x0000000080000001, 0x8000000080008008
+};
+
+/// 4 and 8 64-bit words, one per lane: a single AVX2 / AVX-512 register.
+typedef uint64_t u64x4 __attribute__((vector_size(32)));
+typedef uint64_t u64x8 __attribute__((vector_size(64)));
+
+/// Keccak-f[1600] on @a _a, where each word of the state holds that word for every lane.
+/// Always inlined, so the code is generated for the instruction set of the caller.
+template <class V>
+inline __attribute__((always_inline)) void keccakfLanes(V (&_a)[25]) noexcept
+{
+    for (int round = 0; round < 24; ++round)
+    {
+        // Theta
+        V const c0 = _a[0] ^ _a[5] ^ _a[10] ^ _a[15] ^ _a[20];
+        V const c1 = _a[1] ^ _a[6] ^ _a[11] ^ _a[16] ^ _a[21];
+        V const c2 = _a[2] ^ _a[7] ^ _a[12] ^ _a[17] ^ _a[22];
+        V const c3 = _a[3] ^ _a[8] ^ _a[13] ^ _a[18] ^ _a[23];
+        V const c4 = _a[4] ^ _a[9] ^ _a[14] ^ _a[19] ^ _a[24];
+        V const d0 = c4 ^ ((c1 << 1) | (c1 >> 63));
+        V const d1 = c0 ^ ((c2 << 1) | (c2 >> 63));
+        V const d2 = c1 ^ ((c3 << 1) | (c3 >> 63));
+        V const d3 = c2 ^ ((c4 << 1) | (c4 >> 63));
+        V const d4 = c3 ^ ((c0 << 1) | (c0 >> 63));
+        // Rho and pi
+        V const b0 = _a[0] ^ d0;
+        V const t1 = _a[6] ^ d1, b1 = (t1 << 44) | (t1 >> 20);
+        V const t2 = _a[12] ^ d2, b2 = (t2 << 43) | (t2 >> 21);
+        V const t3 = _a[18] ^ d3, b3 = (t3 << 21) | (t3 >> 43);
+        V const t4 = _a[24] ^ d4, b4 = (t4 << 14) | (t4 >> 50);
+        V const t5 = _a[3] ^ d3, b5 = (t5 << 28) | (t5 >> 36);
+        V const t6 = _a[9] ^ d4, b6 = (t6 << 20) | (t6 >> 44);
+        V const t7 = _a[10] ^ d0, b7 = (t7 << 3) | (t7 >> 61);
+        V const t8 = _a[16] ^ d1, b8 = (t8 << 45) | (t8 >> 19);
+        V const t9 = _a[22] ^ d2, b9 = (t9 << 61) | (t9 >> 3);
+        V const t10 = _a[1] ^ d1, b10 = (t10 << 1) | (t10 >> 63);
+        V const t11 = _a[7] ^ d2, b11 = (t11 << 6) | (t11 >> 58);
+        V const t12 = _a[13] ^ d3, b12 = (t12 << 25) | (t12 >> 39);
+        V const t13 = _a[19] ^ d4, b13 = (t13 << 8) | (t13 >> 56);
+        V const t14 = _a[20] ^ d0, b14 = (t14 << 18) | (t14 >> 46);
+        V const t15 = _a[4] ^ d4, b15 = (t15 << 27) | (t15 >> 37);
+        V const t16 = _a[5] ^ d0, b16 = (t16 << 36) | (t16 >> 28);
+        V const t17 = _a[11] ^ d1, b17 = (t17 << 10) | (t17 >> 54);
+        V const t18 = _a[17] ^ d2, b18 = (t18 << 15) | (t18 >> 49);
+        V const t19 = _a[23] ^ d3, b19 = (t19 << 56) | (t19 >> 8);
+        V const t20 = _a[2] ^ d2, b20 = (t20 << 62) | (t20 >> 2);
+        V const t21 = _a[8] ^ d3, b21 = (t21 << 55) | (t21 >> 9);
+        V const t22 = _a[14] ^ d4, b22 = (t22 << 39) | (t22 >> 25);
+        V const t23 = _a[15] ^ d0, b23 = (t23 << 41) | (t23 >> 23);
+        V const t24 = _a[21] ^ d1, b24 = (t24 << 2) | (t24 >> 62);
+        // Chi and iota
+        _a[0] = b0 ^ (~b1 & b2);
+        _a[1] = b1 ^ (~b2 & b3);
+        _a[2] = b2 ^ (~b3 & b4);
+        _a[3] = b3 ^ (~b4 & b0);
+        _a[4] = b4 ^ (~b0 & b1);
+        _a[5] = b5 ^ (~b6 & b7);
+        _a[6] = b6 ^ (~b7 & b8);
+        _a[7] = b7 ^ (~b8 & b9);
+        _a[8] = b8 ^ (~b9 & b5);
+        _a[9] = b9 ^ (~b5 & b6);
+        _a[10] = b10 ^ (~b11 & b12);
+        _a[11] = b11 ^ (~b12 & b13);
+        _a[12] = b12 ^ (~b13 & b14);
+        _a[13] = b13 ^ (~b14 & b10);
+        _a[14] = b14 ^ (~b10 & b11);
+        _a[15] = b15 ^ (~b16 & b17);
+        _a[16] = b16 ^ (~b17 & b18);
+        _a[17] = b17 ^ (~b18 & b19);
+        _a[18] = b18 ^ (~b19 & b15);
+        _a[19] = b19 ^ (~b15 & b16);
+        _a[20] = b20 ^ (~b21 & b22);
+        _a[21] = b21 ^ (~b22 & b23);
+        _a[22] = b22 ^ (~b23 & b24);
+        _a[23] = b23 ^ (~b24 & b20);
+        _a[24] = b24 ^ (~b20 & b21);
+        _a[0] ^= c_keccakRoundConstants[round];
+    }
+}
+
+inline uint64_t le64dec(byte const* _p) noexcept
+{
+    uint64_t ret = 0;
+    for (int i = 7; i >= 0; --i)
+        ret = (ret << 8) | _p[i];
+    return ret;
+}
+
+/// Keccak-256 of @a L inputs at once, one per lane of @a V.
+/// Inputs may have different lengths: lanes that are done just ride along until the longest one ends.
+template <class V, size_t L>
+inline __attribute__((always_inline)) void keccak256Lanes(bytesConstRef const* _inputs, h256* const* o_outputs) noexcept
+{
+    V a[25];
+    for (V& w: a)
+        w = w ^ w;
+    size_t blocks[L];
+    size_t maxBlocks = 0;
+    for (size_t l = 0; l < L; ++l)
+    {
+        blocks[l] = _inputs[l].size() / c_keccakRate + 1;
+        maxBlocks = std::max(maxBlocks, blocks[l]);
+    }
+    for (size_t b = 0; b < maxBlocks; ++b)
+    {
+        for (size_t l = 0; l < L; ++l)
+        {
+            if (b >= blocks[l])
+                continue;
+            byte const* p = _inputs[l].data() + b * c_keccakRate;
+            byte last[c_keccakRate];
+            if (b + 1 == blocks[l])
+            {
+                // Keccak padding: 0x01 after the data, 0x80 at the end of the block
+                size_t rest = _inputs[l].size() - b * c_keccakRate;
+                memset(last, 0, c_keccakRate);
+                if (rest)
+                    memcpy(last, p, rest);
+                last[rest] ^= 0x01;
+                last[c_keccakRate - 1] ^= 0x80;
+                p = last;
+            }
+            for (size_t i = 0; i < c_keccakRate / 8; ++i)
+                a[i][l] ^= le64dec(p + 8 * i);
+        }
+        keccakfLanes(a);
+        for (size_t l = 0; l < L; ++l)
+            if (b + 1 == blocks[l])
+                for (size_t i = 0; i < 32; ++i)
+                    (*o_outputs[l])[i] = byte(a[i / 8][l] >> (8 * (i % 8)));
+    }
+}
+
+__attribute__((target("avx2"))) void keccak256x4(bytesConstRef const* _inputs, h256* const* o_outputs) noexcept
+{
+    keccak256Lanes<u64x4, 4>(_inputs, o_outputs);
+}
+
+__attribute__((target("avx512f"))) void keccak256x8(bytesConstRef const* _inputs, h256* const* o_outputs) noexcept
+{
+    keccak256Lanes<u64x8, 8>(_inputs, o_outputs);
+}
+
+/// Number of SIMD lanes usable on this CPU: 8 with AVX-512, 4 with AVX2, 1 otherwise.
+size_t sha3Lanes() noexcept
+{
+    static size_t const s_lanes = __builtin_cpu_supports("avx512f") ? 8 : __builtin_cpu_supports("avx2") ? 4 : 1;
+    return s_lanes;
+}
+
+#endif
+
+}
+
 h256 const EmptySHA3 = sha3(bytesConstRef());
 h256 const EmptyListSHA3 = sha3(rlpList());
 
@@ -20,4 +194,47 @@ bool sha3(bytesConstRef _input, bytesRef o_output) noexcept
     bytesConstRef{h.bytes, 32}.copyTo(o_output);
     return true;
 }
+
+void sha3Batch(bytesConstRef const* _inputs, size_t _count, h256* o_outputs)
+{
+    size_t done = 0;
+#ifdef DEV_SHA3_LANES
+    size_t const lanes = sha3Lanes();
+    if (lanes > 1 && _count >= lanes)
+    {
+        // Group inputs by the number of blocks they take, so lanes don't sit idle in a group
+        std::vector<size_t> order(_count);
+        std::iota(order.begin(), order.end(), size_t(0));
+        std::stable_sort(order.begin(), order.end(), [&](size_t _x, size_t _y) {
+            return _inputs[_x].size() / c_keccakRate < _inputs[_y].size() / c_keccakRate;
+        });
+        bytesConstRef in[8];
+        h256* out[8];
+        for (; done + lanes <= _count; done += lanes)
+        {
+            for (size_t l = 0; l < lanes; ++l)
+            {
+                in[l] = _inputs[order[done + l]];
+                out[l] = &o_outputs[order[done + l]];
+            }
+            if (lanes == 8)
+                keccak256x8(in, out);
+            else
+                keccak256x4(in, out);
+        }
+        for (; done < _count; ++done)
+            sha3(_inputs[order[done]], o_outputs[order[done]].ref());
+        return;
+    }
+#endif
+    for (; done < _count; ++done)
+        sha3(_inputs[done], o_outputs[done].ref());
+}
+
+h256s sha3Batch(std::vector<bytesConstRef> const& _inputs)
+{
+    h256s ret(_inputs.size());
+    sha3Batch(_inputs.data(), _inputs.size(), ret.data());
+    return ret;
+}
 }  // namespace dev
@@ -5,12 +5,15 @@
 
 #include <lib/devcore/Guards.h>  // <boost/thread> conflicts with <thread>
 #include "Common.h"
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
 #include <secp256k1.h>
 #include <secp256k1_ecdh.h>
 #include <secp256k1_recovery.h>
 #include <secp256k1_sha256.h>
 #include <cryptopp/aes.h>
-#include <cryptopp/pwdbased.h>
 #include <cryptopp/sha.h>
 #include <cryptopp/modes.h>
 #include <libscrypt.h>
@@ -18,6 +21,7 @@
 #include <lib/devcore/RLP.h>
 #include "AES.h"
 #include "CryptoPP.h"
+#include "KDF.h"
 #include "Exceptions.h"
 using namespace std;
 using namespace dev;
@@ -35,6 +39,47 @@ secp256k1_context const* getCtx()
     return s_ctx.get();
 }
 
+/// Items below this count per thread aren't worth starting a thread for.
+size_t const c_batchGrain = 16;
+
+/// Run @a _f(i) for every i in [0, _count) on up to @a _threads threads (0 = one per core).
+/// Threads take the indices in small chunks, so uneven items don't leave threads idle.
+/// If @a _f throws, the other threads stop taking work and the first exception is rethrown.
+template <class F>
+void parallelFor(size_t _count, unsigned _threads, F const& _f)
+{
+    if (_threads == 0)
+        _threads = max(1u, thread::hardware_concurrency());
+    _threads = unsigned(min<size_t>(_threads, (_count + c_batchGrain - 1) / c_batchGrain));
+
+    atomic<size_t> next{0};
+    exception_ptr error;
+    mutex errorLock;
+    auto worker = [&]() {
+        try
+        {
+            for (size_t begin = next.fetch_add(c_batchGrain); begin < _count; begin = next.fetch_add(c_batchGrain))
+                for (size_t i = begin; i < min(begin + c_batchGrain, _count); ++i)
+                    _f(i);
+        }
+        catch (...)
+        {
+            next = _count;
+            lock_guard<mutex> l(errorLock);
+            if (!error)
+                error = current_exception();
+        }
+    };
+    vector<thread> workers;
+    for (unsigned t = 1; t < _threads; ++t)
+        workers.emplace_back(worker);
+    worker();
+    for (auto& t: workers)
+        t.join();
+    if (error)
+        rethrow_exception(error);
+}
+
 template <std::size_t KeySize>
 bool toPublicKey(Secret const& _secret, unsigned _flags, array<byte, KeySize>& o_serializedPubkey)
 {
@@ -272,6 +317,27 @@ Signature dev::sign(Secret const& _k, h256 const& _hash)
     return s;
 }
 
+vector<Signature> dev::signBatch(Secret const& _k, h256s const& _hashes, unsigned _threads)
+{
+    vector<Signature> ret(_hashes.size());
+    parallelFor(_hashes.size(), _threads, [&](size_t i) { ret[i] = sign(_k, _hashes[i]); });
+    return ret;
+}
+
+vector<Signature> dev::signBatch(vector<pair<Secret, h256>> const& _items, unsigned _threads)
+{
+    vector<Signature> ret(_items.size());
+    parallelFor(_items.size(), _threads, [&](size_t i) { ret[i] = sign(_items[i].first, _items[i].second); });
+    return ret;
+}
+
+vector<Public> dev::recoverBatch(vector<pair<Signature, h256>> const& _items, unsigned _threads)
+{
+    vector<Public> ret(_items.size());
+    parallelFor(_items.size(), _threads, [&](size_t i) { ret[i] = recover(_items[i].first, _items[i].second); });
+    return ret;
+}
+
 bool dev::verify(Public const& _p, Signature const& _s, h256 const& _hash)
 {
     // TODO: Verify w/o recovery (if faster).
@@ -297,23 +363,14 @@ bool dev::verify(PublicCompressed const& _key, h512 const& _signature, h256 cons
 
 bytesSec dev::pbkdf2(string const& _pass, bytes const& _salt, unsigned _iterations, unsigned _dkLen)
 {
-    bytesSec ret(_dkLen);
-    if (CryptoPP::PKCS5_PBKDF2_HMAC<CryptoPP::SHA256>().DeriveKey(
-        ret.writable().data(),
-        _dkLen,
-        0,
-        reinterpret_cast<byte const*>(_pass.data()),
-        _pass.size(),
-        _salt.data(),
-        _salt.size(),
-        _iterations
-    ) != _iterations)
-        BOOST_THROW_EXCEPTION(CryptoException() << errinfo_comment("Key derivation failed."));
-    return ret;
+    return pbkdf2Sha256(_pass, bytesConstRef(&_salt), _iterations, _dkLen);
 }
 
 bytesSec dev::scrypt(std::string const& _pass, bytes const& _salt, uint64_t _n, uint32_t _r, uint32_t _p, unsigned _dkLen)
 {
+    // Lanes are independent, so they're only worth splitting across threads if there's more than one
+    if (_p > 1)
+        return scryptParallel(_pass, bytesConstRef(&_salt), _n, _r, _p, _dkLen);
     bytesSec ret(_dkLen);
     if (libscrypt_scrypt(
         reinterpret_cast<uint8_t const*>(_pass.data()),
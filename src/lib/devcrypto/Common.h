@@ -122,10 +122,21 @@ bool verify(Public const& _k, Signature const& _s, h256 const& _hash);
 // Verify signature with compressed public key
 bool verify(PublicCompressed const& _key, h512 const& _signature, h256 const& _hash);
 
-/// Derive key via PBKDF2.
+/// Sign many hashes with the same secret key, on up to @a _threads threads (0 = one per core).
+/// All threads share the same precomputed secp256k1 context. A failed signature is left zero.
+std::vector<Signature> signBatch(Secret const& _k, h256s const& _hashes, unsigned _threads = 0);
+
+/// Sign many (secret key, hash) pairs, on up to @a _threads threads (0 = one per core).
+std::vector<Signature> signBatch(std::vector<std::pair<Secret, h256>> const& _items, unsigned _threads = 0);
+
+/// Recover the public keys of many (signature, hash) pairs, on up to @a _threads threads
+/// (0 = one per core). Signatures that can't be recovered give a zero Public, like recover().
+std::vector<Public> recoverBatch(std::vector<std::pair<Signature, h256>> const& _items, unsigned _threads = 0);
+
+/// Derive key via PBKDF2 (HMAC-SHA256).
 bytesSec pbkdf2(std::string const& _pass, bytes const& _salt, unsigned _iterations, unsigned _dkLen = 32);
 
-/// Derive key via Scrypt.
+/// Derive key via Scrypt. With @a _p > 1 the lanes run in parallel (see scryptParallel).
 bytesSec scrypt(std::string const& _pass, bytes const& _salt, uint64_t _n, uint32_t _r, uint32_t _p, unsigned _dkLen);
 
 /// Simple class that represents a "key pair".
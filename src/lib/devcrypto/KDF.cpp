@@ -0,0 +1,196 @@
+// Aleth: Ethereum C++ client, tools and libraries.
+// Copyright 2014-2019 Aleth Authors.
+// Licensed under the GNU General Public License, Version 3.
+
+#include "KDF.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include "Exceptions.h"
+using namespace std;
+using namespace dev;
+using namespace dev::crypto;
+
+namespace
+{
+
+inline uint32_t rotl(uint32_t _a, int _b) { return (_a << _b) | (_a >> (32 - _b)); }
+
+inline uint32_t le32dec(uint8_t const* _p)
+{
+	return uint32_t(_p[0]) | (uint32_t(_p[1]) << 8) | (uint32_t(_p[2]) << 16) | (uint32_t(_p[3]) << 24);
+}
+
+inline void le32enc(uint8_t* _p, uint32_t _x)
+{
+	_p[0] = _x & 0xff;
+	_p[1] = (_x >> 8) & 0xff;
+	_p[2] = (_x >> 16) & 0xff;
+	_p[3] = (_x >> 24) & 0xff;
+}
+
+/// Salsa20/8 core, applied in place to a 64-byte block.
+void salsa208(uint32_t _b[16])
+{
+	uint32_t x[16];
+	memcpy(x, _b, sizeof(x));
+	for (int i = 0; i < 8; i += 2)
+	{
+		// Columns
+		x[4] ^= rotl(x[0] + x[12], 7);   x[8] ^= rotl(x[4] + x[0], 9);
+		x[12] ^= rotl(x[8] + x[4], 13);  x[0] ^= rotl(x[12] + x[8], 18);
+		x[9] ^= rotl(x[5] + x[1], 7);    x[13] ^= rotl(x[9] + x[5], 9);
+		x[1] ^= rotl(x[13] + x[9], 13);  x[5] ^= rotl(x[1] + x[13], 18);
+		x[14] ^= rotl(x[10] + x[6], 7);  x[2] ^= rotl(x[14] + x[10], 9);
+		x[6] ^= rotl(x[2] + x[14], 13);  x[10] ^= rotl(x[6] + x[2], 18);
+		x[3] ^= rotl(x[15] + x[11], 7);  x[7] ^= rotl(x[3] + x[15], 9);
+		x[11] ^= rotl(x[7] + x[3], 13);  x[15] ^= rotl(x[11] + x[7], 18);
+		// Rows
+		x[1] ^= rotl(x[0] + x[3], 7);    x[2] ^= rotl(x[1] + x[0], 9);
+		x[3] ^= rotl(x[2] + x[1], 13);   x[0] ^= rotl(x[3] + x[2], 18);
+		x[6] ^= rotl(x[5] + x[4], 7);    x[7] ^= rotl(x[6] + x[5], 9);
+		x[4] ^= rotl(x[7] + x[6], 13);   x[5] ^= rotl(x[4] + x[7], 18);
+		x[11] ^= rotl(x[10] + x[9], 7);  x[8] ^= rotl(x[11] + x[10], 9);
+		x[9] ^= rotl(x[8] + x[11], 13);  x[10] ^= rotl(x[9] + x[8], 18);
+		x[12] ^= rotl(x[15] + x[14], 7); x[13] ^= rotl(x[12] + x[15], 9);
+		x[14] ^= rotl(x[13] + x[12], 13); x[15] ^= rotl(x[14] + x[13], 18);
+	}
+	for (int i = 0; i < 16; ++i)
+		_b[i] += x[i];
+}
+
+/// scrypt BlockMix with Salsa20/8: reads 2 * r blocks from @a _in, writes them to @a _out
+/// (even blocks to the first half, odd ones to the second half).
+void blockMix(uint32_t const* _in, uint32_t* _out, uint32_t _r)
+{
+	uint32_t x[16];
+	memcpy(x, &_in[(2 * _r - 1) * 16], 64);
+	for (uint32_t i = 0; i < 2 * _r; ++i)
+	{
+		for (int j = 0; j < 16; ++j)
+			x[j] ^= _in[i * 16 + j];
+		salsa208(x);
+		memcpy(&_out[((i & 1) * _r + i / 2) * 16], x, 64);
+	}
+}
+
+/// scrypt ROMix on a single lane of 128 * r bytes, in place.
+/// @a _v must hold 32 * r * n words and @a _xy 64 * r words.
+void roMix(uint8_t* _b, uint32_t _r, uint64_t _n, uint32_t* _v, uint32_t* _xy)
+{
+	size_t const words = 32 * _r;
+	uint32_t* x = _xy;
+	uint32_t* y = _xy + words;
+	for (size_t k = 0; k < words; ++k)
+		x[k] = le32dec(&_b[k * 4]);
+	for (uint64_t i = 0; i < _n; ++i)
+	{
+		memcpy(&_v[i * words], x, words * 4);
+		blockMix(x, y, _r);
+		swap(x, y);
+	}
+	for (uint64_t i = 0; i < _n; ++i)
+	{
+		uint32_t const* last = &x[(2 * _r - 1) * 16];
+		uint64_t j = ((uint64_t(last[1]) << 32) | last[0]) & (_n - 1);
+		for (size_t k = 0; k < words; ++k)
+			x[k] ^= _v[j * words + k];
+		blockMix(x, y, _r);
+		swap(x, y);
+	}
+	for (size_t k = 0; k < words; ++k)
+		le32enc(&_b[k * 4], x[k]);
+	OPENSSL_cleanse(_xy, 64 * _r * 4);
+}
+
+}
+
+bytesSec dev::pbkdf2Sha256(string const& _pass, bytesConstRef _salt, unsigned _iterations, unsigned _dkLen)
+{
+	bytesSec ret(_dkLen);
+	if (PKCS5_PBKDF2_HMAC(
+		_pass.data(), int(_pass.size()),
+		_salt.data(), int(_salt.size()),
+		int(_iterations), EVP_sha256(),
+		int(_dkLen), ret.writable().data()
+	) != 1)
+		BOOST_THROW_EXCEPTION(CryptoException() << errinfo_comment("Key derivation failed."));
+	return ret;
+}
+
+bytesSec dev::scryptParallel(
+	string const& _pass, bytesConstRef _salt, uint64_t _n, uint32_t _r, uint32_t _p,
+	unsigned _dkLen, unsigned _threads, uint64_t _maxMemory
+)
+{
+	if (_n < 2 || (_n & (_n - 1)) != 0 || _r == 0 || _p == 0)
+		BOOST_THROW_EXCEPTION(CryptoException() << errinfo_comment("Invalid scrypt parameters."));
+	size_t const laneSize = 128 * size_t(_r);
+	uint64_t const laneMemory = uint64_t(laneSize) * _n;
+
+	// B = PBKDF2(pass, salt, 1, p * 128 * r), each lane is then mixed independently
+	bytesSec b = pbkdf2Sha256(_pass, _salt, 1, unsigned(laneSize * _p));
+	byte* lanes = b.ref().data();
+
+	if (_threads == 0)
+		_threads = max(1u, thread::hardware_concurrency());
+	_threads = unsigned(min<uint64_t>(_threads, max<uint64_t>(1, _maxMemory / laneMemory)));
+	_threads = min(_threads, _p);
+
+	atomic<uint32_t> next{0};
+	exception_ptr error;
+	mutex errorLock;
+	auto worker = [&]() {
+		try
+		{
+			vector<uint32_t> v(size_t(laneMemory / 4));
+			vector<uint32_t> xy(64 * _r);
+			for (uint32_t i = next++; i < _p; i = next++)
+				roMix(lanes + i * laneSize, _r, _n, v.data(), xy.data());
+			OPENSSL_cleanse(v.data(), v.size() * 4);
+		}
+		catch (...)
+		{
+			lock_guard<mutex> l(errorLock);
+			if (!error)
+				error = current_exception();
+		}
+	};
+	vector<thread> workers;
+	for (unsigned t = 1; t < _threads; ++t)
+		workers.emplace_back(worker);
+	worker();
+	for (auto& t: workers)
+		t.join();
+	if (error)
+		rethrow_exception(error);
+
+	// Output = PBKDF2(pass, B, 1, dkLen)
+	return pbkdf2Sha256(_pass, b.ref(), 1, _dkLen);
+}
+
+ScryptParams dev::calibrateScrypt(chrono::milliseconds _budget, ScryptParams const& _min, uint64_t _maxMemory)
+{
+	// Time one small lane with the same r, the cost of a lane is linear in n
+	uint64_t const probeN = 1 << 12;
+	auto start = chrono::steady_clock::now();
+	scryptParallel("calibration", bytesConstRef(), probeN, _min.r, 1, 32, 1);
+	double probe = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	double budget = chrono::duration<double>(_budget).count();
+
+	// Lanes may run in parallel here, but every decrypting device pays for their memory
+	auto wallTime = [&](uint64_t _n) {
+		return double(_min.p) * probe * double(_n) / double(probeN);
+	};
+
+	ScryptParams ret = _min;
+	while (uint64_t(128) * ret.r * ret.n * 2 * ret.p <= _maxMemory && wallTime(ret.n * 2) <= budget)
+		ret.n *= 2;
+	return ret;
+}
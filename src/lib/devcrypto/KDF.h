@@ -0,0 +1,47 @@
+// Aleth: Ethereum C++ client, tools and libraries.
+// Copyright 2014-2019 Aleth Authors.
+// Licensed under the GNU General Public License, Version 3.
+
+/// @file
+/// Key derivation engine used by the keystore.
+/// PBKDF2-HMAC-SHA256 runs on OpenSSL, whose SHA-256 picks the fastest code path for
+/// the CPU at runtime (SHA-NI, AVX2, SSSE3...) and keeps the HMAC pads precomputed
+/// across iterations. scrypt splits its p independent ROMix lanes across threads.
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <lib/devcore/Common.h>
+
+namespace dev
+{
+
+/// Parameters for an scrypt derivation (the memory used by each lane is 128 * r * n bytes).
+struct ScryptParams
+{
+	uint64_t n = 1 << 18;
+	uint32_t r = 8;
+	uint32_t p = 1;
+};
+
+/// Derive key via PBKDF2-HMAC-SHA256, on OpenSSL.
+bytesSec pbkdf2Sha256(std::string const& _pass, bytesConstRef _salt, unsigned _iterations, unsigned _dkLen);
+
+/// Derive key via scrypt, running the @a _p lanes on up to @a _threads threads
+/// (0 = one per core, also limited so the lanes running at once fit in @a _maxMemory bytes).
+bytesSec scryptParallel(
+	std::string const& _pass, bytesConstRef _salt, uint64_t _n, uint32_t _r, uint32_t _p,
+	unsigned _dkLen, unsigned _threads = 0, uint64_t _maxMemory = uint64_t(1) << 30
+);
+
+/// Pick scrypt parameters that take about @a _budget of wall-clock time on this machine.
+/// Security never goes below @a _min: n and r are kept at least as high, and the extra budget
+/// is spent on a higher n while a derivation fits in @a _maxMemory bytes. p is left as in @a _min,
+/// extra lanes would multiply the memory every key needs, on every device that decrypts it.
+/// Measures a small derivation to estimate the speed, which takes a few tens of milliseconds.
+ScryptParams calibrateScrypt(
+	std::chrono::milliseconds _budget, ScryptParams const& _min = ScryptParams(),
+	uint64_t _maxMemory = uint64_t(1) << 30
+);
+
+}
@@ -4,21 +4,54 @@
 
 
 #include "SecretStore.h"
+#include <atomic>
+#include <exception>
+#include <fstream>
+#include <sstream>
 #include <thread>
 #include <mutex>
 #include <boost/algorithm/string.hpp>
 #include <boost/filesystem.hpp>
+#include <lib/devcore/Exceptions.h>
 #include <lib/devcore/Guards.h>
 #include <lib/devcore/SHA3.h>
 #include <lib/devcore/FileSystem.h>
 #include <lib/json_spirit/JsonSpiritHeaders.h>
 #include <lib/devcrypto/Exceptions.h>
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/stat.h>
+#endif
 using namespace std;
 using namespace dev;
 namespace js = json_spirit;
 namespace fs = boost::filesystem;
 
 static const int c_keyFileVersion = 3;
+static char const* c_indexFilename = "keys.index";
+static const string c_indexHeader = "keyindex 2";
+
+/// @returns the modification time of @a _file in nanoseconds, as precise as the filesystem keeps it
+/// (boost::filesystem only gives seconds, which would miss a change within the same second).
+static int64_t modificationTime(fs::path const& _file)
+{
+#if defined(_WIN32)
+	WIN32_FILE_ATTRIBUTE_DATA data;
+	if (!GetFileAttributesExW(_file.wstring().c_str(), GetFileExInfoStandard, &data))
+		BOOST_THROW_EXCEPTION(FileError() << errinfo_comment("Could not stat file: " + _file.string()));
+	return int64_t((uint64_t(data.ftLastWriteTime.dwHighDateTime) << 32) | data.ftLastWriteTime.dwLowDateTime) * 100;
+#else
+	struct stat st;
+	if (stat(_file.c_str(), &st) != 0)
+		BOOST_THROW_EXCEPTION(FileError() << errinfo_comment("Could not stat file: " + _file.string()));
+#if defined(__APPLE__)
+	return int64_t(st.st_mtimespec.tv_sec) * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+	return int64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+#endif
+}
 
 /// Upgrade the json-format to the current version.
 static js::mValue upgraded(string const& _s)
@@ -92,12 +125,14 @@ bytesSec SecretStore::secret(h128 const& _uuid, function<string()> const& _pass,
         return rit->second;
     auto it = m_keys.find(_uuid);
     bytesSec key;
-    if (it != m_keys.end())
+    if (it != m_keys.end() && loadKey(it->second))
     {
         key = bytesSec(decrypt(it->second.encryptedKey, _pass()));
         if (!key.empty())
         {
-            m_cached[_uuid] = key;
+            // Plaintext is only kept around when the caller asked for the cache
+            if (_useCache)
+                m_cached[_uuid] = key;
             // TODO: Fix constness.
             const_cast<SecretStore*>(this)->noteAddress(_uuid, toAddress(Secret{key}));
         }
@@ -109,7 +144,8 @@ bytesSec SecretStore::secret(Address const& _address, function<string()> const&
 {
 	bytesSec ret;
 	if (auto k = key(_address))
-		ret = bytesSec(decrypt(k->second.encryptedKey, _pass()));
+		if (loadKey(k->second))
+			ret = bytesSec(decrypt(k->second.encryptedKey, _pass()));
 	return ret;
 }
 
@@ -134,7 +170,8 @@ h128 SecretStore::importSecret(bytesSec const& _s, string const& _pass)
 	EncryptedKey key{encrypt(_s.ref(), _pass), toUUID(r), KeyPair(Secret(_s)).address()};
 	m_cached[r] = _s;
 	m_keys[r] = move(key);
-	save();
+	saveKey(m_path, r, m_keys[r]);
+	appendIndex(indexLine(r, m_keys[r]));
 	return r;
 }
 
@@ -144,17 +181,77 @@ h128 SecretStore::importSecret(bytesConstRef _s, string const& _pass)
 	EncryptedKey key{encrypt(_s, _pass), toUUID(r), KeyPair(Secret(_s)).address()};
 	m_cached[r] = bytesSec(_s);
 	m_keys[r] = move(key);
-	save();
+	saveKey(m_path, r, m_keys[r]);
+	appendIndex(indexLine(r, m_keys[r]));
 	return r;
 }
 
+vector<h128> SecretStore::importSecrets(vector<bytesSec> const& _secrets, string const& _pass, KDF _kdf, unsigned _threads)
+{
+	vector<h128> ret(_secrets.size());
+	vector<EncryptedKey> keys(_secrets.size());
+	if (_secrets.empty())
+		return ret;
+	if (_threads == 0)
+	{
+		// Calibrated parameters may need more memory per derivation, so the budget is shared
+		ScryptParams const params = scryptParams();
+		uint64_t const memory = uint64_t(128) * params.r * params.n * params.p;
+		uint64_t const fit = max<uint64_t>(1, (uint64_t(1) << 30) / memory);
+		_threads = unsigned(min<uint64_t>(max(1u, thread::hardware_concurrency()), fit));
+	}
+	_threads = min<unsigned>(_threads, _secrets.size());
+
+	// Encryption (the KDF) is the expensive part and each key is independent,
+	// so workers take the next key from a shared counter and fill their own slots
+	atomic<size_t> next{0};
+	exception_ptr error;
+	mutex errorLock;
+	auto worker = [&]() {
+		for (size_t i = next++; i < _secrets.size(); i = next++)
+		{
+			try
+			{
+				keys[i] = EncryptedKey{encrypt(_secrets[i].ref(), _pass, _kdf), fs::path(), KeyPair(Secret(_secrets[i])).address()};
+			}
+			catch (...)
+			{
+				lock_guard<mutex> l(errorLock);
+				if (!error)
+					error = current_exception();
+			}
+		}
+	};
+	vector<thread> workers;
+	for (unsigned t = 1; t < _threads; ++t)
+		workers.emplace_back(worker);
+	worker();
+	for (auto& t: workers)
+		t.join();
+	if (error)
+		rethrow_exception(error);
+
+	// Persist everything in one pass, each new key is written exactly once
+	for (size_t i = 0; i < _secrets.size(); ++i)
+	{
+		ret[i] = h128::random();
+		m_keys[ret[i]] = move(keys[i]);
+	}
+	save();
+	return ret;
+}
+
 void SecretStore::kill(h128 const& _uuid)
 {
 	m_cached.erase(_uuid);
 	if (m_keys.count(_uuid))
 	{
+		string name = m_keys[_uuid].filename.filename().string();
 		fs::remove(m_keys[_uuid].filename);
 		m_keys.erase(_uuid);
+		// A "-" line drops the earlier entry of the file
+		if (!name.empty())
+			appendIndex("- " + name + "\n");
 	}
 }
 
@@ -163,25 +260,143 @@ void SecretStore::clearCache() const
 	m_cached.clear();
 }
 
-void SecretStore::save(fs::path const& _keysPath)
+void SecretStore::saveKey(fs::path const& _keysPath, h128 const& _uuid, EncryptedKey& _key)
 {
+	if (!loadKey(_key))
+		BOOST_THROW_EXCEPTION(FileError() << errinfo_comment("Could not read key file: " + _key.filename.string()));
 	fs::create_directories(_keysPath);
 	DEV_IGNORE_EXCEPTIONS(fs::permissions(_keysPath, fs::owner_all));
+	string uuid = toUUID(_uuid);
+	fs::path filename = (_keysPath / uuid).string() + ".json";
+	js::mObject v;
+	js::mValue crypto;
+	js::read_string(_key.encryptedKey, crypto);
+	v["address"] = _key.address.hex();
+	v["crypto"] = crypto;
+	v["id"] = uuid;
+	v["version"] = c_keyFileVersion;
+	writeFile(filename, js::write_string(js::mValue(v), true), true);
+	swap(_key.filename, filename);
+	_key.dirty = false;
+	_key.mtime = modificationTime(_key.filename);
+	_key.size = fs::file_size(_key.filename);
+	if (!filename.empty() && fs::exists(filename) && !fs::equivalent(filename, _key.filename))
+		fs::remove(filename);
+}
+
+void SecretStore::save(fs::path const& _keysPath)
+{
 	for (auto& k: m_keys)
+		saveKey(_keysPath, k.first, k.second);
+	writeIndex();
+}
+
+void SecretStore::save()
+{
+	string lines;
+	for (auto& k: m_keys)
+		if (k.second.dirty)
+		{
+			saveKey(m_path, k.first, k.second);
+			lines += indexLine(k.first, k.second);
+		}
+	appendIndex(lines);
+}
+
+map<string, pair<h128, SecretStore::EncryptedKey>> SecretStore::readIndex(fs::path const& _keysPath, size_t& o_lines) const
+{
+	map<string, pair<h128, EncryptedKey>> ret;
+	o_lines = 0;
+	fs::path indexFile = _keysPath / c_indexFilename;
+	if (!fs::exists(indexFile))
+		return ret;
+	istringstream in(contentsString(indexFile));
+	string line;
+	if (!getline(in, line) || line != c_indexHeader)
+		return ret;
+	// One key per line: <uuid> <address> <file name> <mtime> <size>, or "- <file name>" once it's removed.
+	// Later lines replace earlier ones for the same file
+	while (getline(in, line))
+	{
+		++o_lines;
+		istringstream l(line);
+		string uuid;
+		string address;
+		string name;
+		long long mtime;
+		uintmax_t size;
+		if (line.compare(0, 2, "- ") == 0)
+		{
+			ret.erase(line.substr(2));
+			continue;
+		}
+		if (!(l >> uuid >> address >> name >> mtime >> size))
+			continue;
+		h128 u = fromUUID(uuid);
+		if (!u || address.size() != 40 || !isHex(address))
+			continue;
+		EncryptedKey k{string(), fs::path(), Address(address), false};
+		k.loaded = false;
+		k.mtime = int64_t(mtime);
+		k.size = size;
+		ret[name] = make_pair(u, move(k));
+	}
+	return ret;
+}
+
+void SecretStore::writeIndex() const
+{
+	if (m_path.empty())
+		return;
+	// Only keys that are stored in their (canonical) file can be indexed
+	string out = c_indexHeader + "\n";
+	for (auto const& k: m_keys)
+		out += indexLine(k.first, k.second);
+	// The index is only a cache, the keys are always recoverable from their files
+	DEV_IGNORE_EXCEPTIONS(writeFile(m_path / c_indexFilename, asBytes(out), true));
+}
+
+string SecretStore::indexLine(h128 const& _uuid, EncryptedKey const& _key)
+{
+	// Only keys that are stored in their (canonical) file can be indexed
+	string name = _key.filename.filename().string();
+	if (_key.dirty || name.empty() || name.find_first_of(" \t\r\n") != string::npos)
+		return string();
+	return toUUID(_uuid) + " " + _key.address.hex() + " " + name + " "
+		+ to_string(static_cast<long long>(_key.mtime)) + " " + to_string(_key.size) + "\n";
+}
+
+void SecretStore::appendIndex(string const& _lines) const
+{
+	if (m_path.empty() || _lines.empty())
+		return;
+	fs::path indexFile = m_path / c_indexFilename;
+	if (!fs::exists(indexFile))
+	{
+		writeIndex();
+		return;
+	}
+	// A torn last line is skipped when reading, and the key is then just read from its file
+	ofstream out(indexFile.string(), ios::out | ios::app | ios::binary);
+	out << _lines;
+}
+
+bool SecretStore::loadKey(EncryptedKey const& _key) const
+{
+	if (_key.loaded)
+		return true;
+	try
 	{
-		string uuid = toUUID(k.first);
-		fs::path filename = (_keysPath / uuid).string() + ".json";
-		js::mObject v;
-		js::mValue crypto;
-		js::read_string(k.second.encryptedKey, crypto);
-		v["address"] = k.second.address.hex();
-		v["crypto"] = crypto;
-		v["id"] = uuid;
-		v["version"] = c_keyFileVersion;
-		writeFile(filename, js::write_string(js::mValue(v), true));
-		swap(k.second.filename, filename);
-		if (!filename.empty() && !fs::equivalent(filename, k.second.filename))
-			fs::remove(filename);
+		js::mValue u = upgraded(contentsString(_key.filename));
+		if (u.type() != js::obj_type)
+			return false;
+		_key.encryptedKey = js::write_string(u.get_obj()["crypto"], false);
+		_key.loaded = true;
+		return true;
+	}
+	catch (...)
+	{
+		return false;
 	}
 }
 
@@ -191,6 +406,7 @@ bool SecretStore::noteAddress(h128 const& _uuid, Address const& _address)
     if (it != m_keys.end() && it->second.address == ZeroAddress)
     {
         it->second.address = _address;
+        it->second.dirty = true;
         return true;
     }
     return false;
@@ -200,9 +416,41 @@ void SecretStore::load(fs::path const& _keysPath)
 {
 	try
 	{
+		size_t indexLines = 0;
+		auto index = readIndex(_keysPath, indexLines);
+		bool indexChanged = false;
+		size_t indexed = 0;
+		string indexName = c_indexFilename;
 		for (fs::directory_iterator it(_keysPath); it != fs::directory_iterator(); ++it)
-			if (fs::is_regular_file(it->path()))
-				readKey(it->path().string(), true);
+		{
+			fs::path const& file = it->path();
+			string name = file.filename().string();
+			// Skip the index itself and its temporary files
+			if (name.compare(0, indexName.size(), indexName) == 0 || !fs::is_regular_file(file))
+				continue;
+			int64_t mtime = modificationTime(file);
+			uintmax_t size = fs::file_size(file);
+			auto i = index.find(name);
+			if (i != index.end() && i->second.second.mtime == mtime && i->second.second.size == size)
+			{
+				// Unchanged since it was indexed, the file will only be read when its secret is needed
+				i->second.second.filename = file;
+				m_keys[i->second.first] = move(i->second.second);
+				++indexed;
+			}
+			else
+			{
+				if (h128 uuid = readKey(file.string(), true))
+				{
+					m_keys[uuid].mtime = mtime;
+					m_keys[uuid].size = size;
+				}
+				indexChanged = true;
+			}
+		}
+		// Rewritten from scratch when something changed behind its back or appended lines were superseded
+		if (indexChanged || indexed != index.size() || indexLines != index.size())
+			writeIndex();
 	}
 	catch (...) {}
 }
@@ -227,7 +475,10 @@ h128 SecretStore::readKeyContent(string const& _content, fs::path const& _file)
 				address = Address(o["address"].get_str());
 			// else
 				// cwarn << "Account address is either not defined or not in hex format" << _file.string();
-			m_keys[uuid] = EncryptedKey{js::write_string(o["crypto"], false), _file, address};
+			// Keys read from their canonical file in the current format don't need to be written again
+			bool current = o.count("version") && o["version"].type() == js::int_type && o["version"].get_int() == c_keyFileVersion;
+			bool canonical = !_file.empty() && _file.filename() == fs::path(toUUID(uuid) + ".json");
+			m_keys[uuid] = EncryptedKey{js::write_string(o["crypto"], false), _file, address, !(current && canonical)};
 			return uuid;
 		}
 		// else
@@ -250,7 +501,8 @@ bool SecretStore::recode(Address const& _address, string const& _newPass, functi
 		else
 		{
 			k->second.encryptedKey = encrypt(s.ref(), _newPass, _kdf);
-			save();
+			saveKey(m_path, k->first, k->second);
+			appendIndex(indexLine(k->first, k->second));
 			return true;
 		}
 	}
@@ -280,10 +532,33 @@ bool SecretStore::recode(h128 const& _uuid, string const& _newPass, function<str
 		return false;
 	m_cached.erase(_uuid);
 	m_keys[_uuid].encryptedKey = encrypt(s.ref(), _newPass, _kdf);
-	save();
+	saveKey(m_path, _uuid, m_keys[_uuid]);
+	appendIndex(indexLine(_uuid, m_keys[_uuid]));
 	return true;
 }
 
+namespace
+{
+/// scrypt parameters for newly encrypted keys, see SecretStore::setScryptParams.
+ScryptParams s_scryptParams;
+mutex s_scryptParamsLock;
+}
+
+void SecretStore::setScryptParams(ScryptParams const& _params)
+{
+	ScryptParams const floor;
+	lock_guard<mutex> l(s_scryptParamsLock);
+	s_scryptParams.n = max(_params.n, floor.n);
+	s_scryptParams.r = max(_params.r, floor.r);
+	s_scryptParams.p = max(_params.p, floor.p);
+}
+
+ScryptParams SecretStore::scryptParams()
+{
+	lock_guard<mutex> l(s_scryptParamsLock);
+	return s_scryptParams;
+}
+
 static bytesSec deriveNewKey(string const& _pass, KDF _kdf, js::mObject& o_ret)
 {
 	unsigned dklen = 32;
@@ -291,8 +566,10 @@ static bytesSec deriveNewKey(string const& _pass, KDF _kdf, js::mObject& o_ret)
 	bytes salt = h256::random().asBytes();
 	if (_kdf == KDF::Scrypt)
 	{
-		unsigned p = 1;
-		unsigned r = 8;
+		ScryptParams scryptParams = SecretStore::scryptParams();
+		iterations = unsigned(scryptParams.n);
+		unsigned p = scryptParams.p;
+		unsigned r = scryptParams.r;
 		o_ret["kdf"] = "scrypt";
 		{
 			js::mObject params;
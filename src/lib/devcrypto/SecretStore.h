@@ -4,12 +4,15 @@
 
 #pragma once
 
+#include <ctime>
 #include <functional>
+#include <map>
 #include <mutex>
 #include <lib/devcore/FixedHash.h>
 #include <lib/devcore/FileSystem.h>
 #include <lib/devcore/CommonIO.h>
 #include "Common.h"
+#include "KDF.h"
 
 #include <boost/filesystem.hpp>
 
@@ -26,6 +29,10 @@ enum class KDF {
  * and changes to the keys are automatically synced to the directory.
  * Each file stores exactly one key in a specific JSON format whose file name is derived from the
  * UUID of the key.
+ * An index file in the same directory keeps the uuid, address, file name, modification time and
+ * size of every key, so on load only the files that are new or changed since the index was written
+ * are parsed. The other keys are read from their files only when their secret is requested.
+ * Changes are appended to the index, which is only rewritten as a whole on load.
  * @note that most of the functions here affect the filesystem and throw exceptions on failure,
  * and they also throw exceptions upon rare malfunction in the cryptographic functions.
  */
@@ -34,9 +41,18 @@ class SecretStore
 public:
 	struct EncryptedKey
 	{
-		std::string encryptedKey;
+		/// Read from the file on demand by loadKey() (also on const stores), see @a loaded.
+		mutable std::string encryptedKey;
 		boost::filesystem::path filename;
 		Address address;
+		/// True if the key has changes that were not written to disk yet.
+		bool dirty = true;
+		/// False if only the index entry was read, @a encryptedKey is then read from the file on demand.
+		mutable bool loaded = true;
+		/// Modification time (in nanoseconds, as precise as the filesystem keeps it) and size of
+		/// the key file when it was last read or written.
+		int64_t mtime = 0;
+		uintmax_t size = 0;
 	};
 
 	/// Construct a new SecretStore but don't read any keys yet.
@@ -51,7 +67,8 @@ public:
 
 	/// @returns the secret key stored by the given @a _uuid.
 	/// @param _pass function that returns the password for the key.
-	/// @param _useCache if true, allow previously decrypted keys to be returned directly.
+	/// @param _useCache if true, allow previously decrypted keys to be returned directly,
+	/// and keep this one cached. If false, no plaintext copy stays in the store.
 	bytesSec secret(h128 const& _uuid, std::function<std::string()> const& _pass, bool _useCache = true) const;
 	/// @returns the secret key stored by the given @a _uuid.
 	/// @param _pass function that returns the password for the key.
@@ -68,6 +85,12 @@ public:
 	/// (a key derived from) the password @a _pass.
 	h128 importSecret(bytesSec const& _s, std::string const& _pass);
 	h128 importSecret(bytesConstRef _s, std::string const& _pass);
+	/// Imports many decrypted keys at once, all encrypted with the password @a _pass.
+	/// Keys are encrypted in parallel on up to @a _threads worker threads (0 = one per core,
+	/// at most as many scrypt derivations as fit in 1GB, i.e. 4 with the default ~256MB ones),
+	/// then written to disk in a single pass. The decrypted keys are not cached.
+	/// @returns the uuids of the imported keys, in the same order as @a _secrets.
+	std::vector<h128> importSecrets(std::vector<bytesSec> const& _secrets, std::string const& _pass, KDF _kdf = KDF::Scrypt, unsigned _threads = 0);
 	/// Decrypts and re-encrypts the key identified by @a _uuid.
 	bool recode(h128 const& _uuid, std::string const& _newPass, std::function<std::string()> const& _pass, KDF _kdf = KDF::Scrypt);
 	/// Decrypts and re-encrypts the key identified by @a _address.
@@ -97,13 +120,19 @@ public:
 
 	/// Store all keys in the directory @a _keysPath.
 	void save(boost::filesystem::path const& _keysPath);
-	/// Store all keys in the managed directory.
-	void save() { save(m_path); }
+	/// Store the keys that changed since they were last written in the managed directory.
+	void save();
 	/// @returns true if the current file @arg _uuid contains an empty address. m_keys will be updated with the given @arg _address.
 	bool noteAddress(h128 const& _uuid, Address const& _address);
 	/// @returns the address of the given key or the zero address if it is unknown.
 	Address address(h128 const& _uuid) const { return m_keys.at(_uuid).address; }
 
+	/// Sets the scrypt parameters used to encrypt new (or recoded) keys, e.g. as picked by
+	/// calibrateScrypt(). Values below the defaults (n = 2^18, r = 8, p = 1) are raised to them.
+	static void setScryptParams(ScryptParams const& _params);
+	/// @returns the scrypt parameters used to encrypt new keys.
+	static ScryptParams scryptParams();
+
 	/// @returns the default path for the managed directory.
 	static boost::filesystem::path defaultPath() { return getDataDir("web3") / boost::filesystem::path("keys"); }
 
@@ -115,6 +144,22 @@ private:
 	static std::string encrypt(bytesConstRef _v, std::string const& _pass, KDF _kdf = KDF::Scrypt);
 	/// Decrypts @a _v with a key derived from @a _pass or the empty byte array on error.
 	static bytesSec decrypt(std::string const& _v, std::string const& _pass);
+	/// Reads the index file in @a _keysPath, @a o_lines is set to the number of entry lines in it.
+	/// @returns the index entries (uuid and key data, not loaded) by file name.
+	std::map<std::string, std::pair<h128, EncryptedKey>> readIndex(boost::filesystem::path const& _keysPath, size_t& o_lines) const;
+	/// Rewrites the index file in the managed directory with every key that is stored in its file.
+	void writeIndex() const;
+	/// @returns the index line of a key, or an empty string if it isn't stored in its own file yet.
+	static std::string indexLine(h128 const& _uuid, EncryptedKey const& _key);
+	/// Appends entry lines to the index file (a later line for the same file replaces an earlier one),
+	/// so a single key change doesn't rewrite it. load() compacts it once lines are superseded.
+	void appendIndex(std::string const& _lines) const;
+	/// Reads the encrypted key of an index-only entry from its file.
+	/// @returns false if the file couldn't be read or parsed.
+	bool loadKey(EncryptedKey const& _key) const;
+	/// Writes a single key file to the directory @a _keysPath (atomically, through a
+	/// temporary file), removing the file it was previously stored in if different.
+	void saveKey(boost::filesystem::path const& _keysPath, h128 const& _uuid, EncryptedKey& _key);
 	/// @returns the key given the @a _address.
 	std::pair<h128 const, EncryptedKey> const* key(Address const& _address) const;
 	std::pair<h128 const, EncryptedKey>* key(Address const& _address);
@@ -179,8 +179,16 @@ private:
 
 template<class... Args> using Handler = std::shared_ptr<typename Signal<Args...>::HandlerAux>;
 
+/// EIP-2718 envelope type of a transaction.
+enum class TransactionType: uint8_t
+{
+	Legacy = 0,			///< Untyped transaction, priced by gasPrice.
+	DynamicFee = 2		///< EIP-1559 transaction, priced by maxFeePerGas and maxPriorityFeePerGas.
+};
+
 struct TransactionSkeleton
 {
+	TransactionType txType = TransactionType::Legacy;
 	bool creation = false;
 	Address from;
 	Address to;
@@ -190,6 +198,8 @@ struct TransactionSkeleton
 	u256 nonce = Invalid256;
 	u256 gas = Invalid256;
 	u256 gasPrice = Invalid256;
+	u256 maxFeePerGas = Invalid256;			///< Only used by DynamicFee transactions.
+	u256 maxPriorityFeePerGas = Invalid256;	///< Only used by DynamicFee transactions.
 
 	std::string userReadable(bool _toProxy, std::function<std::pair<bool, std::string>(TransactionSkeleton const&)> const& _getNatSpec, std::function<std::string(Address const&)> const& _formatAddress) const;
 };
@@ -92,6 +92,10 @@ public:
 
 	h128 import(Secret const& _s, std::string const& _accountName, std::string const& _pass, std::string const& _passwordHint);
 	h128 import(Secret const& _s, std::string const& _accountName) { return import(_s, _accountName, defaultPassword(), std::string()); }
+	/// Imports many secrets (with their account names) at once, all with the same password.
+	/// Keys are encrypted in parallel and both the key files and the keys file are written once.
+	/// @returns the uuids of the imported keys, in the same order as @a _accounts.
+	std::vector<h128> import(std::vector<std::pair<Secret, std::string>> const& _accounts, std::string const& _pass, std::string const& _passwordHint);
 
 	SecretStore& store() { return m_store; }
 	void importExisting(h128 const& _uuid, std::string const& _accountName, std::string const& _pass, std::string const& _passwordHint);
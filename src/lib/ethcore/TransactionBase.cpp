@@ -14,10 +14,12 @@ using namespace dev::eth;
 
 TransactionBase::TransactionBase(TransactionSkeleton const& _ts, Secret const& _s):
     m_type(_ts.creation ? ContractCreation : MessageCall),
+    m_txType(_ts.txType),
     m_nonce(_ts.nonce),
     m_value(_ts.value),
     m_receiveAddress(_ts.to),
-    m_gasPrice(_ts.gasPrice),
+    m_gasPrice(_ts.txType == TransactionType::DynamicFee ? _ts.maxFeePerGas : _ts.gasPrice),
+    m_maxPriorityFeePerGas(_ts.maxPriorityFeePerGas),
     m_gas(_ts.gas),
     m_data(_ts.data),
     m_sender(_ts.from),
@@ -29,6 +31,15 @@ TransactionBase::TransactionBase(TransactionSkeleton const& _ts, Secret const& _
 
 TransactionBase::TransactionBase(bytesConstRef _rlpData, CheckTransaction _checkSig)
 {
+    // Typed transactions (EIP-2718) start with the type byte, legacy ones with an RLP list prefix
+    if (!_rlpData.empty() && _rlpData[0] <= 0x7f)
+    {
+        if (_rlpData[0] != static_cast<byte>(TransactionType::DynamicFee))
+            BOOST_THROW_EXCEPTION(InvalidTransactionFormat() << errinfo_comment("unsupported transaction type"));
+        decodeDynamicFee(RLP(_rlpData.cropped(1)), _checkSig);
+        return;
+    }
+
     RLP const rlp(_rlpData);
     try
     {
@@ -94,6 +105,64 @@ TransactionBase::TransactionBase(bytesConstRef _rlpData, CheckTransaction _check
     }
 }
 
+void TransactionBase::decodeDynamicFee(RLP const& _rlp, CheckTransaction _checkSig)
+{
+    try
+    {
+        // [chainId, nonce, maxPriorityFeePerGas, maxFeePerGas, gas, to, value, data, accessList, yParity, r, s]
+        if (!_rlp.isList() || _rlp.itemCount() != 12)
+            BOOST_THROW_EXCEPTION(InvalidTransactionFormat()
+                                  << errinfo_comment("EIP-1559 transaction RLP must be a list of 12 items"));
+
+        m_txType = TransactionType::DynamicFee;
+        u256 const chainId = _rlp[0].toInt<u256>();
+        if (chainId > std::numeric_limits<uint64_t>::max())
+            BOOST_THROW_EXCEPTION(InvalidSignature());
+        m_chainId = static_cast<uint64_t>(chainId);
+        m_nonce = _rlp[1].toInt<u256>();
+        m_maxPriorityFeePerGas = _rlp[2].toInt<u256>();
+        m_gasPrice = _rlp[3].toInt<u256>();
+        m_gas = _rlp[4].toInt<u256>();
+        if (!_rlp[5].isData())
+            BOOST_THROW_EXCEPTION(InvalidTransactionFormat()
+                                  << errinfo_comment("recepient RLP must be a byte array"));
+        m_type = _rlp[5].isEmpty() ? ContractCreation : MessageCall;
+        m_receiveAddress = _rlp[5].isEmpty() ? Address() : _rlp[5].toHash<Address>(RLP::VeryStrict);
+        m_value = _rlp[6].toInt<u256>();
+
+        if (!_rlp[7].isData())
+            BOOST_THROW_EXCEPTION(InvalidTransactionFormat()
+                                  << errinfo_comment("transaction data RLP must be a byte array"));
+        m_data = _rlp[7].toBytes();
+
+        // The access list isn't used here, it's only kept so the transaction serialises back the same
+        if (!_rlp[8].isList())
+            BOOST_THROW_EXCEPTION(InvalidTransactionFormat()
+                                  << errinfo_comment("access list RLP must be a list"));
+        m_accessList = _rlp[8].data().toBytes();
+
+        u256 const v = _rlp[9].toInt<u256>();
+        h256 const r = _rlp[10].toInt<u256>();
+        h256 const s = _rlp[11].toInt<u256>();
+
+        // Typed transactions carry the bare recovery id, the chain id is signed as a field
+        if (v > 1)
+            BOOST_THROW_EXCEPTION(InvalidSignature());
+        m_vrs = SignatureStruct{r, s, static_cast<byte>(v)};
+
+        if (!isZeroSignature(r, s) && _checkSig >= CheckTransaction::Cheap && !m_vrs->isValid())
+            BOOST_THROW_EXCEPTION(InvalidSignature());
+
+        if (_checkSig == CheckTransaction::Everything)
+            m_sender = sender();
+    }
+    catch (Exception& _e)
+    {
+        _e << errinfo_name("invalid transaction format RLP: " + toHex(_rlp.data()));
+        throw;
+    }
+}
+
 Address const& TransactionBase::safeSender() const noexcept
 {
     try
@@ -139,6 +208,9 @@ u256 TransactionBase::rawV() const
     if (!m_vrs)
         BOOST_THROW_EXCEPTION(TransactionIsUnsigned());
 
+    if (m_txType != TransactionType::Legacy)
+        return m_vrs->v;
+
     int const vOffset = m_chainId.has_value() ? *m_chainId * 2 + 35 : 27;
     return m_vrs->v + vOffset;
 }
@@ -163,6 +235,27 @@ void TransactionBase::streamRLP(RLPStream& _s, IncludeSignature _sig, bool _forE
     if (m_type == NullTransaction)
         return;
 
+    if (m_txType == TransactionType::DynamicFee)
+    {
+        _s.appendList((_sig ? 3 : 0) + 9);
+        _s << m_chainId.value_or(0) << m_nonce << m_maxPriorityFeePerGas << m_gasPrice << m_gas;
+        if (m_type == MessageCall)
+            _s << m_receiveAddress;
+        else
+            _s << "";
+        _s << m_value << m_data;
+        _s.appendRaw(m_accessList);
+
+        if (_sig)
+        {
+            if (!m_vrs)
+                BOOST_THROW_EXCEPTION(TransactionIsUnsigned());
+
+            _s << (u256)m_vrs->v << (u256)m_vrs->r << (u256)m_vrs->s;
+        }
+        return;
+    }
+
     _s.appendList((_sig || _forEip155hash ? 3 : 0) + 6);
     _s << m_nonce << m_gasPrice << m_gas;
     if (m_type == MessageCall)
@@ -187,6 +280,18 @@ void TransactionBase::streamRLP(RLPStream& _s, IncludeSignature _sig, bool _forE
         _s << *m_chainId << 0 << 0;
 }
 
+bytes TransactionBase::rlp(IncludeSignature _sig) const
+{
+    RLPStream s;
+    streamRLP(s, _sig);
+    if (m_txType == TransactionType::Legacy)
+        return s.out();
+
+    bytes ret{static_cast<byte>(m_txType)};
+    ret += s.out();
+    return ret;
+}
+
 static const u256 c_secp256k1n("115792089237316195423570985008687907852837564279074904382605163141518161494337");
 
 void TransactionBase::checkLowS() const
@@ -221,10 +326,18 @@ h256 TransactionBase::sha3(IncludeSignature _sig) const
     if (_sig == WithSignature && m_hashWith)
         return m_hashWith;
 
-    RLPStream s;
-    streamRLP(s, _sig, isReplayProtected() && _sig == WithoutSignature);
-
-    auto ret = dev::sha3(s.out());
+    h256 ret;
+    if (m_txType != TransactionType::Legacy)
+    {
+        // Typed transactions are hashed with the type byte, and sign the chain id as a field
+        ret = dev::sha3(rlp(_sig));
+    }
+    else
+    {
+        RLPStream s;
+        streamRLP(s, _sig, isReplayProtected() && _sig == WithoutSignature);
+        ret = dev::sha3(s.out());
+    }
     if (_sig == WithSignature)
         m_hashWith = ret;
     return ret;
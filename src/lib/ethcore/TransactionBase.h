@@ -87,12 +87,14 @@ public:
     /// @returns true if transaction is contract-creation.
     bool isCreation() const { return m_type == ContractCreation; }
 
-    /// Serialises this transaction to an RLPStream.
+    /// Serialises this transaction to an RLPStream. For typed transactions this is only the
+    /// payload, without the leading type byte.
     /// @throws TransactionIsUnsigned if including signature was requested but it was not initialized
     void streamRLP(RLPStream& _s, IncludeSignature _sig = WithSignature, bool _forEip155hash = true) const;
 
-    /// @returns the RLP serialisation of this transaction.
-    bytes rlp(IncludeSignature _sig = WithSignature) const { RLPStream s; streamRLP(s, _sig); return s.out(); }
+    /// @returns the serialisation of this transaction, as an EIP-2718 envelope
+    /// (type byte followed by the RLP payload) for typed transactions.
+    bytes rlp(IncludeSignature _sig = WithSignature) const;
 
     /// @returns the SHA3 hash of the RLP serialisation of this transaction.
     h256 sha3(IncludeSignature _sig = WithSignature) const;
@@ -101,8 +103,21 @@ public:
     u256 value() const { return m_value; }
 
     /// @returns the base fee and thus the implied exchange rate of ETH to GAS.
+    /// For DynamicFee transactions this is maxFeePerGas, the most that may be paid per gas.
     u256 gasPrice() const { return m_gasPrice; }
 
+    /// @returns the EIP-2718 envelope type of the transaction.
+    TransactionType txType() const { return m_txType; }
+
+    /// @returns true if the transaction is an EIP-1559 transaction.
+    bool isDynamicFee() const { return m_txType == TransactionType::DynamicFee; }
+
+    /// @returns the most that may be paid per gas, base fee included (EIP-1559).
+    u256 maxFeePerGas() const { return m_gasPrice; }
+
+    /// @returns the most that may be paid per gas to the block producer (EIP-1559).
+    u256 maxPriorityFeePerGas() const { return m_maxPriorityFeePerGas; }
+
     /// @returns the total gas to convert, paid for from sender's account. Any unused gas gets refunded once the contract is ended.
     u256 gas() const { return m_gas; }
 
@@ -137,7 +152,8 @@ public:
     /// @throws TransactionIsUnsigned if signature was not initialized
     SignatureStruct const& signature() const;
 
-    /// @returns v value of the transaction (has chainID and recoveryID encoded in it)
+    /// @returns v value of the transaction (has chainID and recoveryID encoded in it,
+    /// or is just the recoveryID for typed transactions)
     /// @throws TransactionIsUnsigned if signature was not initialized
     u256 rawV() const;
 
@@ -165,11 +181,17 @@ protected:
     /// Clears the signature.
     void clearSignature() { m_vrs = SignatureStruct(); }
 
+    /// Constructs a typed transaction from the given RLP payload (without the type byte).
+    void decodeDynamicFee(RLP const& _rlp, CheckTransaction _checkSig);
+
     Type m_type = NullTransaction;		///< Is this a contract-creation transaction or a message-call transaction?
+    TransactionType m_txType = TransactionType::Legacy;	///< EIP-2718 envelope type.
     u256 m_nonce;						///< The transaction-count of the sender.
     u256 m_value;						///< The amount of ETH to be transferred by this transaction. Called 'endowment' for contract-creation transactions.
     Address m_receiveAddress;			///< The receiving address of the transaction.
-    u256 m_gasPrice;					///< The base fee and thus the implied exchange rate of ETH to GAS.
+    u256 m_gasPrice;					///< The base fee and thus the implied exchange rate of ETH to GAS. maxFeePerGas for DynamicFee transactions.
+    u256 m_maxPriorityFeePerGas;		///< The most paid per gas to the block producer, for DynamicFee transactions.
+    bytes m_accessList = bytes{0xc0};	///< RLP of the EIP-2930 access list of typed transactions, empty by default.
     u256 m_gas;							///< The total gas to convert, paid for from sender's account. Any unused gas gets refunded once the contract is ended.
     bytes m_data;						///< The data associated with the transaction, or the initialiser if it's a creation transaction.
     boost::optional<SignatureStruct> m_vrs;	///< The signature of the transaction. Encodes the sender.
@@ -81,6 +81,10 @@ namespace ledger {
       ret.second = "Address doesn't exist in the desired path";
       return ret;
     }
+    // The device signs legacy transactions only, at the quoted gas price
+    if (transactionSkl.txType == dev::eth::TransactionType::DynamicFee) {
+      transactionSkl.txType = dev::eth::TransactionType::Legacy;
+    }
     dev::eth::TransactionBase transaction(transactionSkl);
     auto signature = ledger::encoding::decodeSignEthMessage(
       this->ledgerDevice.exchangeMessage(ledger::encoding::encodeSignEthMessage(transaction, path))
@@ -0,0 +1,138 @@
+// Copyright (c) 2020-2021 AVME Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <core/Metrics.h>
+#include <core/Utils.h>
+#include <network/API.h>
+#include <network/Graph.h>
+
+/**
+ * Load driver for end-to-end refresh latency.
+ * Each refresh does what the wallet does when updating an account's balances
+ * (see QmlSystem::getAccountAllBalances): one batched JSON-RPC request with
+ * eth_getBalance plus an eth_call balanceOf per token, followed by
+ * Graph::getAccountPrices for the same tokens, and parses both answers.
+ * Meant to be pointed at avme-stub-server, results are printed as JSON.
+ */
+
+struct LoadOptions {
+  std::string apiURL = "http://127.0.0.1:8545/";
+  std::string graphURL = "http://127.0.0.1:8545/graph";
+  std::string address = "0x1111111111111111111111111111111111111111";
+  int refreshes = 100;
+  int concurrency = 4;
+  int tokens = 10;
+};
+
+// Run one full refresh. Returns true if every answer could be parsed.
+static bool refresh(const LoadOptions& opts, const std::vector<ARC20Token>& tokenList) {
+  std::string addressStr = opts.address.substr(2);
+  std::vector<Request> reqs;
+  reqs.push_back({1, "2.0", "eth_getBalance", {opts.address, "latest"}});
+  for (const ARC20Token& token : tokenList) {
+    json params;
+    json array = json::array();
+    params["to"] = token.address;
+    params["data"] = "0x70a08231000000000000000000000000" + addressStr;
+    array.push_back(params);
+    array.push_back("latest");
+    reqs.push_back({reqs.size() + size_t(1), "2.0", "eth_call", array});
+  }
+  try {
+    std::string resp = API::httpGetRequest(API::buildMultiRequest(reqs));
+    json resultArr = json::parse(resp);
+    if (!resultArr.is_array() || resultArr.size() != reqs.size()) return false;
+    for (const json& result : resultArr) {
+      if (!result.contains("result")) return false;
+      boost::lexical_cast<HexTo<u256>>(result["result"].get<std::string>());
+    }
+    json prices = Graph::getAccountPrices(tokenList);
+    boost::lexical_cast<bigfloat>(Graph::parseAVAXPriceUSD(prices));
+    for (const ARC20Token& token : tokenList) {
+      std::string addr = Utils::toLowerCaseAddress(token.address);
+      prices["data"]["token_" + addr]["derivedETH"].get<std::string>();
+    }
+  } catch (std::exception const& e) {
+    return false;
+  }
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  LoadOptions opts;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    std::string next = (i + 1 < argc) ? argv[i + 1] : "";
+    if (arg == "--api") { opts.apiURL = next; i++; }
+    else if (arg == "--graph") { opts.graphURL = next; i++; }
+    else if (arg == "--address") { opts.address = next; i++; }
+    else if (arg == "--refreshes") { opts.refreshes = std::atoi(next.c_str()); i++; }
+    else if (arg == "--concurrency") { opts.concurrency = std::atoi(next.c_str()); i++; }
+    else if (arg == "--tokens") { opts.tokens = std::atoi(next.c_str()); i++; }
+    else {
+      std::cout << "Usage: " << argv[0] << " [--api URL] [--graph URL] [--address 0x...]"
+        << " [--refreshes 100] [--concurrency 4] [--tokens 10]" << std::endl;
+      return (arg == "--help") ? 0 : 1;
+    }
+  }
+  API::setEndpoint(Endpoint::fromURL(opts.apiURL));
+  Graph::setEndpoint(Endpoint::fromURL(opts.graphURL));
+  Logger::setLevel(Logger::Level::Warning);
+
+  // Fake token list, addresses only need to be unique
+  std::vector<ARC20Token> tokenList;
+  for (int i = 0; i < opts.tokens; i++) {
+    ARC20Token token;
+    char addr[43];
+    std::snprintf(addr, sizeof(addr), "0x%040x", i + 1);
+    token.address = addr;
+    token.symbol = "TKN" + std::to_string(i);
+    token.name = token.symbol;
+    token.decimals = 18;
+    tokenList.push_back(token);
+  }
+
+  // Each worker takes refreshes from a shared counter until they're all done
+  Metrics::Histogram& latency = Metrics::histogram("avme_loadtest_refresh_seconds");
+  std::atomic<int> next{0};
+  std::atomic<int> errors{0};
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> workers;
+  for (int w = 0; w < opts.concurrency; w++) {
+    workers.emplace_back([&]{
+      while (next++ < opts.refreshes) {
+        Metrics::Timer timer(latency);
+        if (!refresh(opts, tokenList)) errors++;
+      }
+    });
+  }
+  for (std::thread& t : workers) t.join();
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  json result;
+  result["api"] = opts.apiURL;
+  result["graph"] = opts.graphURL;
+  result["refreshes"] = opts.refreshes;
+  result["concurrency"] = opts.concurrency;
+  result["tokens"] = opts.tokens;
+  result["errors"] = errors.load();
+  result["elapsed_s"] = elapsed;
+  result["throughput_per_s"] = (elapsed > 0) ? opts.refreshes / elapsed : 0;
+  result["latency_ms"]["p50"] = latency.quantile(0.5) / 1000.0;
+  result["latency_ms"]["p90"] = latency.quantile(0.9) / 1000.0;
+  result["latency_ms"]["p99"] = latency.quantile(0.99) / 1000.0;
+  result["latency_ms"]["max"] = latency.getMax() / 1000.0;
+  result["latency_ms"]["mean"] = (latency.getCount() > 0)
+    ? (latency.getSum() / 1000.0) / latency.getCount() : 0;
+  std::cout << result.dump(2) << std::endl;
+  Logger::flush();
+  return (errors > 0) ? 2 : 0;
+}
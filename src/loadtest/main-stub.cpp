@@ -0,0 +1,197 @@
+// Copyright (c) 2020-2021 AVME Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+
+#include <boost/asio.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <boost/beast/version.hpp>
+
+#include <lib/nlohmann_json/json.hpp>
+
+using json = nlohmann::json;
+using tcp = boost::asio::ip::tcp;
+namespace http = boost::beast::http;
+
+/**
+ * Stub JSON-RPC and GraphQL server for offline end-to-end load tests.
+ * Replays recorded responses from a JSON file (see responses.json):
+ * - "rpc": results by JSON-RPC method. eth_call results can also be
+ *   an object keyed by function selector, with a "default" fallback.
+ * - "graph": responses by GraphQL operation name (as built by GraphQuery).
+ *   Keys containing "{i}" are repeated for every "t<i>" variable in the
+ *   request, so token lists of any size get an answer.
+ * Supports single and batch JSON-RPC requests, and adds configurable
+ * latency (with jitter) and a configurable rate of injected errors.
+ * Plain HTTP only, point the wallet to it with e.g.
+ * AVME_API_URL=http://127.0.0.1:8545/ AVME_GRAPH_URL=http://127.0.0.1:8545/graph
+ */
+
+// Runtime options
+struct StubOptions {
+  unsigned short port = 8545;
+  std::string responsesFile = "responses.json";
+  int latencyMs = 0;
+  int jitterMs = 0;
+  double errorRate = 0.0;
+  std::string errorMode = "http"; // "http" (503) or "rpc" (JSON-RPC error object)
+  unsigned seed = 42;
+};
+
+static StubOptions opts;
+static json responses;
+
+// Answer a single JSON-RPC request object.
+static json handleRPC(const json& req, std::mt19937& rng) {
+  json ret;
+  ret["jsonrpc"] = "2.0";
+  ret["id"] = req.value("id", json(nullptr));
+  std::string method = req.value("method", "");
+  std::uniform_real_distribution<double> dist(0.0, 1.0);
+  if (opts.errorMode == "rpc" && dist(rng) < opts.errorRate) {
+    ret["error"] = {{"code", -32000}, {"message", "injected error"}};
+    return ret;
+  }
+  if (!responses.at("rpc").contains(method)) {
+    ret["error"] = {{"code", -32601}, {"message", "method not recorded: " + method}};
+    return ret;
+  }
+  json result = responses.at("rpc").at(method);
+  if (method == "eth_call" && result.is_object()) {
+    std::string selector;
+    if (req.contains("params") && req["params"].is_array() && !req["params"].empty()) {
+      std::string data = req["params"][0].value("data", "");
+      selector = data.substr(0, 10);
+    }
+    result = (result.contains(selector)) ? result[selector] : result.value("default", json("0x"));
+  }
+  ret["result"] = result;
+  return ret;
+}
+
+// Answer a GraphQL request, expanding "{i}" templates for every "t<i>" variable.
+static json handleGraph(const json& req) {
+  std::string query = req.value("query", "");
+  std::string name;
+  if (query.compare(0, 6, "query ") == 0) {
+    std::size_t end = query.find_first_of("( {", 6);
+    name = query.substr(6, end - 6);
+  }
+  if (!responses.at("graph").contains(name)) {
+    return {{"errors", {{{"message", "query not recorded: " + name}}}}};
+  }
+  json recorded = responses.at("graph").at(name);
+  if (!recorded.contains("data")) return recorded;
+  json vars = req.value("variables", json::object());
+  json data = json::object();
+  for (auto it = recorded["data"].begin(); it != recorded["data"].end(); ++it) {
+    std::size_t pos = it.key().find("{i}");
+    if (pos == std::string::npos) { data[it.key()] = it.value(); continue; }
+    for (int i = 0; vars.contains("t" + std::to_string(i)); i++) {
+      std::string key = it.key();
+      key.replace(pos, 3, std::to_string(i));
+      data[key] = it.value();
+    }
+  }
+  json ret = recorded;
+  ret["data"] = data;
+  return ret;
+}
+
+// Serve every request on a connection until the client closes it.
+static void session(tcp::socket socket, unsigned seed) {
+  std::mt19937 rng(seed);
+  std::uniform_int_distribution<int> jitter(0, opts.jitterMs);
+  std::uniform_real_distribution<double> dist(0.0, 1.0);
+  try {
+    boost::beast::flat_buffer buffer;
+    for (;;) {
+      http::request<http::string_body> req;
+      boost::system::error_code ec;
+      http::read(socket, buffer, req, ec);
+      if (ec) break;
+
+      int delay = opts.latencyMs + ((opts.jitterMs > 0) ? jitter(rng) : 0);
+      if (delay > 0) std::this_thread::sleep_for(std::chrono::milliseconds(delay));
+
+      http::response<http::string_body> res{http::status::ok, req.version()};
+      res.set(http::field::server, "avme-stub-server");
+      res.set(http::field::content_type, "application/json");
+      res.keep_alive(req.keep_alive());
+      if (opts.errorMode == "http" && dist(rng) < opts.errorRate) {
+        res.result(http::status::service_unavailable);
+        res.body() = "{\"error\": \"injected error\"}";
+      } else {
+        json body = json::parse(req.body(), nullptr, false);
+        json answer;
+        if (body.is_discarded()) {
+          res.result(http::status::bad_request);
+          answer = {{"error", "invalid JSON"}};
+        } else if (body.is_array()) {
+          answer = json::array();
+          for (const json& r : body) answer.push_back(handleRPC(r, rng));
+        } else if (body.contains("query")) {
+          answer = handleGraph(body);
+        } else {
+          answer = handleRPC(body, rng);
+        }
+        res.body() = answer.dump();
+      }
+      res.prepare_payload();
+      http::write(socket, res, ec);
+      if (ec || !res.keep_alive()) break;
+    }
+    boost::system::error_code ec;
+    socket.shutdown(tcp::socket::shutdown_send, ec);
+  } catch (std::exception const& e) {
+    std::cerr << "Session error: " << e.what() << std::endl;
+  }
+}
+
+int main(int argc, char *argv[]) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    std::string next = (i + 1 < argc) ? argv[i + 1] : "";
+    if (arg == "--port") { opts.port = std::atoi(next.c_str()); i++; }
+    else if (arg == "--responses") { opts.responsesFile = next; i++; }
+    else if (arg == "--latency-ms") { opts.latencyMs = std::atoi(next.c_str()); i++; }
+    else if (arg == "--jitter-ms") { opts.jitterMs = std::atoi(next.c_str()); i++; }
+    else if (arg == "--error-rate") { opts.errorRate = std::atof(next.c_str()); i++; }
+    else if (arg == "--error-mode") { opts.errorMode = next; i++; }
+    else if (arg == "--seed") { opts.seed = std::atoi(next.c_str()); i++; }
+    else {
+      std::cout << "Usage: " << argv[0] << " [--port 8545] [--responses responses.json]"
+        << " [--latency-ms 0] [--jitter-ms 0] [--error-rate 0.0] [--error-mode http|rpc]"
+        << " [--seed 42]" << std::endl;
+      return (arg == "--help") ? 0 : 1;
+    }
+  }
+
+  std::ifstream file(opts.responsesFile);
+  if (!file.is_open()) {
+    std::cerr << "Couldn't open " << opts.responsesFile << std::endl;
+    return 1;
+  }
+  responses = json::parse(file, nullptr, false);
+  if (responses.is_discarded() || !responses.contains("rpc") || !responses.contains("graph")) {
+    std::cerr << "Invalid responses file " << opts.responsesFile << std::endl;
+    return 1;
+  }
+
+  boost::asio::io_context ioc;
+  tcp::acceptor acceptor{ioc, tcp::endpoint(boost::asio::ip::address_v4::loopback(), opts.port)};
+  std::cout << "Stub server listening on http://127.0.0.1:" << opts.port << "/" << std::endl;
+  for (unsigned conn = 0;; conn++) {
+    tcp::socket socket{ioc};
+    acceptor.accept(socket);
+    std::thread(session, std::move(socket), opts.seed + conn).detach();
+  }
+  return 0;
+}
@@ -35,6 +35,44 @@ int main(int argc, char *argv[]) {
   if (engine.rootObjects().isEmpty()) return -1;
   QmlSystem qmlsystem;
   QObject::connect(&app, SIGNAL(aboutToQuit()), &qmlsystem, SLOT(cleanAndClose()));
-  return app.exec();
+
+  // Optionally override the API/Graph endpoints (e.g. to use a local stub server)
+  try {
+    const char* apiURL = std::getenv("AVME_API_URL");
+    const char* graphURL = std::getenv("AVME_GRAPH_URL");
+    const char* tlsVerify = std::getenv("AVME_TLS_VERIFY");
+    bool verify = (tlsVerify != nullptr && std::string(tlsVerify) == "1");
+    Endpoint apiEndpoint = (apiURL != nullptr) ? Endpoint::fromURL(apiURL) : API::getEndpoint();
+    Endpoint graphEndpoint = (graphURL != nullptr) ? Endpoint::fromURL(graphURL) : Graph::getEndpoint();
+    apiEndpoint.verifyTLS = verify;
+    graphEndpoint.verifyTLS = verify;
+    API::setEndpoint(apiEndpoint);
+    Graph::setEndpoint(graphEndpoint);
+  } catch (std::exception const& e) {
+    Utils::logToDebug(std::string("Invalid endpoint override: ") + e.what());
+  }
+
+  // Optionally use a WebSocket endpoint for requests and push updates (new blocks, transfers)
+  try {
+    const char* wsURL = std::getenv("AVME_WS_URL");
+    const char* tlsVerify = std::getenv("AVME_TLS_VERIFY");
+    if (wsURL != nullptr) {
+      Endpoint wsEndpoint = Endpoint::fromURL(wsURL);
+      wsEndpoint.verifyTLS = (tlsVerify != nullptr && std::string(tlsVerify) == "1");
+      API::startWebSocket(wsEndpoint);
+    }
+  } catch (std::exception const& e) {
+    Utils::logToDebug(std::string("Invalid WebSocket endpoint: ") + e.what());
+  }
+
+  // Optionally expose metrics at http://127.0.0.1:<port>/metrics and/or dump them to a file on exit
+  const char* metricsPort = std::getenv("AVME_METRICS_PORT");
+  const char* metricsFile = std::getenv("AVME_METRICS_FILE");
+  if (metricsPort != nullptr) MetricsServer::start(std::atoi(metricsPort));
+  int ret = app.exec();
+  if (metricsFile != nullptr) Metrics::writeToFile(metricsFile);
+  MetricsServer::stop();
+  API::stopWebSocket();
+  return ret;
 }
 
@@ -49,6 +49,7 @@ Q_IMPORT_PLUGIN(QtChartsQml2Plugin)
 #include <core/Utils.h>
 #include <core/Wallet.h>
 #include <network/Graph.h>
+#include <network/MetricsServer.h>
 #include <network/Pangolin.h>
 #include <network/Staking.h>
 
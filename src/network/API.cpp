@@ -2,86 +2,145 @@
 // Distributed under the MIT/X11 software license, see the accompanying
 // file LICENSE or http://www.opensource.org/licenses/mit-license.php.
 #include "API.h"
+#include "FeeOracle.h"
 
 #ifdef TESTNET
-std::string API::host = "testnet-api.avme.io";
-std::string API::port = "443";
+Endpoint API::endpoint = Endpoint::fromURL("https://testnet-api.avme.io/");
 #else
-std::string API::host = "api.avme.io";
-std::string API::port = "443";
+Endpoint API::endpoint = Endpoint::fromURL("https://api.avme.io/");
 #endif
+std::mutex API::endpointLock;
+std::shared_ptr<WsClient> API::ws;
+const std::string API::outcomeUnknown = "Transaction outcome unknown";
+
+bool API::isOutcomeUnknown(const std::string& error) {
+  return (error.compare(0, outcomeUnknown.size(), outcomeUnknown) == 0);
+}
+
+// Answer each request in a body with an outcomeUnknown error, keeping their ids.
+static std::string outcomeUnknownAnswer(const std::string& reqBody) {
+  auto answer = [](const json& req) {
+    json ans;
+    ans["jsonrpc"] = "2.0";
+    ans["id"] = req.contains("id") ? req["id"] : json();
+    ans["error"] = {{"code", -32000}, {"message", API::outcomeUnknown}};
+    return ans;
+  };
+  try {
+    json req = json::parse(reqBody);
+    if (!req.is_array()) return answer(req).dump();
+    json ret = json::array();
+    for (const json& r : req) ret.push_back(answer(r));
+    return ret.dump();
+  } catch (std::exception const& e) {
+    return "";
+  }
+}
+
+Endpoint API::getEndpoint() {
+  std::lock_guard<std::mutex> lock(endpointLock);
+  return endpoint;
+}
+
+void API::setEndpoint(Endpoint newEndpoint) {
+  std::lock_guard<std::mutex> lock(endpointLock);
+  endpoint = newEndpoint;
+}
+
+void API::startWebSocket(Endpoint wsEndpoint) {
+  std::shared_ptr<WsClient> newWs = std::make_shared<WsClient>(wsEndpoint);
+  std::lock_guard<std::mutex> lock(endpointLock);
+  ws = newWs;
+}
+
+void API::stopWebSocket() {
+  std::shared_ptr<WsClient> oldWs;
+  {
+    std::lock_guard<std::mutex> lock(endpointLock);
+    oldWs.swap(ws);
+  }
+  // Destroyed (and disconnected) here unless a request still holds it
+}
+
+std::shared_ptr<WsClient> API::getWebSocket() {
+  std::lock_guard<std::mutex> lock(endpointLock);
+  return ws;
+}
+
+// Get the latency histogram of a JSON-RPC method. Handles are cached per thread,
+// so the registry's lock is only taken the first time a thread sees a method.
+static Metrics::Histogram& methodHistogram(const std::string& method) {
+  thread_local std::map<std::string, Metrics::Histogram*> handles;
+  Metrics::Histogram*& h = handles[method];
+  if (h == nullptr) h = &Metrics::histogram("avme_api_request_seconds", "method=\"" + method + "\"");
+  return *h;
+}
 
 std::string API::httpGetRequest(std::string reqBody) {
   std::string result = "";
-  using tcp = boost::asio::ip::tcp;       // from <boost/asio/ip/tcp.hpp>
-  namespace ssl = boost::asio::ssl;       // from <boost/asio/ssl.hpp>
-  namespace http = boost::beast::http;    // from <boost/beast/http.hpp>
 
-  std::string RequestID = Utils::randomHexBytes();
+  std::string RequestID = Utils::newRequestID();
+  std::string method = API::requestMethod(reqBody);
+  Metrics::Timer timer(methodHistogram(method));
+  static Metrics::Gauge& inFlight = Metrics::gauge("avme_api_requests_in_flight");
+  inFlight.add(1);
   //std::cout << "REQUEST BODY: \n" << reqBody << std::endl;  // Uncomment for debugging
-  Utils::logToDebug("API Request ID " + RequestID + " : " + reqBody);
+  if (Logger::enabled(Logger::Level::Debug)) {
+    Logger::log(Logger::Level::Debug, "API Request ID " + RequestID + " : " + reqBody);
+  }
+
+  // Use the WebSocket if it's up, a failed call there falls back to HTTP
+  std::shared_ptr<WsClient> wsClient = API::getWebSocket();
+  if (wsClient != nullptr && wsClient->isConnected()) {
+    result = wsClient->call(reqBody);
+    if (!result.empty()) {
+      if (Logger::enabled(Logger::Level::Debug)) {
+        Logger::log(Logger::Level::Debug, "API Result ID " + RequestID + " (ws) : " + result);
+      }
+      inFlight.add(-1);
+      return result;
+    }
+    // A timeout doesn't mean the node didn't get the transactions, so they aren't sent twice
+    if (reqBody.find("\"eth_sendRawTransaction\"") != std::string::npos) {
+      Logger::log(Logger::Level::Error, "API ID " + RequestID + " ERROR: no answer to broadcast, not resending");
+      Metrics::counter("avme_api_request_errors_total", "method=\"" + method + "\"").inc();
+      inFlight.add(-1);
+      return outcomeUnknownAnswer(reqBody);
+    }
+  }
 
   try {
-    // Create context and load certificates into it
-    boost::asio::io_context ioc;
-    ssl::context ctx{ssl::context::sslv23_client};
-    load_root_certificates(ctx);
-
-    tcp::resolver resolver{ioc};
-    ssl::stream<tcp::socket> stream{ioc, ctx};
-
-    // Set SNI Hostname (many hosts need this to handshake successfully)
-    if (!SSL_set_tlsext_host_name(stream.native_handle(), API::host.c_str())) {
-      boost::system::error_code ec{static_cast<int>(::ERR_get_error()), boost::asio::error::get_ssl_category()};
-      throw boost::system::system_error{ec};
+    result = HttpClient::post(API::getEndpoint(), reqBody);
+    if (Logger::enabled(Logger::Level::Debug)) {
+      Logger::log(Logger::Level::Debug, "API Result ID " + RequestID + " : " + result);
     }
-    auto const results = resolver.resolve(API::host, API::port);
-
-    // Connect and Handshake
-    boost::asio::connect(stream.next_layer(), results.begin(), results.end());
-    stream.handshake(ssl::stream_base::client);
-
-    // Set up an HTTP GET request message
-    http::request<http::string_body> req{http::verb::post, "/", 11};
-    req.set(http::field::host, API::host);
-    req.set(http::field::user_agent, BOOST_BEAST_VERSION_STRING);
-    req.set(http::field::content_type, "application/json");
-    req.body() = reqBody;
-    req.prepare_payload();
-
-    // Send the HTTP request to the remote host
-    http::write(stream, req);
-    boost::beast::flat_buffer buffer;
-
-    // Declare a container to hold the response
-    http::response<http::dynamic_body> res;
-
-    // Receive the HTTP response
-    http::read(stream, buffer, res);
-
-    // Write only the body answer to output
-    std::string body { boost::asio::buffers_begin(res.body().data()),boost::asio::buffers_end(res.body().data()) };
-    result = body;
-    Utils::logToDebug("API Result ID " + RequestID + " : " + result);
     //std::cout << "REQUEST RESULT: \n" << result << std::endl; // Uncomment for debugging
-
-    boost::system::error_code ec;
-    stream.shutdown(ec);
-
-    // SSL Connections return stream_truncated when closed.
-    // For that reason, we need to treat this as an error.
-    if (ec == boost::asio::error::eof || boost::asio::ssl::error::stream_truncated)
-      ec.assign(0, ec.category());
-    if (ec)
-      throw boost::system::system_error{ec};
   } catch (std::exception const& e) {
-    Utils::logToDebug("API ID " + RequestID + " ERROR:" + e.what());
+    Logger::log(Logger::Level::Error, "API ID " + RequestID + " ERROR:" + e.what());
+    Metrics::counter("avme_api_request_errors_total", "method=\"" + method + "\"").inc();
+    inFlight.add(-1);
+    // The body may have reached the node before the error, same as over the WebSocket
+    if (reqBody.find("\"eth_sendRawTransaction\"") != std::string::npos) {
+      return outcomeUnknownAnswer(reqBody);
+    }
     return "";
   }
 
+  inFlight.add(-1);
   return result;
 }
 
+std::string API::requestMethod(const std::string& reqBody) {
+  if (!reqBody.empty() && reqBody[0] == '[') return "batch";
+  static const std::string key = "\"method\":\"";
+  std::size_t begin = reqBody.find(key);
+  if (begin == std::string::npos) return "unknown";
+  begin += key.size();
+  std::size_t end = reqBody.find('"', begin);
+  if (end == std::string::npos) return "unknown";
+  return reqBody.substr(begin, end - begin);
+}
+
 void API::httpGetFile(std::string host, std::string get, std::string target) {
   using boost::asio::ip::tcp;
   namespace ssl = boost::asio::ssl;
@@ -96,7 +155,7 @@ void API::httpGetFile(std::string host, std::string get, std::string target) {
   boost::asio::io_context io_context;
   ssl_socket socket(io_context, ctx);
   tcp::resolver resolver(io_context);
-  tcp::resolver::query query(host, API::port);
+  tcp::resolver::query query(host, "443");
   boost::asio::connect(socket.lowest_layer(), resolver.resolve(query));
   socket.lowest_layer().set_option(tcp::no_delay(true));
 
@@ -178,17 +237,64 @@ std::string API::buildMultiRequest(std::vector<Request> reqs) {
   return reqStr;
 }
 
-std::string API::broadcastTx(std::string txidHex) {
+std::string API::broadcastTx(std::string txidHex, std::string* error) {
   Request req{1, "2.0", "eth_sendRawTransaction", {"0x" + txidHex}};
   std::string query = buildRequest(req);
   std::string resp = httpGetRequest(query);
-  json respJson = json::parse(resp);
-  return respJson["result"].get<std::string>();
+  std::string errorMsg = "Connection failure";
+  try {
+    json respJson = json::parse(resp);
+    if (respJson.contains("result") && respJson["result"].is_string()) {
+      return respJson["result"].get<std::string>();
+    }
+    if (respJson.contains("error") && respJson["error"].contains("message")) {
+      errorMsg = respJson["error"]["message"].get<std::string>();
+    }
+  } catch (std::exception const& e) {}
+  Utils::logToDebug("Transaction broadcast failed: " + errorMsg);
+  if (error != nullptr) *error = errorMsg;
+  return "";
 }
 
-// TODO: migrate to QmlApi when dynamic fees are implemented
-std::string API::getAutomaticFee() {
-  return "225"; // AVAX fees are fixed
+std::vector<std::string> API::broadcastTxs(
+  const std::vector<std::string>& txidHexes, std::vector<std::string>* errors
+) {
+  std::vector<std::string> ret(txidHexes.size());
+  std::vector<std::string> errs(txidHexes.size(), "Connection failure");
+  std::vector<Request> reqs;
+  for (size_t i = 0; i < txidHexes.size(); i++) {
+    reqs.push_back({i + 1, "2.0", "eth_sendRawTransaction", {"0x" + txidHexes[i]}});
+  }
+  std::string resp = (reqs.empty()) ? "[]" : httpGetRequest(buildMultiRequest(reqs));
+  try {
+    // Batch answers may come in any order, so match them by id
+    json respArr = json::parse(resp);
+    for (const json& r : respArr) {
+      if (!r.contains("id") || !r["id"].is_number()) continue;
+      uint64_t id = r["id"].get<uint64_t>();
+      if (id < 1 || id > txidHexes.size()) continue;
+      if (r.contains("result") && r["result"].is_string()) {
+        ret[id - 1] = r["result"].get<std::string>();
+      } else if (r.contains("error") && r["error"].contains("message")) {
+        errs[id - 1] = r["error"]["message"].get<std::string>();
+      }
+    }
+  } catch (std::exception const& e) {}
+  for (size_t i = 0; i < ret.size(); i++) {
+    if (ret[i].empty()) {
+      Utils::logToDebug("Transaction broadcast failed: " + errs[i]);
+    } else {
+      errs[i] = "";
+    }
+  }
+  if (errors != nullptr) *errors = errs;
+  return ret;
+}
+
+std::string API::getAutomaticFee(std::string speed) {
+  u256 gasPrice = FeeOracle::suggest(FeeOracle::speedFromString(speed)).gasPrice;
+  u256 gwei = raiseToPow(10, 9);
+  return boost::lexical_cast<std::string>((gasPrice + gwei - 1) / gwei);
 }
 
 std::string API::getNonce(std::string address) {
@@ -215,6 +321,33 @@ std::string API::getTxStatus(std::string txidHex) {
   return respJson["result"]["status"].get<std::string>();
 }
 
+std::vector<json> API::getTxReceipts(
+  const std::vector<std::string>& txidHexes, std::vector<bool>* answered
+) {
+  std::vector<json> ret(txidHexes.size());
+  if (answered != nullptr) answered->assign(txidHexes.size(), false);
+  if (txidHexes.empty()) return ret;
+  std::vector<Request> reqs;
+  for (size_t i = 0; i < txidHexes.size(); i++) {
+    reqs.push_back({i + 1, "2.0", "eth_getTransactionReceipt", {"0x" + txidHexes[i]}});
+  }
+  std::string resp = httpGetRequest(buildMultiRequest(reqs));
+  try {
+    json respArr = json::parse(resp);
+    for (const json& r : respArr) {
+      // Errored entries carry "error" instead of "result", and count as unanswered
+      if (!r.contains("id") || !r["id"].is_number() || !r.contains("result")) continue;
+      uint64_t id = r["id"].get<uint64_t>();
+      if (id < 1 || id > txidHexes.size()) continue;
+      ret[id - 1] = r["result"];
+      if (answered != nullptr) (*answered)[id - 1] = true;
+    }
+  } catch (std::exception const& e) {
+    Utils::logToDebug(std::string("Error when fetching receipts: ") + e.what());
+  }
+  return ret;
+}
+
 std::string API::getTxBlock(std::string txidHex) {
   Request req{1, "2.0", "eth_getTransactionReceipt", {"0x" + txidHex}};
   std::string query = buildRequest(req);
@@ -7,6 +7,7 @@
 #include <cstdlib>
 #include <iostream>
 #include <string>
+#include <vector>
 
 #include <boost/asio.hpp>
 #include <boost/asio/ssl.hpp>
@@ -15,6 +16,8 @@
 #include <boost/beast/version.hpp>
 
 #include <core/Utils.h>
+#include <network/HttpClient.h>
+#include <network/WsClient.h>
 #include <network/Pangolin.h>
 #include <network/root_certificates.hpp>
 #include <lib/nlohmann_json/json.hpp>
@@ -36,17 +39,63 @@ typedef struct Request {
  */
 class API {
   private:
-    // Strings for the API's host and port, respectively.
-    static std::string host;
-    static std::string port;
+    // The API's endpoint (host, port, target and TLS settings), and its mutex.
+    static Endpoint endpoint;
+    static std::mutex endpointLock;
+
+    // Optional WebSocket transport, used instead of HTTP while it's connected.
+    static std::shared_ptr<WsClient> ws;
 
   public:
     /**
-     * Send an HTTP GET Request to the API.
+     * Error message for a broadcast that was sent but never answered (e.g.
+     * the WebSocket dropped), so the node may or may not have the transaction.
+     * Sending it again isn't safe, the caller has to check its hash instead.
+     */
+    static const std::string outcomeUnknown;
+
+    /**
+     * Check if a broadcast error is an outcomeUnknown one.
+     */
+    static bool isOutcomeUnknown(const std::string& error);
+
+    /**
+     * Get/set the API's endpoint at runtime (e.g. to point it to a local stub server).
+     * Returns a copy of the current endpoint.
+     */
+    static Endpoint getEndpoint();
+    static void setEndpoint(Endpoint newEndpoint);
+
+    /**
+     * Start/stop the WebSocket transport (e.g. "wss://node.example/ws").
+     * While it's connected, requests go through it instead of a new HTTP
+     * connection each, and subscriptions (eth_subscribe) become available.
+     * Requests fall back to HTTP whenever it's down, except transaction
+     * broadcasts that may have reached the node already (see outcomeUnknown).
+     */
+    static void startWebSocket(Endpoint wsEndpoint);
+    static void stopWebSocket();
+
+    /**
+     * Get the WebSocket transport, for subscriptions.
+     * Returns a pointer to it, or nullptr if it wasn't started.
+     */
+    static std::shared_ptr<WsClient> getWebSocket();
+
+    /**
+     * Send an HTTP GET Request to the API (through the WebSocket if it's connected).
      * Returns the requested pure JSON data, or an empty string at connection failure.
+     * A failed eth_sendRawTransaction call on the WebSocket isn't resent over
+     * HTTP, it's answered with an outcomeUnknown error for each transaction.
      */
     static std::string httpGetRequest(std::string reqBody);
 
+    /**
+     * Get the JSON-RPC method of a request body, used to label metrics.
+     * Returns the method name, "batch" for multi-requests or "unknown".
+     */
+    static std::string requestMethod(const std::string& reqBody);
+
     /**
      * Downloads a file from a given host URL and a given path (e.g. "/file.txt")
      * to a given target path in the filesystem.
@@ -62,16 +111,29 @@ class API {
 
     /**
      * Broadcast a signed transaction to the blockchain.
-     * Returns a link to the successful transaction, or an empty string on failure.
+     * If given, error is set to the node's error message on failure.
+     * Returns the transaction hash, or an empty string on failure.
      */
-    static std::string broadcastTx(std::string txidHex);
+    static std::string broadcastTx(std::string txidHex, std::string* error = nullptr);
 
     /**
-     * Get the recommended gas price for a transaction.
-     * Returns the gas price in Gwei, which has to be converted to Wei
-     * when building a transaction (1 Gwei = 10^9 Wei).
+     * Broadcast many signed transactions in one batch request.
+     * If given, errors is set to the node's error message for each
+     * transaction (empty for the ones that were accepted).
+     * Returns the transaction hashes in the same order, with an empty
+     * string for each transaction that failed.
      */
-    static std::string getAutomaticFee();
+    static std::vector<std::string> broadcastTxs(
+      const std::vector<std::string>& txidHexes, std::vector<std::string>* errors = nullptr
+    );
+
+    /**
+     * Get the recommended gas price for a transaction, from the fee oracle,
+     * for a given speed ("slow", "normal" or "fast").
+     * Returns the gas price in Gwei (rounded up), which has to be converted
+     * to Wei when building a transaction (1 Gwei = 10^9 Wei).
+     */
+    static std::string getAutomaticFee(std::string speed = "normal");
 
     /**
      * Get the highest available nonce for an address from the blockchain API.
@@ -92,6 +154,17 @@ class API {
      */
     static std::string getTxStatus(std::string txidHex);
 
+    /**
+     * Get the receipts of many transactions in one batch request.
+     * Returns the receipts in the same order, null for transactions
+     * that weren't mined yet or couldn't be fetched.
+     * If given, #answered tells which ones the node actually answered,
+     * so "not mined" (true) can be told apart from "couldn't fetch" (false).
+     */
+    static std::vector<json> getTxReceipts(
+      const std::vector<std::string>& txidHexes, std::vector<bool>* answered = nullptr
+    );
+
     /**
      * Get the block number for the given transaction.
      * Returns the number.
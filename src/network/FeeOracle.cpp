@@ -0,0 +1,175 @@
+// Copyright (c) 2020-2021 AVME Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+#include "FeeOracle.h"
+
+FeeEstimate FeeOracle::cached;
+bool FeeOracle::hasCached = false;
+std::chrono::steady_clock::time_point FeeOracle::fetchedAt;
+u256 FeeOracle::head = 0;
+bool FeeOracle::pushed = false;
+std::mutex FeeOracle::lock;
+std::mutex FeeOracle::fetchLock;
+unsigned FeeOracle::historyBlocks = 20;
+std::vector<double> FeeOracle::percentiles = {10, 50, 90};
+std::chrono::milliseconds FeeOracle::maxAge(2000);
+u256 FeeOracle::fallbackGasPrice = u256(225) * raiseToPow(10, 9); // The old fixed AVAX fee
+
+// Median of a list of values, 0 if it's empty.
+static u256 median(std::vector<u256> values) {
+  if (values.empty()) return 0;
+  std::sort(values.begin(), values.end());
+  return values[values.size() / 2];
+}
+
+// Value of a hex quantity from a JSON-RPC answer.
+static u256 hexToU256(const json& value) {
+  return boost::lexical_cast<HexTo<u256>>(value.get<std::string>());
+}
+
+bool FeeOracle::fetch(FeeEstimate& estimate) {
+  std::vector<Request> reqs;
+  reqs.push_back({1, "2.0", "eth_feeHistory", {historyBlocks, "latest", percentiles}});
+  reqs.push_back({2, "2.0", "eth_gasPrice", json::array()});
+  std::string resp = API::httpGetRequest(API::buildMultiRequest(reqs));
+  if (resp.empty()) return false;
+
+  json history;
+  u256 gasPrice = 0;
+  try {
+    // Batch answers may come in any order, so match them by id
+    json respArr = json::parse(resp);
+    if (!respArr.is_array()) throw std::runtime_error("not a batch response");
+    for (const json& r : respArr) {
+      if (!r.contains("id") || !r["id"].is_number() || !r.contains("result")) continue;
+      uint64_t id = r["id"].get<uint64_t>();
+      if (id == 1 && r["result"].is_object()) {
+        history = r["result"];
+      } else if (id == 2 && r["result"].is_string()) {
+        gasPrice = hexToU256(r["result"]);
+      }
+    }
+  } catch (std::exception const& e) {
+    Utils::logToDebug(std::string("Fee estimate failed: ") + e.what());
+    return false;
+  }
+
+  // Nodes (or chains) without EIP-1559 only have eth_gasPrice
+  if (!history.contains("baseFeePerGas") || !history["baseFeePerGas"].is_array()
+    || history["baseFeePerGas"].size() < 2 || !history.contains("reward")
+    || !history["reward"].is_array() || !history.contains("oldestBlock")
+  ) {
+    if (gasPrice == 0) return false;
+    estimate.eip1559 = false;
+    estimate.block = head;
+    estimate.baseFee = 0;
+    estimate.slow = {gasPrice, gasPrice, gasPrice};
+    estimate.normal = estimate.slow;
+    u256 fastPrice = gasPrice * 5 / 4;
+    estimate.fast = {fastPrice, fastPrice, fastPrice};
+    return true;
+  }
+
+  try {
+    const json& baseFees = history["baseFeePerGas"];
+    const json& rewards = history["reward"];
+    const json& ratios = history["gasUsedRatio"];
+    u256 oldest = hexToU256(history["oldestBlock"]);
+    // The last base fee is the one of the block after the newest in the range
+    estimate.eip1559 = true;
+    estimate.baseFee = hexToU256(baseFees.back());
+    estimate.block = oldest + (baseFees.size() - 1) - 1;
+
+    // Empty blocks report zero rewards, so they're left out of the samples
+    std::vector<std::vector<u256>> samples(3);
+    for (size_t i = 0; i < rewards.size(); i++) {
+      if (ratios.is_array() && i < ratios.size() && ratios[i].is_number() && ratios[i].get<double>() == 0) continue;
+      for (size_t k = 0; k < 3 && k < rewards[i].size(); k++) {
+        samples[k].push_back(hexToU256(rewards[i][k]));
+      }
+    }
+    u256 tips[3];
+    for (size_t k = 0; k < 3; k++) tips[k] = median(samples[k]);
+    if (samples[1].empty() && gasPrice > estimate.baseFee) tips[1] = gasPrice - estimate.baseFee;
+    tips[1] = std::max(tips[1], tips[0]);
+    tips[2] = std::max(tips[2], tips[1]);
+
+    /**
+     * The base fee can go up by 12.5% per full block, so twice its current
+     * value covers a few blocks in a row. Only base fee + tip is actually
+     * paid, the rest is refunded. Legacy transactions pay their whole gas
+     * price, so they get base fee + tip, and never less than the node's
+     * own suggestion for normal and fast.
+     */
+    FeeSuggestion* suggestions[3] = {&estimate.slow, &estimate.normal, &estimate.fast};
+    for (size_t k = 0; k < 3; k++) {
+      suggestions[k]->maxPriorityFeePerGas = tips[k];
+      suggestions[k]->maxFeePerGas = estimate.baseFee * 2 + tips[k];
+      suggestions[k]->gasPrice = estimate.baseFee + tips[k];
+      if (k > 0) suggestions[k]->gasPrice = std::max(suggestions[k]->gasPrice, gasPrice);
+    }
+  } catch (std::exception const& e) {
+    Utils::logToDebug(std::string("Fee estimate failed: ") + e.what());
+    return false;
+  }
+  return true;
+}
+
+FeeEstimate FeeOracle::getEstimate() {
+  auto isFresh = [](){
+    // While blocks are pushed the estimate lasts until the next one, otherwise for maxAge
+    std::shared_ptr<WsClient> ws = API::getWebSocket();
+    bool pushing = (pushed && ws != nullptr && ws->isConnected());
+    return (hasCached && head <= cached.block
+      && (pushing || std::chrono::steady_clock::now() - fetchedAt < maxAge));
+  };
+  {
+    std::lock_guard<std::mutex> lk(lock);
+    if (isFresh()) return cached;
+  }
+
+  // Only one request at a time, the others get its result
+  std::lock_guard<std::mutex> fetchLk(fetchLock);
+  {
+    std::lock_guard<std::mutex> lk(lock);
+    if (isFresh()) return cached;
+  }
+  static Metrics::Counter& fetches = Metrics::counter("avme_fee_oracle_fetches_total");
+  fetches.inc();
+  FeeEstimate estimate;
+  bool ok = fetch(estimate);
+
+  std::lock_guard<std::mutex> lk(lock);
+  if (!ok) {
+    // Keep using the last estimate, or the old fixed fee if there's none
+    if (hasCached) return cached;
+    FeeSuggestion fallback = {fallbackGasPrice, fallbackGasPrice, fallbackGasPrice};
+    return {head, 0, false, fallback, fallback, fallback};
+  }
+  cached = estimate;
+  hasCached = true;
+  fetchedAt = std::chrono::steady_clock::now();
+  if (estimate.block > head) head = estimate.block;
+  return cached;
+}
+
+FeeSuggestion FeeOracle::suggest(FeeSpeed speed) {
+  FeeEstimate estimate = getEstimate();
+  switch (speed) {
+    case FeeSpeed::Slow: return estimate.slow;
+    case FeeSpeed::Fast: return estimate.fast;
+    default: return estimate.normal;
+  }
+}
+
+void FeeOracle::notifyBlock(const u256& number) {
+  std::lock_guard<std::mutex> lk(lock);
+  pushed = true;
+  if (number > head) head = number;
+}
+
+FeeSpeed FeeOracle::speedFromString(const std::string& speed) {
+  if (speed == "slow") return FeeSpeed::Slow;
+  if (speed == "fast") return FeeSpeed::Fast;
+  return FeeSpeed::Normal;
+}
@@ -0,0 +1,97 @@
+// Copyright (c) 2020-2021 AVME Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+#ifndef FEEORACLE_H
+#define FEEORACLE_H
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <core/Utils.h>
+#include <network/API.h>
+
+// How soon a transaction should be included.
+enum class FeeSpeed { Slow = 0, Normal = 1, Fast = 2 };
+
+// Suggested fees for a transaction, in Wei.
+typedef struct FeeSuggestion {
+  u256 maxFeePerGas;          // EIP-1559 cap per gas, base fee included
+  u256 maxPriorityFeePerGas;  // EIP-1559 tip per gas
+  u256 gasPrice;              // Price per gas for legacy transactions
+} FeeSuggestion;
+
+// Fee suggestions for the block after a given one.
+typedef struct FeeEstimate {
+  u256 block;                 // Newest block the estimate is based on
+  u256 baseFee;               // Base fee of the next block (0 if not EIP-1559)
+  bool eip1559;               // Whether the chain supports EIP-1559 transactions
+  FeeSuggestion slow;
+  FeeSuggestion normal;
+  FeeSuggestion fast;
+} FeeEstimate;
+
+/**
+ * Fee oracle, sampling the priority fees paid in recent blocks.
+ * One batch request gets eth_feeHistory (with the rewardPercentiles for
+ * slow, normal and fast) and eth_gasPrice, and the result is cached for
+ * the block it was based on. It's fetched again once a newer block is
+ * reported through notifyBlock() or, without a push source, once it's
+ * older than maxAge. Nodes without eth_feeHistory fall back to
+ * eth_gasPrice (legacy transactions only).
+ */
+class FeeOracle {
+  private:
+    // Cached estimate, when it was fetched, the latest block known and whether blocks are pushed.
+    static FeeEstimate cached;
+    static bool hasCached;
+    static std::chrono::steady_clock::time_point fetchedAt;
+    static u256 head;
+    static bool pushed;
+
+    // Guards the cache, and keeps fetches to one at a time, respectively.
+    static std::mutex lock;
+    static std::mutex fetchLock;
+
+    // Fetch a new estimate from the node. Returns false on failure.
+    static bool fetch(FeeEstimate& estimate);
+
+  public:
+    // Number of past blocks sampled by eth_feeHistory.
+    static unsigned historyBlocks;
+
+    // Percentiles of the priority fees paid for slow, normal and fast suggestions.
+    static std::vector<double> percentiles;
+
+    // How long an estimate is used while no new blocks are reported.
+    static std::chrono::milliseconds maxAge;
+
+    // Gas price used when the node can't be reached and nothing is cached.
+    static u256 fallbackGasPrice;
+
+    /**
+     * Get the current fee estimate, from the cache if it's still fresh.
+     */
+    static FeeEstimate getEstimate();
+
+    /**
+     * Get the suggested fees for a given speed.
+     */
+    static FeeSuggestion suggest(FeeSpeed speed);
+
+    /**
+     * Report a new chain head from a push source (e.g. a newHeads subscription),
+     * so the cache is only refreshed when a block comes in.
+     */
+    static void notifyBlock(const u256& number);
+
+    /**
+     * Parse a speed name ("slow", "normal" or "fast").
+     * Returns the speed, or FeeSpeed::Normal if the name is unknown.
+     */
+    static FeeSpeed speedFromString(const std::string& speed);
+};
+
+#endif // FEEORACLE_H
@@ -0,0 +1,154 @@
+// Copyright (c) 2020-2021 AVME Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+#include "GasEstimator.h"
+
+std::map<std::string, GasEstimator::Entry> GasEstimator::cache;
+u256 GasEstimator::head = 0;
+bool GasEstimator::pushed = false;
+std::mutex GasEstimator::lock;
+double GasEstimator::safetyMargin = 0.2;
+unsigned GasEstimator::ttlBlocks = 5;
+std::chrono::milliseconds GasEstimator::blockTime(2000);
+size_t GasEstimator::maxEntries = 256;
+
+// Gas used by a plain coin transfer, which doesn't need a margin.
+static const u256 transferGas = 21000;
+
+std::string GasEstimator::cacheKey(const GasQuery& query) {
+  std::string data = query.data;
+  if (data.substr(0, 2) == "0x") data = data.substr(2);
+  std::string value = query.value;
+  if (value.substr(0, 2) == "0x") value = value.substr(2);
+  bool hasValue = (value.find_first_not_of('0') != std::string::npos);
+
+  // The exact calldata, as any argument can pick a different code path or
+  // storage slot (e.g. a transfer to a fresh holder costs 15k more gas)
+  std::string key = query.from + "|" + query.to + "|" + data + "|" + (hasValue ? "v" : "");
+  std::transform(key.begin(), key.end(), key.begin(), ::tolower);
+  return key;
+}
+
+bool GasEstimator::isFresh(const Entry& entry) {
+  std::shared_ptr<WsClient> ws = API::getWebSocket();
+  if (pushed && ws != nullptr && ws->isConnected()) return (head < entry.block + ttlBlocks);
+  return (std::chrono::steady_clock::now() - entry.at < blockTime * ttlBlocks);
+}
+
+std::vector<u256> GasEstimator::estimate(
+  const std::vector<GasQuery>& queries, std::vector<std::string>* errors
+) {
+  std::vector<u256> ret(queries.size(), 0);
+  std::vector<std::string> errs(queries.size());
+  std::vector<std::string> keys;
+  for (const GasQuery& query : queries) keys.push_back(cacheKey(query));
+
+  // Transactions with the same key are only estimated once
+  std::map<std::string, size_t> missing;
+  {
+    std::lock_guard<std::mutex> lk(lock);
+    for (size_t i = 0; i < queries.size(); i++) {
+      auto it = cache.find(keys[i]);
+      if (it != cache.end() && isFresh(it->second)) {
+        ret[i] = it->second.gas;
+      } else if (!missing.count(keys[i])) {
+        missing[keys[i]] = i;
+      }
+    }
+  }
+  static Metrics::Counter& hits = Metrics::counter("avme_gas_estimate_cache_total", "result=\"hit\"");
+  static Metrics::Counter& misses = Metrics::counter("avme_gas_estimate_cache_total", "result=\"miss\"");
+  hits.inc(queries.size() - missing.size());
+  misses.inc(missing.size());
+  if (missing.empty()) {
+    if (errors != nullptr) *errors = errs;
+    return ret;
+  }
+
+  // All missing estimates and the current block in one request
+  std::vector<Request> reqs;
+  std::vector<size_t> reqIndexes;
+  reqs.push_back({1, "2.0", "eth_blockNumber", json::array()});
+  for (const std::pair<const std::string, size_t>& p : missing) {
+    const GasQuery& query = queries[p.second];
+    json params;
+    params["from"] = query.from;
+    params["to"] = query.to;
+    if (!query.value.empty()) params["value"] = query.value;
+    if (!query.data.empty()) params["data"] = query.data;
+    reqs.push_back({reqs.size() + 1, "2.0", "eth_estimateGas", {params}});
+    reqIndexes.push_back(p.second);
+  }
+  std::string resp = API::httpGetRequest(API::buildMultiRequest(reqs));
+
+  std::map<size_t, u256> estimated;
+  u256 block = 0;
+  try {
+    // Batch answers may come in any order, so match them by id
+    json respArr = json::parse(resp);
+    if (!respArr.is_array()) throw std::runtime_error("not a batch response");
+    for (const json& r : respArr) {
+      if (!r.contains("id") || !r["id"].is_number()) continue;
+      uint64_t id = r["id"].get<uint64_t>();
+      if (id < 1 || id > reqs.size()) continue;
+      bool hasResult = (r.contains("result") && r["result"].is_string());
+      if (id == 1) {
+        if (!hasResult) continue;
+        u256 number = boost::lexical_cast<HexTo<u256>>(r["result"].get<std::string>());
+        block = number;
+        continue;
+      }
+      size_t index = reqIndexes[id - 2];
+      if (hasResult) {
+        u256 gas = boost::lexical_cast<HexTo<u256>>(r["result"].get<std::string>());
+        if (gas != transferGas) {
+          // Margin in thousandths, rounded up
+          u256 margin = u256(1000 + unsigned(safetyMargin * 1000));
+          gas = (gas * margin + 999) / 1000;
+        }
+        estimated[index] = gas;
+      } else if (r.contains("error") && r["error"].contains("message")) {
+        errs[index] = r["error"]["message"].get<std::string>();
+      }
+    }
+  } catch (std::exception const& e) {
+    Utils::logToDebug(std::string("Gas estimation failed: ") + e.what());
+  }
+
+  std::lock_guard<std::mutex> lk(lock);
+  if (block > head) head = block;
+  if (cache.size() + estimated.size() > maxEntries) {
+    for (auto it = cache.begin(); it != cache.end();) {
+      if (isFresh(it->second)) ++it; else it = cache.erase(it);
+    }
+    if (cache.size() + estimated.size() > maxEntries) cache.clear();
+  }
+  auto now = std::chrono::steady_clock::now();
+  for (const std::pair<const size_t, u256>& p : estimated) {
+    cache[keys[p.first]] = {p.second, head, now};
+  }
+  for (size_t i = 0; i < queries.size(); i++) {
+    if (ret[i] != 0) continue;
+    size_t index = missing[keys[i]];
+    auto it = estimated.find(index);
+    if (it != estimated.end()) {
+      ret[i] = it->second;
+    } else {
+      errs[i] = errs[index].empty() ? "no answer from the node" : errs[index];
+      Utils::logToDebug("Gas estimation failed: " + errs[i]);
+    }
+  }
+  if (errors != nullptr) *errors = errs;
+  return ret;
+}
+
+void GasEstimator::notifyBlock(const u256& number) {
+  std::lock_guard<std::mutex> lk(lock);
+  pushed = true;
+  if (number > head) head = number;
+}
+
+void GasEstimator::clear() {
+  std::lock_guard<std::mutex> lk(lock);
+  cache.clear();
+}
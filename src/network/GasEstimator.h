@@ -0,0 +1,95 @@
+// Copyright (c) 2020-2021 AVME Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+#ifndef GASESTIMATOR_H
+#define GASESTIMATOR_H
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <core/Utils.h>
+#include <network/API.h>
+
+// A transaction to estimate the gas limit for.
+typedef struct GasQuery {
+  std::string from;   // Sender address
+  std::string to;     // Receiver or contract address
+  std::string value;  // Value in Wei as a hex quantity ("0x..."), empty for none
+  std::string data;   // Call data in hex ("0x..."), empty for coin transfers
+} GasQuery;
+
+/**
+ * Gas limit estimator, with a cache shared by all screens.
+ * The transactions missing from the cache are estimated with one batch
+ * request (eth_estimateGas for each, plus eth_blockNumber to date them).
+ * Results are cached by sender, receiver, exact calldata and whether any
+ * value is sent, so repeated estimates for the same call (e.g. while a
+ * screen is refreshed) don't hit the node again.
+ * Entries last for ttlBlocks blocks, counted from the blocks reported
+ * through notifyBlock() or, without a push source, from blockTime.
+ * A safety margin is added to every estimate except plain transfers,
+ * whose cost is fixed.
+ */
+class GasEstimator {
+  private:
+    // A cached estimate (margin included) and when it was made.
+    struct Entry {
+      u256 gas;
+      u256 block;
+      std::chrono::steady_clock::time_point at;
+    };
+
+    // Cache by key, the latest block known and whether blocks are pushed.
+    static std::map<std::string, Entry> cache;
+    static u256 head;
+    static bool pushed;
+    static std::mutex lock;
+
+    // Build the cache key of a transaction.
+    static std::string cacheKey(const GasQuery& query);
+
+    // Check if an entry can still be used. Must be called with lock held.
+    static bool isFresh(const Entry& entry);
+
+  public:
+    // Fraction added on top of each estimate (e.g. 0.2 = 20%).
+    static double safetyMargin;
+
+    // Number of blocks an estimate is used for.
+    static unsigned ttlBlocks;
+
+    // Average time between blocks, for the TTL while no blocks are pushed.
+    static std::chrono::milliseconds blockTime;
+
+    // Most estimates kept in the cache.
+    static size_t maxEntries;
+
+    /**
+     * Estimate the gas limits for a set of transactions, in one request
+     * for the ones that aren't cached.
+     * If given, errors is set to the node's error message for each
+     * transaction (empty for the ones that were estimated).
+     * Returns the gas limits (safety margin included) in the same order,
+     * with 0 for each transaction that couldn't be estimated
+     * (e.g. because it would revert).
+     */
+    static std::vector<u256> estimate(
+      const std::vector<GasQuery>& queries, std::vector<std::string>* errors = nullptr
+    );
+
+    /**
+     * Report a new chain head from a push source (e.g. a newHeads subscription).
+     */
+    static void notifyBlock(const u256& number);
+
+    /**
+     * Drop every cached estimate (e.g. after a contract was upgraded).
+     */
+    static void clear();
+};
+
+#endif // GASESTIMATOR_H
@@ -4,94 +4,80 @@
 #include "Graph.h"
 
 // There's no Graph API for the testnet, so we use mainnet for all purposes
-std::string Graph::host = "api.thegraph.com";
-std::string Graph::port = "443";
-std::string Graph::target = "/subgraphs/name/dasconnor/pangolin-dex";
+Endpoint Graph::endpoint = Endpoint::fromURL(
+  "https://api.thegraph.com/subgraphs/name/dasconnor/pangolin-dex"
+);
+std::mutex Graph::endpointLock;
+
+Endpoint Graph::getEndpoint() {
+  std::lock_guard<std::mutex> lock(endpointLock);
+  return endpoint;
+}
+
+void Graph::setEndpoint(Endpoint newEndpoint) {
+  std::lock_guard<std::mutex> lock(endpointLock);
+  endpoint = newEndpoint;
+}
 
 std::string Graph::httpGetRequest(std::string reqBody) {
   std::string result = "";
-  using tcp = boost::asio::ip::tcp;       // from <boost/asio/ip/tcp.hpp>
-  namespace ssl = boost::asio::ssl;       // from <boost/asio/ssl.hpp>
-  namespace http = boost::beast::http;    // from <boost/beast/http.hpp>
 
-  std::string RequestID = Utils::randomHexBytes();
+  std::string RequestID = Utils::newRequestID();
+  std::string operation = Graph::queryName(reqBody);
+  Metrics::Timer timer(Metrics::histogram("avme_graph_request_seconds", "query=\"" + operation + "\""));
   //std::cout << "REQUEST BODY: \n" << reqBody << std::endl;  // Uncomment for debugging
-  Utils::logToDebug("GRAPH Request ID " + RequestID + " : " + reqBody);
+  if (Logger::enabled(Logger::Level::Debug)) {
+    Logger::log(Logger::Level::Debug, "GRAPH Request ID " + RequestID + " : " + reqBody);
+  }
 
   try {
-    // Create context and load certificates into it
-    boost::asio::io_context ioc;
-    ssl::context ctx{ssl::context::sslv23_client};
-    load_root_certificates(ctx);
-
-    tcp::resolver resolver{ioc};
-    ssl::stream<tcp::socket> stream{ioc, ctx};
-
-    // Set SNI Hostname (many hosts need this to handshake successfully)
-    if (!SSL_set_tlsext_host_name(stream.native_handle(), Graph::host.c_str())) {
-      boost::system::error_code ec{static_cast<int>(::ERR_get_error()), boost::asio::error::get_ssl_category()};
-      throw boost::system::system_error{ec};
+    result = HttpClient::post(Graph::getEndpoint(), reqBody);
+    if (Logger::enabled(Logger::Level::Debug)) {
+      Logger::log(Logger::Level::Debug, "GRAPH Result ID " + RequestID + " : " + result);
     }
-    auto const results = resolver.resolve(Graph::host, Graph::port);
-
-    // Connect and Handshake
-    boost::asio::connect(stream.next_layer(), results.begin(), results.end());
-    stream.handshake(ssl::stream_base::client);
-
-    // Set up an HTTP GET request message
-    http::request<http::string_body> req{http::verb::post, Graph::target, 11};
-    req.set(http::field::host, Graph::host);
-    req.set(http::field::user_agent, BOOST_BEAST_VERSION_STRING);
-    req.set(http::field::content_type, "application/json");
-    req.body() = reqBody;
-    req.prepare_payload();
-
-    // Send the HTTP request to the remote host
-    http::write(stream, req);
-    boost::beast::flat_buffer buffer;
-
-    // Declare a container to hold the response
-    http::response<http::dynamic_body> res;
-
-    // Receive the HTTP response
-    http::read(stream, buffer, res);
-
-    // Write only the body answer to output
-    std::string body { boost::asio::buffers_begin(res.body().data()),boost::asio::buffers_end(res.body().data()) };
-    result = body;
-
-    Utils::logToDebug("GRAPH Result ID " + RequestID + " : " + result);
     //std::cout << "REQUEST RESULT: \n" << result << std::endl; // Uncomment for debugging
-
-    boost::system::error_code ec;
-    stream.shutdown(ec);
-
-    // SSL Connections return stream_truncated when closed.
-    // For that reason, we need to treat this as an error.
-    if (ec == boost::asio::error::eof || boost::asio::ssl::error::stream_truncated)
-      ec.assign(0, ec.category());
-    if (ec)
-      throw boost::system::system_error{ec};
   } catch (std::exception const& e) {
-    Utils::logToDebug("GRAPH ID " + RequestID + " ERROR:" + e.what());
+    Logger::log(Logger::Level::Error, "GRAPH ID " + RequestID + " ERROR:" + e.what());
+    Metrics::counter("avme_graph_request_errors_total", "query=\"" + operation + "\"").inc();
     return "";
   }
 
   return result;
 }
 
+std::string Graph::queryName(const std::string& reqBody) {
+  static const std::string key = "\"query\":\"query ";
+  std::size_t begin = reqBody.find(key);
+  if (begin == std::string::npos) return "unknown";
+  begin += key.size();
+  std::size_t end = reqBody.find_first_of("( {\"", begin);
+  if (end == std::string::npos || end == begin) return "unknown";
+  return reqBody.substr(begin, end - begin);
+}
+
+// Pair and token contracts used in the queries
+static const std::string USDT_WAVAX_PAIR = "0x9ee0a4e21bd333a6bb2ab298194320b8daa26516";
+static const std::string WAVAX_TOKEN = "0xb31f66aa3c1e785363f0875a1b74e27b85fd66c7";
+static const std::string USDT_TOKEN = "0xde3a24028580884448a5397872046a019649b084";
+static const std::string AVME_TOKEN = "0x1ecd47ff4d9598f89721a2866bfeb99505a413ed";
+
+// Selection sets shared between queries
+static const std::string PAIR_PRICE_FIELDS = "token0 { symbol } token1 { symbol } token0Price token1Price";
+static const std::string DAY_DATA_ARGS = ", orderBy: date, orderDirection: desc, where: { token: ";
+
+std::size_t Graph::maxTokensPerQuery = 25;
+std::map<std::pair<std::size_t, bool>, std::string> Graph::accountPricesQueryCache;
+std::mutex Graph::accountPricesQueryLock;
+
 /**
  * Prices are inverted, taking the WAVAX-USDT pair as an example:
  * - If token0 is WAVAX, token1Price is 1 WAVAX price in USDT
  * - If token0 is USDT, token1Price is 1 USDT price in WAVAX
  */
 std::string Graph::getAVAXPriceUSD() {
-  std::stringstream query;
-  query << "{\"query\": \"{"
-        << "pair(id: \\\"0x9ee0a4e21bd333a6bb2ab298194320b8daa26516\\\")"
-        << "{token0 {symbol} token1 {symbol} token0Price token1Price}"
-        << "}\"}";
-  std::string resp = httpGetRequest(query.str());
+  GraphQuery query("AVAXPrice");
+  query.field("", "pair", "id: " + query.var("pair", "ID!", USDT_WAVAX_PAIR), PAIR_PRICE_FIELDS);
+  std::string resp = httpGetRequest(query.body());
   json respJson = json::parse(resp);
   std::string token0Label, token1Label, token0Price, token1Price;
   token0Label = respJson["data"]["pair"]["token0"]["symbol"].get<std::string>();
@@ -110,100 +96,135 @@ std::string Graph::parseAVAXPriceUSD(json input) {
   return (token0Label == "WAVAX") ? token1Price : token0Price;
 }
 
+void Graph::addAVAXFields(GraphQuery& query, int days) {
+  // Get USD AVAX price with ID USDAVAX and put the chart data into AVAXUSDCHART.
+  query.field("USDAVAX", "pair", "id: " + query.var("pair", "ID!", USDT_WAVAX_PAIR), PAIR_PRICE_FIELDS);
+  query.field("AVAXUSDCHART", "tokenDayDatas",
+    "first: " + query.var("days", "Int!", days) + DAY_DATA_ARGS
+    + query.var("wavax", "String!", WAVAX_TOKEN) + " }",
+    "date priceUSD"
+  );
+}
+
 json Graph::avaxUSDData(int days) {
-  std::stringstream query;
-  // Get USD AVAX price with ID USDAVAX.
-  query << "{\"query\": \"{"
-      << "USDAVAX: pair(id: \\\"0x9ee0a4e21bd333a6bb2ab298194320b8daa26516\\\")"
-      << "{token0 {symbol} token1 {symbol} token0Price token1Price}"
-  // Put the chart data into AVAXUSDCHART:
-      << "AVAXUSDCHART: tokenDayDatas(first: " << days << ", orderBy: date, orderDirection: desc, where: {"
-      << "token: \\\"0xb31f66aa3c1e785363f0875a1b74e27b85fd66c7\\\""
-      << "} ) { date priceUSD } }\"}";
-  std::string resp = httpGetRequest(query.str());
+  GraphQuery query("AVAXUSDData");
+  addAVAXFields(query, days);
+  std::string resp = httpGetRequest(query.body());
   json respJson = json::parse(resp);
   return respJson;
 }
 
-// TODO: use nlohmann/json
 std::string Graph::getTokenPriceDerived(std::string address) {
-  std::stringstream query;
+  GraphQuery query("TokenPriceDerived");
   address = Utils::toLowerCaseAddress(address);
-  query << "{\"query\": \"{"
-        << "token(id: \\\"" + address + "\\\")"
-        << "{symbol derivedETH}"
-        << "}\"}";
-  std::string resp = httpGetRequest(query.str());
+  query.field("", "token", "id: " + query.var("token", "ID!", address), "symbol derivedETH");
+  std::string resp = httpGetRequest(query.body());
   json respJson = json::parse(resp);
   std::string derivedETH = respJson["data"]["token"]["derivedETH"].get<std::string>();
   return derivedETH;
 }
 
 json Graph::getTokenPriceHistory(std::string address, int days) {
-  std::stringstream query;
+  GraphQuery query("TokenPriceHistory");
   address = Utils::toLowerCaseAddress(address);
-  query << "{\"query\": \"{"
-        << "tokenDayDatas(first: " << days << ", orderBy: date, orderDirection: desc, where: {"
-        << "token: \\\"" << address << "\\\""
-        << "} ) { date priceUSD } }\"}";
-  std::string resp = httpGetRequest(query.str());
+  query.field("", "tokenDayDatas",
+    "first: " + query.var("days", "Int!", days) + DAY_DATA_ARGS
+    + query.var("token", "String!", address) + " }",
+    "date priceUSD"
+  );
+  std::string resp = httpGetRequest(query.body());
   json respJson = json::parse(resp);
   json arr = respJson["data"]["tokenDayDatas"];
   return arr;
 }
 
-// TODO: use nlohmann/json
 json Graph::getUSDTPriceHistory(int days) {
-  std::stringstream query;
-  query << "{\"query\": \"{"
-        << "tokenDayDatas(first: " << days << ", orderBy: date, orderDirection: desc, where: {"
-        << "token: \\\"0xde3a24028580884448a5397872046a019649b084\\\""
-        << "} ) { date priceUSD } }\"}";
-  std::string resp = httpGetRequest(query.str());
-  json respJson = json::parse(resp);
-  json arr = respJson["data"]["tokenDayDatas"];
-  return arr;
+  return getTokenPriceHistory(USDT_TOKEN, days);
 }
 
-// TODO: use nlohmann/json
 json Graph::getAVMEPriceHistory(int days) {
-  std::stringstream query;
-  query << "{\"query\": \"{"
-        << "tokenDayDatas(first: " << days << ", orderBy: date, orderDirection: desc, where: {"
-        << "token: \\\"0x1ecd47ff4d9598f89721a2866bfeb99505a413ed\\\""
-        << "} ) { date priceUSD } }\"}";
-  std::string resp = httpGetRequest(query.str());
-  json respJson = json::parse(resp);
-  json arr = respJson["data"]["tokenDayDatas"];
-  return arr;
+  return getTokenPriceHistory(AVME_TOKEN, days);
 }
 
-json Graph::getAccountPrices(std::vector<ARC20Token> tokenList) {
-  std::stringstream query;
-  json ret;
-  // Get USD AVAX price with ID USDAVAX.
-  query << "{\"query\": \"{"
-        << "USDAVAX: pair(id: \\\"0x9ee0a4e21bd333a6bb2ab298194320b8daa26516\\\")"
-        << "{token0 {symbol} token1 {symbol} token0Price token1Price}";
-
-  // Request USD Price for each token. Using token_contract as ID
-  for (auto token : tokenList) {
-    token.address = Utils::toLowerCaseAddress(token.address);
-    query << "token_" << token.address << ": token(id: \\\"" << token.address << "\\\")"
-    << "{symbol derivedETH}";
-    query << "chart_" << token.address << ": tokenDayDatas(first: 31, orderBy: date, orderDirection: desc, where: {";
-    query << "token: \\\"" << token.address << "\\\"" << "} ) { date priceUSD id }";
+std::string Graph::buildAccountPricesQuery(std::vector<std::string> addresses, bool withAVAX) {
+  // The query text only depends on the number of tokens and whether
+  // the AVAX fields are present, so it's built once per shape and reused.
+  std::pair<std::size_t, bool> shape = std::make_pair(addresses.size(), withAVAX);
+  json vars = json::object();
+  std::string queryText;
+  accountPricesQueryLock.lock();
+  auto it = accountPricesQueryCache.find(shape);
+  if (it != accountPricesQueryCache.end()) queryText = it->second;
+  accountPricesQueryLock.unlock();
+
+  if (queryText.empty()) {
+    // Each token adds two fields of roughly 200 bytes each
+    GraphQuery query("AccountPrices", 512 + (addresses.size() * 400));
+    if (withAVAX) addAVAXFields(query, 31);
+    for (std::size_t i = 0; i < addresses.size(); i++) {
+      std::string idx = std::to_string(i);
+      std::string tokenVar = query.var("t" + idx, "ID!", addresses[i]);
+      std::string chartVar = query.var("c" + idx, "String!", addresses[i]);
+      // Aliases are token_<address> and chart_<address>, but since they can't be
+      // variables, they're replaced by placeholders that are filled in below.
+      query.field("token_" + idx + "_", "token", "id: " + tokenVar, "symbol derivedETH");
+      query.field("chart_" + idx + "_", "tokenDayDatas", "first: 31" + DAY_DATA_ARGS + chartVar + " }", "date priceUSD id");
+    }
+    queryText = query.text();
+    vars = query.vars();
+    accountPricesQueryLock.lock();
+    accountPricesQueryCache[shape] = queryText;
+    accountPricesQueryLock.unlock();
+  } else {
+    if (withAVAX) {
+      vars["pair"] = USDT_WAVAX_PAIR;
+      vars["days"] = 31;
+      vars["wavax"] = WAVAX_TOKEN;
+    }
+    for (std::size_t i = 0; i < addresses.size(); i++) {
+      std::string idx = std::to_string(i);
+      vars["t" + idx] = addresses[i];
+      vars["c" + idx] = addresses[i];
+    }
   }
+  return GraphQuery::body(queryText, vars);
+}
 
-  // Add AVAX Price chart to the query
-  query << "AVAXUSDCHART: tokenDayDatas(first: 31, orderBy: date, orderDirection: desc, where: {"
-        << "token: \\\"0xb31f66aa3c1e785363f0875a1b74e27b85fd66c7\\\""
-        << "} ) { date priceUSD }";
+json Graph::getAccountPrices(std::vector<ARC20Token> tokenList) {
+  // Split the token list into chunks that respect the subgraph's query
+  // complexity limits. The first chunk also carries the AVAX price and chart.
+  std::vector<std::vector<std::string>> chunks(1);
+  for (ARC20Token& token : tokenList) {
+    if (chunks.back().size() >= maxTokensPerQuery) chunks.emplace_back();
+    chunks.back().push_back(Utils::toLowerCaseAddress(token.address));
+  }
 
-  // Close the query
-  query << "}\"}";
-  std::string resp = httpGetRequest(query.str());
-  ret = json::parse(resp);
+  // Fire all chunks in parallel and merge the results as they arrive
+  std::vector<std::future<std::string>> futures;
+  for (std::size_t i = 0; i < chunks.size(); i++) {
+    std::string body = buildAccountPricesQuery(chunks[i], (i == 0));
+    futures.push_back(std::async(std::launch::async, &Graph::httpGetRequest, body));
+  }
+  json ret = json::object();
+  for (std::size_t i = 0; i < futures.size(); i++) {
+    std::string resp = futures[i].get();
+    json respJson = json::parse(resp);
+    // Rename the placeholder aliases back to token_<address> and chart_<address>
+    if (respJson.contains("data") && respJson["data"].is_object()) {
+      for (std::size_t j = 0; j < chunks[i].size(); j++) {
+        std::string idx = std::to_string(j);
+        json& data = respJson["data"];
+        if (data.contains("token_" + idx + "_")) {
+          data["token_" + chunks[i][j]] = data["token_" + idx + "_"];
+          data.erase("token_" + idx + "_");
+        }
+        if (data.contains("chart_" + idx + "_")) {
+          data["chart_" + chunks[i][j]] = data["chart_" + idx + "_"];
+          data.erase("chart_" + idx + "_");
+        }
+      }
+    }
+    GraphQuery::mergeResponse(ret, respJson);
+  }
   return ret;
 }
-
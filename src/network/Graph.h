@@ -5,8 +5,12 @@
 #define GRAPH_H
 
 #include <cstdlib>
+#include <future>
 #include <iostream>
+#include <map>
+#include <mutex>
 #include <string>
+#include <vector>
 
 #include <boost/asio.hpp>
 #include <boost/asio/ssl.hpp>
@@ -15,6 +19,8 @@
 #include <boost/beast/version.hpp>
 
 #include <core/Utils.h>
+#include <network/GraphQuery.h>
+#include <network/HttpClient.h>
 #include <network/root_certificates.hpp>
 
 /**
@@ -23,12 +29,39 @@
  */
 class Graph {
   private:
-    // Strings for the API's host, port and target endpoint, respectively.
-    static std::string host;
-    static std::string port;
-    static std::string target;
+    // The Graph's endpoint (host, port, target and TLS settings), and its mutex.
+    static Endpoint endpoint;
+    static std::mutex endpointLock;
+
+    // Cached query texts for getAccountPrices, keyed by token count and
+    // whether the AVAX fields are included, and the mutex that guards them.
+    static std::map<std::pair<std::size_t, bool>, std::string> accountPricesQueryCache;
+    static std::mutex accountPricesQueryLock;
+
+    /**
+     * Add the USDAVAX price and AVAXUSDCHART fields from the last X days to a query.
+     */
+    static void addAVAXFields(GraphQuery& query, int days);
+
+    /**
+     * Build the request body for one chunk of getAccountPrices.
+     * Returns the JSON request body.
+     */
+    static std::string buildAccountPricesQuery(std::vector<std::string> addresses, bool withAVAX);
 
   public:
+    /**
+     * Get/set the Graph's endpoint at runtime (e.g. to point it to a local stub server).
+     * Returns a copy of the current endpoint.
+     */
+    static Endpoint getEndpoint();
+    static void setEndpoint(Endpoint newEndpoint);
+
+    // Maximum number of tokens in a single getAccountPrices query.
+    // Larger lists are split into parallel sub-queries to stay within
+    // the subgraph's complexity limits, and their results are merged.
+    static std::size_t maxTokensPerQuery;
+
     /**
      * Send an HTTP GET Request to the blockchain API.
      * Returns the requested pure JSON data, or an empty string at connection failure.
@@ -36,6 +69,12 @@ class Graph {
      */
     static std::string httpGetRequest(std::string reqBody);
 
+    /**
+     * Get the operation name of a query built with GraphQuery, used to label metrics.
+     * Returns the operation name, or "unknown".
+     */
+    static std::string queryName(const std::string& reqBody);
+
     /**
      * Get the CURRENT price in fiat (USD) for 1 unit (fixed point) of AVAX
      * and a given token, respectively.
@@ -45,7 +84,9 @@ class Graph {
     static json avaxUSDData(int days);
     static std::string getTokenPriceDerived(std::string address);
     /**
-     * Get the intire account prices for all both AVAX and Tokens
+     * Get the entire account prices for both AVAX and tokens.
+     * Returns a JSON object with USDAVAX, AVAXUSDCHART,
+     * token_<address> and chart_<address> inside "data".
      */
     static json getAccountPrices(std::vector<ARC20Token> tokenList);
 
@@ -0,0 +1,60 @@
+// Copyright (c) 2020-2021 AVME Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+#include "GraphQuery.h"
+
+GraphQuery::GraphQuery(std::string name, std::size_t reserveSize) : name(name) {
+  this->fields.reserve(reserveSize);
+}
+
+std::string GraphQuery::var(const std::string& key, const std::string& type, json value) {
+  if (!this->declarations.empty()) this->declarations += ", ";
+  this->declarations += "$" + key + ": " + type;
+  this->variables[key] = std::move(value);
+  return "$" + key;
+}
+
+GraphQuery& GraphQuery::field(
+  const std::string& alias, const std::string& entity,
+  const std::string& args, const std::string& selection
+) {
+  if (!alias.empty()) this->fields.append(alias).append(": ");
+  this->fields.append(entity);
+  if (!args.empty()) this->fields.append("(").append(args).append(")");
+  this->fields.append(" { ").append(selection).append(" } ");
+  return *this;
+}
+
+std::string GraphQuery::text() const {
+  std::string ret;
+  ret.reserve(this->fields.size() + this->declarations.size() + this->name.size() + 16);
+  ret += "query";
+  if (!this->name.empty()) ret += " " + this->name;
+  if (!this->declarations.empty()) ret += "(" + this->declarations + ")";
+  ret += " { ";
+  ret += this->fields;
+  ret += "}";
+  return ret;
+}
+
+std::string GraphQuery::body() const {
+  return body(this->text(), this->variables);
+}
+
+std::string GraphQuery::body(const std::string& queryText, const json& vars) {
+  json req;
+  req["query"] = queryText;
+  if (!vars.empty()) req["variables"] = vars;
+  return req.dump();
+}
+
+bool GraphQuery::mergeResponse(json& dest, const json& src) {
+  if (!src.is_object()) return false;
+  if (src.contains("errors")) {
+    for (const json& err : src["errors"]) dest["errors"].push_back(err);
+  }
+  if (!src.contains("data") || !src["data"].is_object()) return false;
+  if (!dest.contains("data") || !dest["data"].is_object()) dest["data"] = json::object();
+  dest["data"].update(src["data"]);
+  return true;
+}
@@ -0,0 +1,81 @@
+// Copyright (c) 2020-2021 AVME Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+#ifndef GRAPHQUERY_H
+#define GRAPHQUERY_H
+
+#include <string>
+#include <vector>
+
+#include <core/Utils.h>
+
+/**
+ * Small builder for GraphQL queries sent to the Graph.
+ * Aliased subqueries are appended to a single preallocated buffer and
+ * values are passed as GraphQL variables instead of being inlined, so the
+ * query text only depends on its shape and can be cached/reused as-is.
+ * The request body is serialized by nlohmann, so no manual escaping is needed.
+ */
+class GraphQuery {
+  private:
+    // Operation name, variable declarations and aliased fields, respectively.
+    std::string name;
+    std::string declarations;
+    std::string fields;
+
+    // Values for the declared variables, sent alongside the query text.
+    json variables = json::object();
+
+  public:
+    /**
+     * Constructor. reserveSize is the expected query text size in bytes,
+     * used to preallocate the field buffer.
+     */
+    GraphQuery(std::string name = "", std::size_t reserveSize = 512);
+
+    /**
+     * Declare a variable (e.g. "t0" of type "ID!") and set its value.
+     * Returns the reference to be used inside field arguments (e.g. "$t0").
+     */
+    std::string var(const std::string& key, const std::string& type, json value);
+
+    /**
+     * Add a top-level field, optionally aliased and with arguments, e.g.:
+     * field("USDAVAX", "pair", "id: $pair", "token0Price token1Price")
+     * becomes `USDAVAX: pair(id: $pair) { token0Price token1Price }`.
+     * Returns a reference to the builder for chaining.
+     */
+    GraphQuery& field(
+      const std::string& alias, const std::string& entity,
+      const std::string& args, const std::string& selection
+    );
+
+    /**
+     * Get the query text (e.g. "query Name($t0: ID!) { ... }").
+     * Returns the GraphQL query string.
+     */
+    std::string text() const;
+
+    /**
+     * Get the variable values for the query.
+     * Returns a JSON object with the variables.
+     */
+    const json& vars() const { return variables; }
+
+    /**
+     * Build the HTTP request body for the Graph, either from this builder
+     * or from a previously cached query text and its variables.
+     * Returns a JSON string in the format {"query": "...", "variables": {...}}.
+     */
+    std::string body() const;
+    static std::string body(const std::string& queryText, const json& vars);
+
+    /**
+     * Merge the "data" object (and "errors" array, if any) of a
+     * sub-query response into an accumulated response.
+     * Returns true if the sub-response had data, false otherwise.
+     */
+    static bool mergeResponse(json& dest, const json& src);
+};
+
+#endif // GRAPHQUERY_H
@@ -0,0 +1,141 @@
+// Copyright (c) 2020-2021 AVME Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+#include "HttpClient.h"
+
+Endpoint Endpoint::fromURL(const std::string& url) {
+  Endpoint ret;
+  std::string rest;
+  if (url.compare(0, 8, "https://") == 0 || url.compare(0, 6, "wss://") == 0) {
+    ret.tls = true;
+    ret.port = "443";
+    rest = url.substr(url.find("://") + 3);
+  } else if (url.compare(0, 7, "http://") == 0 || url.compare(0, 5, "ws://") == 0) {
+    ret.tls = false;
+    ret.port = "80";
+    rest = url.substr(url.find("://") + 3);
+  } else {
+    throw std::invalid_argument("URL must start with http(s):// or ws(s)://: " + url);
+  }
+
+  std::size_t slash = rest.find('/');
+  std::string authority = rest.substr(0, slash);
+  ret.target = (slash == std::string::npos) ? "/" : rest.substr(slash);
+  std::size_t colon = authority.rfind(':');
+  if (colon != std::string::npos && authority.find(']', colon) == std::string::npos) {
+    ret.port = authority.substr(colon + 1);
+    authority = authority.substr(0, colon);
+  }
+  if (authority.empty() || ret.port.empty()) {
+    throw std::invalid_argument("Invalid URL: " + url);
+  }
+  ret.host = authority;
+  return ret;
+}
+
+std::string Endpoint::toURL() const {
+  std::string ret = (this->tls) ? "https://" : "http://";
+  ret += this->host;
+  if (!((this->tls && this->port == "443") || (!this->tls && this->port == "80"))) {
+    ret += ":" + this->port;
+  }
+  ret += this->target;
+  return ret;
+}
+
+namespace beast = boost::beast;
+namespace ssl = boost::asio::ssl;
+using tcp = boost::asio::ip::tcp;
+
+std::chrono::milliseconds HttpClient::connectTimeout(10000);
+std::chrono::milliseconds HttpClient::requestTimeout(30000);
+
+// Run one asynchronous operation to completion, throwing on error.
+// Beast streams only enforce their time limits on asynchronous operations.
+template <typename Op> static void runOp(boost::asio::io_context& ioc, Op op) {
+  boost::system::error_code ec;
+  op([&ec](boost::system::error_code e, auto&&...) { ec = e; });
+  ioc.restart();
+  ioc.run();
+  if (ec) throw boost::system::system_error{ec};
+}
+
+// Send the request and read the response over an already connected stream.
+template <typename Stream> static std::string doPost(
+  boost::asio::io_context& ioc, Stream& stream, const Endpoint& endpoint, const std::string& body
+) {
+  namespace http = beast::http;
+  http::request<http::string_body> req{http::verb::post, endpoint.target, 11};
+  req.set(http::field::host, endpoint.host);
+  req.set(http::field::user_agent, BOOST_BEAST_VERSION_STRING);
+  req.set(http::field::content_type, "application/json");
+  req.body() = body;
+  req.prepare_payload();
+
+  beast::flat_buffer buffer;
+  http::response<http::string_body> res;
+  beast::get_lowest_layer(stream).expires_after(HttpClient::requestTimeout);
+  runOp(ioc, [&](auto&& done){ http::async_write(stream, req, done); });
+  runOp(ioc, [&](auto&& done){ http::async_read(stream, buffer, res, done); });
+  return std::move(res.body());
+}
+
+std::string HttpClient::post(const Endpoint& endpoint, const std::string& body) {
+  boost::asio::io_context ioc;
+  tcp::resolver resolver{ioc};
+  tcp::resolver::results_type results;
+  std::string ret;
+
+  // Resolving has no stream to time it out, so it's cancelled by a timer
+  boost::asio::steady_timer timer{ioc, connectTimeout};
+  timer.async_wait([&](boost::system::error_code ec){ if (!ec) resolver.cancel(); });
+  runOp(ioc, [&](auto&& done){
+    resolver.async_resolve(endpoint.host, endpoint.port,
+      [&, done](boost::system::error_code ec, tcp::resolver::results_type r){
+        results = r;
+        timer.cancel();
+        done(ec);
+      }
+    );
+  });
+
+  if (!endpoint.tls) {
+    beast::tcp_stream stream{ioc};
+    stream.expires_after(connectTimeout);
+    runOp(ioc, [&](auto&& done){ stream.async_connect(results, done); });
+    ret = doPost(ioc, stream, endpoint, body);
+    boost::system::error_code ec;
+    stream.socket().shutdown(tcp::socket::shutdown_both, ec);
+    return ret;
+  }
+
+  // Create context and load certificates into it
+  ssl::context ctx{ssl::context::sslv23_client};
+  load_root_certificates(ctx);
+  if (endpoint.verifyTLS) ctx.set_default_verify_paths();
+  beast::ssl_stream<beast::tcp_stream> stream{ioc, ctx};
+  if (endpoint.verifyTLS) {
+    stream.set_verify_mode(ssl::verify_peer);
+    stream.set_verify_callback(ssl::rfc2818_verification(endpoint.host));
+  }
+
+  // Set SNI Hostname (many hosts need this to handshake successfully)
+  if (!SSL_set_tlsext_host_name(stream.native_handle(), endpoint.host.c_str())) {
+    boost::system::error_code ec{static_cast<int>(::ERR_get_error()), boost::asio::error::get_ssl_category()};
+    throw boost::system::system_error{ec};
+  }
+
+  // Connect, handshake and send the request
+  beast::get_lowest_layer(stream).expires_after(connectTimeout);
+  runOp(ioc, [&](auto&& done){ beast::get_lowest_layer(stream).async_connect(results, done); });
+  runOp(ioc, [&](auto&& done){ stream.async_handshake(ssl::stream_base::client, done); });
+  ret = doPost(ioc, stream, endpoint, body);
+
+  // The body was already read at this point, so errors on shutdown
+  // (usually stream_truncated, as many servers just close the connection) are ignored.
+  try {
+    beast::get_lowest_layer(stream).expires_after(connectTimeout);
+    runOp(ioc, [&](auto&& done){ stream.async_shutdown(done); });
+  } catch (std::exception const& e) {}
+  return ret;
+}
@@ -0,0 +1,67 @@
+// Copyright (c) 2020-2021 AVME Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+#ifndef HTTPCLIENT_H
+#define HTTPCLIENT_H
+
+#include <chrono>
+#include <mutex>
+#include <string>
+
+#include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <boost/beast/ssl.hpp>
+#include <boost/beast/version.hpp>
+
+#include <network/root_certificates.hpp>
+
+/**
+ * A remote HTTP(S) endpoint (e.g. the AVME API or the Graph).
+ * tls = false allows talking to plain HTTP servers (e.g. a local stub server),
+ * verifyTLS = true checks the server's certificate chain and hostname.
+ */
+struct Endpoint {
+  std::string host;
+  std::string port = "443";
+  std::string target = "/";
+  bool tls = true;
+  bool verifyTLS = false;
+
+  /**
+   * Parse an URL like "https://api.avme.io/" or "http://127.0.0.1:8545/rpc".
+   * WebSocket URLs ("wss://..." and "ws://...") are parsed the same way.
+   * Port defaults to 443 for https/wss and 80 for http/ws, and target defaults to "/".
+   * Throws std::invalid_argument if the URL is malformed.
+   * Returns the parsed endpoint (verifyTLS is left as false).
+   */
+  static Endpoint fromURL(const std::string& url);
+
+  /**
+   * Returns the endpoint as an URL string.
+   */
+  std::string toURL() const;
+};
+
+/**
+ * Class for the HTTP(S) transport shared by API and Graph.
+ */
+class HttpClient {
+  public:
+    // Time limit for resolving, connecting and the TLS handshake.
+    static std::chrono::milliseconds connectTimeout;
+
+    // Time limit for sending the request and reading the whole response.
+    static std::chrono::milliseconds requestTimeout;
+
+    /**
+     * Send an HTTP POST request with a JSON body to the given endpoint.
+     * Throws on connection or TLS errors, and when a time limit is hit.
+     * Returns the response body, whatever the HTTP status (JSON-RPC
+     * servers put their error details there).
+     */
+    static std::string post(const Endpoint& endpoint, const std::string& body);
+};
+
+#endif // HTTPCLIENT_H
@@ -0,0 +1,99 @@
+// Copyright (c) 2020-2021 AVME Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+#include "MetricsServer.h"
+
+std::unique_ptr<boost::asio::io_context> MetricsServer::ioc;
+std::unique_ptr<boost::asio::ip::tcp::acceptor> MetricsServer::acceptor;
+std::thread MetricsServer::thread;
+std::mutex MetricsServer::lock;
+
+std::chrono::seconds MetricsServer::requestTimeout(5);
+
+// A connection being answered. It's kept alive by the handlers of its pending operations.
+struct MetricsSession {
+  boost::beast::tcp_stream stream;
+  boost::beast::flat_buffer buffer;
+  boost::beast::http::request<boost::beast::http::string_body> req;
+  boost::beast::http::response<boost::beast::http::string_body> res;
+  explicit MetricsSession(boost::asio::ip::tcp::socket&& socket) : stream(std::move(socket)) {}
+};
+
+// Build the answer to a request, the metrics or a 404.
+static void buildResponse(MetricsSession& s) {
+  namespace http = boost::beast::http;
+  s.res.version(s.req.version());
+  s.res.set(http::field::server, BOOST_BEAST_VERSION_STRING);
+  if (s.req.method() == http::verb::get && s.req.target() == "/metrics") {
+    s.res.result(http::status::ok);
+    s.res.set(http::field::content_type, "text/plain; version=0.0.4");
+    s.res.body() = Metrics::toPrometheus();
+  } else {
+    s.res.result(http::status::not_found);
+    s.res.set(http::field::content_type, "text/plain");
+    s.res.body() = "Not found\n";
+  }
+  s.res.keep_alive(false);
+  s.res.prepare_payload();
+}
+
+void MetricsServer::doAccept() {
+  using tcp = boost::asio::ip::tcp;
+  namespace http = boost::beast::http;
+  acceptor->async_accept([](boost::system::error_code ec, tcp::socket socket) {
+    if (ec) return; // Acceptor was closed
+    // Reads and writes are async with a deadline, so a slow or idle
+    // client can't hold the only io thread (or stop()) hostage
+    std::shared_ptr<MetricsSession> s = std::make_shared<MetricsSession>(std::move(socket));
+    s->stream.expires_after(requestTimeout);
+    http::async_read(s->stream, s->buffer, s->req, [s](boost::system::error_code ec, std::size_t) {
+      if (ec) {
+        Utils::logToDebug("MetricsServer error: " + ec.message());
+        return;
+      }
+      try {
+        buildResponse(*s);
+      } catch (std::exception const& e) {
+        Utils::logToDebug(std::string("MetricsServer error: ") + e.what());
+        return;
+      }
+      s->stream.expires_after(requestTimeout);
+      http::async_write(s->stream, s->res, [s](boost::system::error_code ec, std::size_t) {
+        if (ec) Utils::logToDebug("MetricsServer error: " + ec.message());
+        boost::system::error_code sec;
+        s->stream.socket().shutdown(tcp::socket::shutdown_send, sec);
+      });
+    });
+    doAccept();
+  });
+}
+
+bool MetricsServer::start(unsigned short port) {
+  using tcp = boost::asio::ip::tcp;
+  std::lock_guard<std::mutex> lk(lock);
+  if (ioc != nullptr) return false;
+  try {
+    ioc.reset(new boost::asio::io_context());
+    acceptor.reset(new tcp::acceptor(
+      *ioc, tcp::endpoint(boost::asio::ip::address_v4::loopback(), port)
+    ));
+  } catch (std::exception const& e) {
+    Utils::logToDebug(std::string("Couldn't start MetricsServer: ") + e.what());
+    acceptor.reset();
+    ioc.reset();
+    return false;
+  }
+  doAccept();
+  thread = std::thread([]{ ioc->run(); });
+  Utils::logToDebug("MetricsServer listening on 127.0.0.1:" + std::to_string(port));
+  return true;
+}
+
+void MetricsServer::stop() {
+  std::lock_guard<std::mutex> lk(lock);
+  if (ioc == nullptr) return;
+  ioc->stop();
+  if (thread.joinable()) thread.join();
+  acceptor.reset();
+  ioc.reset();
+}
@@ -0,0 +1,56 @@
+// Copyright (c) 2020-2021 AVME Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+#ifndef METRICSSERVER_H
+#define METRICSSERVER_H
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <boost/asio.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <boost/beast/version.hpp>
+
+#include <core/Metrics.h>
+#include <core/Utils.h>
+
+/**
+ * Minimal local HTTP server that exposes the metrics registry
+ * in Prometheus text format at http://127.0.0.1:<port>/metrics.
+ * Only binds to the loopback interface and serves every connection
+ * asynchronously on a single thread.
+ */
+class MetricsServer {
+  private:
+    // Context, acceptor and thread of the running server, and the mutex that guards them.
+    static std::unique_ptr<boost::asio::io_context> ioc;
+    static std::unique_ptr<boost::asio::ip::tcp::acceptor> acceptor;
+    static std::thread thread;
+    static std::mutex lock;
+
+    /**
+     * Accept the next connection and answer it.
+     */
+    static void doAccept();
+
+  public:
+    // Time a client has to send its request, and then to read the answer.
+    static std::chrono::seconds requestTimeout;
+
+    /**
+     * Start the server on the given port, in a background thread.
+     * Returns true on success, false if it's already running or the port can't be bound.
+     */
+    static bool start(unsigned short port);
+
+    /**
+     * Stop the server and wait for its thread to finish.
+     */
+    static void stop();
+};
+
+#endif // METRICSSERVER_H
@@ -0,0 +1,348 @@
+// Copyright (c) 2020-2021 AVME Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+#include "WsClient.h"
+
+namespace beast = boost::beast;
+namespace websocket = boost::beast::websocket;
+namespace ssl = boost::asio::ssl;
+using tcp = boost::asio::ip::tcp;
+typedef std::function<void(boost::system::error_code)> WsDone;
+typedef std::function<void(boost::system::error_code, std::size_t)> WsIoDone;
+
+std::chrono::milliseconds WsClient::requestTimeout(10000);
+std::chrono::seconds WsClient::maxReconnectDelay(30);
+
+class WsClient::Connection {
+  public:
+    virtual ~Connection() {}
+    virtual void asyncConnect(const tcp::resolver::results_type& results, const Endpoint& endpoint, WsDone done) = 0;
+    virtual void asyncRead(beast::flat_buffer& buffer, WsIoDone done) = 0;
+    virtual void asyncWrite(const std::string& msg, WsIoDone done) = 0;
+    virtual void close() = 0;
+};
+
+// The TLS handshake is only needed for wss://, so it's a no-op for plain streams.
+static void tlsHandshake(beast::tcp_stream&, const Endpoint&, WsDone done) {
+  done(boost::system::error_code());
+}
+
+static void tlsHandshake(beast::ssl_stream<beast::tcp_stream>& stream, const Endpoint& endpoint, WsDone done) {
+  // Set SNI Hostname (many hosts need this to handshake successfully)
+  if (!SSL_set_tlsext_host_name(stream.native_handle(), endpoint.host.c_str())) {
+    done(boost::system::error_code(static_cast<int>(::ERR_get_error()), boost::asio::error::get_ssl_category()));
+    return;
+  }
+  if (endpoint.verifyTLS) {
+    stream.set_verify_mode(ssl::verify_peer);
+    stream.set_verify_callback(ssl::rfc2818_verification(endpoint.host));
+  }
+  stream.async_handshake(ssl::stream_base::client, done);
+}
+
+// Connection over a plain (beast::tcp_stream) or TLS (beast::ssl_stream) stream.
+template <typename Stream> class StreamConnection : public WsClient::Connection {
+  private:
+    websocket::stream<Stream> ws;
+
+  public:
+    template <typename... Args> explicit StreamConnection(Args&&... args)
+      : ws(std::forward<Args>(args)...) {}
+
+    void asyncConnect(const tcp::resolver::results_type& results, const Endpoint& endpoint, WsDone done) override {
+      beast::get_lowest_layer(this->ws).expires_after(std::chrono::seconds(10));
+      beast::get_lowest_layer(this->ws).async_connect(results,
+        [this, endpoint, done](boost::system::error_code ec, tcp::endpoint) {
+          if (ec) { done(ec); return; }
+          tlsHandshake(this->ws.next_layer(), endpoint, [this, endpoint, done](boost::system::error_code ec) {
+            if (ec) { done(ec); return; }
+            // The WebSocket layer has its own timeouts (and keepalive pings) from here on
+            beast::get_lowest_layer(this->ws).expires_never();
+            this->ws.set_option(websocket::stream_base::timeout::suggested(beast::role_type::client));
+            this->ws.text(true);
+            this->ws.async_handshake(endpoint.host, endpoint.target, done);
+          });
+        }
+      );
+    }
+
+    void asyncRead(beast::flat_buffer& buffer, WsIoDone done) override {
+      this->ws.async_read(buffer, done);
+    }
+
+    void asyncWrite(const std::string& msg, WsIoDone done) override {
+      this->ws.async_write(boost::asio::buffer(msg), done);
+    }
+
+    void close() override {
+      boost::system::error_code ec;
+      beast::get_lowest_layer(this->ws).socket().close(ec);
+    }
+};
+
+WsClient::WsClient(Endpoint endpoint) : endpoint(endpoint) {
+  this->thread = std::thread(&WsClient::run, this);
+}
+
+WsClient::~WsClient() {
+  this->stopping = true;
+  this->ioc.stop();
+  if (this->thread.joinable()) this->thread.join();
+  this->conn.reset();
+  onDisconnect();
+}
+
+void WsClient::post(std::string msg) {
+  boost::asio::post(this->ioc, [this, msg]() {
+    if (!this->connected) return; // Dropped, its caller was already failed
+    this->writeQueue.push_back(msg);
+    if (this->writeQueue.size() == 1) doWrite();
+  });
+}
+
+void WsClient::doWrite() {
+  if (this->writeQueue.empty() || !this->conn) return;
+  this->conn->asyncWrite(this->writeQueue.front(), [this](boost::system::error_code ec, std::size_t) {
+    if (ec) { fail(ec, "write"); return; }
+    this->writeQueue.pop_front();
+    doWrite();
+  });
+}
+
+void WsClient::doRead() {
+  this->conn->asyncRead(this->readBuffer, [this](boost::system::error_code ec, std::size_t) {
+    if (ec) { fail(ec, "read"); return; }
+    std::string msg = beast::buffers_to_string(this->readBuffer.data());
+    this->readBuffer.consume(this->readBuffer.size());
+    onMessage(msg);
+    doRead();
+  });
+}
+
+void WsClient::onMessage(const std::string& msg) {
+  json data;
+  try {
+    data = json::parse(msg);
+  } catch (std::exception const& e) {
+    Utils::logToDebug(std::string("WebSocket sent invalid JSON: ") + e.what());
+    return;
+  }
+  if (data.is_array()) {
+    for (const json& resp : data) onResponse(resp);
+    return;
+  }
+
+  // Subscription results are pushed as eth_subscription notifications
+  if (data.contains("method") && data["method"] == "eth_subscription") {
+    if (!data.contains("params") || !data["params"].contains("subscription")) return;
+    const json& params = data["params"];
+    WsHandler handler;
+    {
+      std::lock_guard<std::mutex> lk(this->lock);
+      auto it = this->serverSubs.find(params["subscription"].get<std::string>());
+      if (it == this->serverSubs.end()) return;
+      handler = this->subs[it->second].handler;
+    }
+    try {
+      if (handler) handler(params.contains("result") ? params["result"] : json());
+    } catch (std::exception const& e) {
+      Utils::logToDebug(std::string("Error in subscription handler: ") + e.what());
+    }
+    return;
+  }
+  onResponse(data);
+}
+
+void WsClient::onResponse(const json& resp) {
+  if (!resp.is_object() || !resp.contains("id") || !resp["id"].is_number()) return;
+  uint64_t id = resp["id"].get<uint64_t>();
+  std::lock_guard<std::mutex> lk(this->lock);
+
+  // Answer to an eth_subscribe: remember the node-side id
+  auto subIt = this->pendingSubs.find(id);
+  if (subIt != this->pendingSubs.end()) {
+    uint64_t localId = subIt->second;
+    this->pendingSubs.erase(subIt);
+    auto it = this->subs.find(localId);
+    if (it == this->subs.end()) return; // Cancelled in the meantime
+    if (resp.contains("result") && resp["result"].is_string()) {
+      it->second.serverId = resp["result"].get<std::string>();
+      this->serverSubs[it->second.serverId] = localId;
+    } else {
+      Utils::logToDebug("WebSocket subscription failed: " + resp.dump());
+    }
+    return;
+  }
+
+  // Answer to a call: put the caller's id back
+  auto it = this->pending.find(id);
+  if (it == this->pending.end()) return; // Timed out in the meantime
+  std::shared_ptr<PendingCall> call = it->second.first;
+  json answer = resp;
+  answer["id"] = it->second.second;
+  this->pending.erase(it);
+  call->results.push_back(answer);
+  if (--call->remaining == 0) {
+    call->promise.set_value((call->batch) ? call->results.dump() : call->results[0].dump());
+  }
+}
+
+void WsClient::sendSubscribe(uint64_t localId) {
+  uint64_t id = this->nextId++;
+  this->pendingSubs[id] = localId;
+  json req;
+  req["jsonrpc"] = "2.0";
+  req["id"] = id;
+  req["method"] = "eth_subscribe";
+  req["params"] = this->subs[localId].params;
+  post(req.dump());
+}
+
+void WsClient::onConnected() {
+  static Metrics::Gauge& connectedGauge = Metrics::gauge("avme_ws_connected");
+  connectedGauge.set(1);
+  this->established = true;
+  this->connected = true;
+  Utils::logToDebug("WebSocket connected to " + this->endpoint.host);
+  {
+    std::lock_guard<std::mutex> lk(this->lock);
+    for (const std::pair<const uint64_t, Subscription>& s : this->subs) sendSubscribe(s.first);
+  }
+  doRead();
+}
+
+void WsClient::fail(boost::system::error_code ec, const char* what) {
+  static Metrics::Gauge& connectedGauge = Metrics::gauge("avme_ws_connected");
+  connectedGauge.set(0);
+  if (!this->stopping) {
+    Utils::logToDebug(std::string("WebSocket ") + what + " failed: " + ec.message());
+  }
+  this->connected = false;
+  if (this->conn) this->conn->close();
+}
+
+void WsClient::onDisconnect() {
+  std::vector<std::shared_ptr<PendingCall>> calls;
+  {
+    std::lock_guard<std::mutex> lk(this->lock);
+    for (std::pair<const uint64_t, std::pair<std::shared_ptr<PendingCall>, json>>& p : this->pending) {
+      if (std::find(calls.begin(), calls.end(), p.second.first) == calls.end()) {
+        calls.push_back(p.second.first);
+      }
+    }
+    this->pending.clear();
+    this->pendingSubs.clear();
+    this->serverSubs.clear();
+    for (std::pair<const uint64_t, Subscription>& s : this->subs) s.second.serverId = "";
+  }
+  for (std::shared_ptr<PendingCall>& call : calls) call->promise.set_value("");
+}
+
+void WsClient::run() {
+  ssl::context ctx{ssl::context::sslv23_client};
+  load_root_certificates(ctx);
+  if (this->endpoint.verifyTLS) ctx.set_default_verify_paths();
+  tcp::resolver resolver{this->ioc};
+  std::chrono::seconds delay(1);
+
+  while (!this->stopping) {
+    // Resolve, connect and handshake, then keep reading until the connection drops
+    this->established = false;
+    if (this->endpoint.tls) {
+      this->conn.reset(new StreamConnection<beast::ssl_stream<beast::tcp_stream>>(this->ioc, ctx));
+    } else {
+      this->conn.reset(new StreamConnection<beast::tcp_stream>(this->ioc));
+    }
+    resolver.async_resolve(this->endpoint.host, this->endpoint.port,
+      [this](boost::system::error_code ec, tcp::resolver::results_type results) {
+        if (ec) { fail(ec, "resolve"); return; }
+        this->conn->asyncConnect(results, this->endpoint, [this](boost::system::error_code ec) {
+          if (ec) { fail(ec, "connect"); return; }
+          onConnected();
+        });
+      }
+    );
+    this->ioc.run();
+    this->ioc.restart();
+    this->connected = false;
+    this->conn.reset();
+    this->writeQueue.clear();
+    this->readBuffer.consume(this->readBuffer.size());
+    onDisconnect();
+    if (this->stopping) break;
+
+    // Retry right away after a working connection dropped, back off while it keeps failing
+    static Metrics::Counter& reconnects = Metrics::counter("avme_ws_reconnects_total");
+    reconnects.inc();
+    delay = (this->established) ? std::chrono::seconds(1) : std::min(delay * 2, maxReconnectDelay);
+    auto until = std::chrono::steady_clock::now() + delay;
+    while (!this->stopping && std::chrono::steady_clock::now() < until) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+  }
+}
+
+std::string WsClient::call(const std::string& reqBody) {
+  if (!this->connected) return "";
+  json req;
+  try {
+    req = json::parse(reqBody);
+  } catch (std::exception const& e) {
+    return "";
+  }
+
+  // Every request gets a unique id on the wire, the caller's id is kept to be put back
+  std::shared_ptr<PendingCall> call = std::make_shared<PendingCall>();
+  std::future<std::string> answer = call->promise.get_future();
+  std::vector<uint64_t> ids;
+  {
+    std::lock_guard<std::mutex> lk(this->lock);
+    auto remap = [&](json& r) {
+      uint64_t id = this->nextId++;
+      this->pending[id] = std::make_pair(call, (r.contains("id")) ? r["id"] : json());
+      r["id"] = id;
+      ids.push_back(id);
+    };
+    if (req.is_array()) {
+      call->batch = true;
+      for (json& r : req) remap(r);
+    } else {
+      remap(req);
+    }
+    call->remaining = ids.size();
+  }
+  if (ids.empty()) return "[]";
+  post(req.dump());
+
+  if (answer.wait_for(requestTimeout) != std::future_status::ready) {
+    std::lock_guard<std::mutex> lk(this->lock);
+    for (uint64_t id : ids) this->pending.erase(id);
+    // The answer may have completed right before the ids were removed
+    if (answer.wait_for(std::chrono::seconds(0)) != std::future_status::ready) return "";
+  }
+  return answer.get();
+}
+
+uint64_t WsClient::subscribe(const json& params, WsHandler handler) {
+  std::lock_guard<std::mutex> lk(this->lock);
+  uint64_t localId = this->nextSubId++;
+  this->subs[localId] = {params, handler, ""};
+  if (this->connected) sendSubscribe(localId);
+  return localId;
+}
+
+void WsClient::unsubscribe(uint64_t id) {
+  std::lock_guard<std::mutex> lk(this->lock);
+  auto it = this->subs.find(id);
+  if (it == this->subs.end()) return;
+  if (!it->second.serverId.empty()) {
+    this->serverSubs.erase(it->second.serverId);
+    json req;
+    req["jsonrpc"] = "2.0";
+    req["id"] = this->nextId++;
+    req["method"] = "eth_unsubscribe";
+    req["params"] = {it->second.serverId};
+    post(req.dump());
+  }
+  this->subs.erase(it);
+}
@@ -0,0 +1,166 @@
+// Copyright (c) 2020-2021 AVME Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file LICENSE or http://www.opensource.org/licenses/mit-license.php.
+#ifndef WSCLIENT_H
+#define WSCLIENT_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/ssl.hpp>
+#include <boost/beast/websocket.hpp>
+#include <boost/beast/websocket/ssl.hpp>
+
+#include <core/Utils.h>
+#include <network/HttpClient.h>
+#include <lib/nlohmann_json/json.hpp>
+
+// For convenience.
+using json = nlohmann::json;
+
+// Callback for the results pushed by a subscription.
+typedef std::function<void(const json&)> WsHandler;
+
+/**
+ * JSON-RPC client over a single long-lived WebSocket connection.
+ * Requests from any thread are multiplexed on the connection: their ids are
+ * rewritten to unique ones on the way out and restored on the way back, so
+ * callers can keep using their own ids (and batches) as with HTTP.
+ * Subscriptions (eth_subscribe) push their results to a handler, and are
+ * set up again automatically whenever the connection is re-established.
+ * All socket I/O happens on a background thread, which reconnects with
+ * exponential backoff if the connection drops.
+ */
+class WsClient {
+  public:
+    // A connected WebSocket stream, plain or TLS.
+    class Connection;
+
+  private:
+    // A request waiting for its answers, shared by all ids of a batch.
+    struct PendingCall {
+      std::promise<std::string> promise;
+      json results = json::array();
+      size_t remaining = 0;
+      bool batch = false;
+    };
+
+    // A subscription and the id the node gave it on the current connection.
+    struct Subscription {
+      json params;
+      WsHandler handler;
+      std::string serverId;
+    };
+
+    Endpoint endpoint;
+
+    // I/O thread and its context, the current connection and the outgoing messages.
+    boost::asio::io_context ioc;
+    std::thread thread;
+    std::unique_ptr<Connection> conn;
+    std::deque<std::string> writeQueue;
+    boost::beast::flat_buffer readBuffer;
+    bool established = false;
+    std::atomic<bool> connected{false};
+    std::atomic<bool> stopping{false};
+
+    // Requests waiting for answers (by wire id) and their original ids.
+    std::map<uint64_t, std::pair<std::shared_ptr<PendingCall>, json>> pending;
+
+    // Subscriptions by local id, the local ids by node-side id, and
+    // the eth_subscribe requests waiting for an answer (by wire id).
+    std::map<uint64_t, Subscription> subs;
+    std::map<std::string, uint64_t> serverSubs;
+    std::map<uint64_t, uint64_t> pendingSubs;
+
+    // Guards pending, subs, serverSubs and pendingSubs.
+    std::mutex lock;
+
+    // Id counters for wire requests and local subscriptions.
+    std::atomic<uint64_t> nextId{1};
+    uint64_t nextSubId = 1;
+
+    // Queue a message to be sent, on the I/O thread.
+    void post(std::string msg);
+
+    // Write the next queued message. Must be called on the I/O thread.
+    void doWrite();
+
+    // Read the next message. Must be called on the I/O thread.
+    void doRead();
+
+    // Handle a message from the node.
+    void onMessage(const std::string& msg);
+
+    // Handle an answer to a request.
+    void onResponse(const json& resp);
+
+    // Send eth_subscribe for a subscription. Must be called with lock held.
+    void sendSubscribe(uint64_t localId);
+
+    // Called on the I/O thread once the handshake is done.
+    void onConnected();
+
+    // Drop the connection after an I/O error. Must be called on the I/O thread.
+    void fail(boost::system::error_code ec, const char* what);
+
+    // Fail every pending request and forget the node-side subscription ids.
+    void onDisconnect();
+
+    // Connect, run and reconnect until stopped.
+    void run();
+
+  public:
+    // Time to wait for an answer before failing a request.
+    static std::chrono::milliseconds requestTimeout;
+
+    // Longest wait between reconnection attempts.
+    static std::chrono::seconds maxReconnectDelay;
+
+    /**
+     * Start connecting to the given "ws://" or "wss://" endpoint in the background.
+     */
+    explicit WsClient(Endpoint endpoint);
+    ~WsClient();
+    WsClient(const WsClient&) = delete;
+    WsClient& operator=(const WsClient&) = delete;
+
+    /**
+     * Check if the connection is currently up.
+     */
+    bool isConnected() { return this->connected; }
+
+    /**
+     * Send a JSON-RPC request body (single or batch) and wait for its answer.
+     * Returns the answer with the original ids, or an empty string if the
+     * connection is down, dropped or the request timed out.
+     */
+    std::string call(const std::string& reqBody);
+
+    /**
+     * Subscribe to a stream of events (eth_subscribe with the given params,
+     * e.g. ["newHeads"] or ["logs", {filter}]). The handler is called on the
+     * I/O thread for each result, so it should return quickly.
+     * Returns a local id for the subscription, which lasts across reconnections.
+     */
+    uint64_t subscribe(const json& params, WsHandler handler);
+
+    /**
+     * Cancel a subscription.
+     */
+    void unsubscribe(uint64_t id);
+};
+
+#endif // WSCLIENT_H
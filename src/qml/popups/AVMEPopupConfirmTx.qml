@@ -38,10 +38,10 @@ AVMEPopup {
 
   Connections {
     target: qmlApi
-    function onApiRequestAnswered(answer, requestID) {
+    function onGasLimitsEstimated(limits, requestID) {
       if (requestID == "PopupConfirmTxGas") {
-        var answerJson = JSON.parse(answer)
-        gas = Math.round(+qmlApi.uintFromHex(answerJson[0]["result"]) * 1.1)
+        // The estimate already has a safety margin, keep the given limit if it failed
+        if (limits[0] != "0") { gas = limits[0] }
         loadingFees = false
       }
     }
@@ -60,12 +60,9 @@ AVMEPopup {
       var Params = ({})
       Params["from"] = from
       Params["to"] = inputTo
-      Params["gas"] = "0x" + qmlApi.uintToHex(inputGas)
-      Params["gasPrice"] = "0x" + qmlApi.uintToHex(+inputGasPrice * 10 * 9)
       Params["value"] = "0x" + qmlApi.uintToHex(qmlApi.fixedPointToWei(inputValue, 18))
       Params["data"] = inputTxData
-      qmlApi.buildGetEstimateGasLimitReq(JSON.stringify(Params), "PopupConfirmTxGas")
-      qmlApi.doAPIRequests("PopupConfirmTxGas")
+      qmlApi.estimateGasLimits([Params], "PopupConfirmTxGas")
     }
   }
 
@@ -5,11 +5,13 @@
 #include <qmlwrap/QmlSystem.h>
 
 QString QmlSystem::getCurrentAccount() {
-  return QString::fromStdString(this->w.getCurrentAccount().first);
+  if (!this->w.hasAccountSet()) return "";
+  return QString::fromStdString(Utils::addressString(this->w.getCurrentAccount().first));
 }
 
 void QmlSystem::setCurrentAccount(QString address) {
-  this->w.setCurrentAccount(address.toStdString());
+  Address a;
+  if (Utils::parseAddress(address.toStdString(), a)) this->w.setCurrentAccount(a);
 }
 
 void QmlSystem::loadAccounts() {
@@ -18,10 +20,10 @@ void QmlSystem::loadAccounts() {
 
 QVariantList QmlSystem::listAccounts() {
   QVariantList ret;
-  for (std::pair<std::string, std::string> a : this->w.getAccounts()) {
+  for (std::pair<Address, std::string> a : this->w.getAccounts()) {
     std::string obj;
     // TODO: Use nlohmann/json
-    obj += "{\"address\": \"" + a.first;
+    obj += "{\"address\": \"" + Utils::addressString(a.first);
     obj += "\", \"name\": \"" + a.second;
     obj += "\"}";
     ret << QString::fromStdString(obj);
@@ -29,34 +31,49 @@ QVariantList QmlSystem::listAccounts() {
   return ret;
 }
 
-void QmlSystem::generateAccounts(QString seed, int idx) {
+// Convert a scanned Account to the map the Account list in QML expects.
+static QVariantMap accountRecordToMap(const AccountRecord& r) {
+  QVariantMap obj;
+  obj["idx"] = QVariant(QString::number(r.index));
+  obj["account"] = QVariant(QString::fromStdString(r.address));
+  obj["balance"] = QVariant(QString::fromStdString((r.fetched) ? Utils::weiToFixedPoint(
+    boost::lexical_cast<std::string>(r.balance), 18
+  ) : ""));
+  obj["nonce"] = QVariant(QString::fromStdString(boost::lexical_cast<std::string>(r.nonce)));
+  obj["used"] = QVariant(r.used());
+  return obj;
+}
+
+void QmlSystem::generateAccounts(QString seed, int idx, int count) {
+  // A page is at most one discovery gap long
+  uint32_t pageSize = uint32_t(std::max(0, std::min<int>(count, AccountScanner::maxGapLimit)));
   QtConcurrent::run([=](){
-    QVariantList ret;
-    std::vector<std::string> list = BIP39::generateAccountsFromSeed(seed.toStdString(), idx);
-    for (std::string s : list) {
-      QVariantMap obj;
-      std::stringstream listss(s);
-      std::string item;
-      int ct = 0;
-      while (std::getline(listss, item, ' ')) {
-        QString itemStr = QString::fromStdString(item);
-        switch (ct) {
-          case 0: obj["idx"] = QVariant(itemStr); break;
-          case 1: obj["account"] = QVariant(itemStr); break;
-          case 2: obj["balance"] = QVariant(itemStr); break;
-        }
-        ct++;
-      }
-      emit accountGenerated(obj);
+    for (const AccountRecord& r : AccountScanner::scan(seed.toStdString(), std::max(0, idx), pageSize)) {
+      emit accountGenerated(accountRecordToMap(r));
     }
   });
 }
 
+void QmlSystem::scanAccounts(QString seed, int gapLimit) {
+  QtConcurrent::run([=](){
+    int found = 0;
+    AccountScanner::discover(seed.toStdString(), uint32_t(std::max(0, gapLimit)), 1000,
+      [&](const AccountRecord& r) {
+        if (!r.used()) return;
+        found++;
+        emit accountGenerated(accountRecordToMap(r));
+      }
+    );
+    emit accountScanFinished(found);
+  });
+}
+
 void QmlSystem::generateLedgerAccounts(QString path, int idx) {
   QtConcurrent::run([=](){
     QVariantList ret;
     for (int i = idx; i < idx + 10; i++) {
       std::string fullPath = path.toStdString() + boost::lexical_cast<std::string>(i);
+      Metrics::Timer timer(Metrics::histogram("avme_ledger_exchange_seconds", "op=\"bip32_account\""));
       this->ledgerDevice.generateBip32Account(fullPath);
     }
     // TODO: convert to multirequest
@@ -102,15 +119,36 @@ void QmlSystem::createAccount(QString seed, int index, QString name, QString pas
 }
 
 void QmlSystem::importLedgerAccount(QString address, QString path) {
-  this->w.importLedgerAccount(address.toStdString(), path.toStdString());
+  Address a;
+  if (Utils::parseAddress(address.toStdString(), a)) {
+    this->w.importLedgerAccount(a, path.toStdString());
+  }
 }
 
 bool QmlSystem::eraseAccount(QString account) {
-  return this->w.eraseAccount(account.toStdString());
+  Address a;
+  return (Utils::parseAddress(account.toStdString(), a) && this->w.eraseAccount(a));
 }
 
 bool QmlSystem::accountExists(QString account) {
-  return this->w.accountExists(account.toStdString());
+  Address a;
+  return (Utils::parseAddress(account.toStdString(), a) && this->w.accountExists(a));
+}
+
+bool QmlSystem::unlockAccount(QString account, QString pass, int ttl) {
+  return this->w.unlockAccount(account.toStdString(), pass.toStdString(), std::max(ttl, 0));
+}
+
+void QmlSystem::lockAccount(QString account) {
+  this->w.lockAccount(account.toStdString());
+}
+
+void QmlSystem::lockAllAccounts() {
+  this->w.lockAllAccounts();
+}
+
+int QmlSystem::accountUnlockedFor(QString account) {
+  return this->w.accountUnlockedFor(account.toStdString());
 }
 
 QString QmlSystem::getPrivateKeys(QString account, QString pass) {
@@ -315,5 +353,6 @@ bool QmlSystem::loadTokenDB() {
 }
 
 bool QmlSystem::loadHistoryDB(QString address) {
-  return this->w.loadHistoryDB(address.toStdString());
+  Address a;
+  return (Utils::parseAddress(address.toStdString(), a) && this->w.loadHistoryDB(a));
 }
@@ -85,7 +85,6 @@ void QmlApi::buildGetTxReceiptReq(std::string txidHex, QString requestID) {
   requestListLock.unlock();
 }
 
-// TODO: implement this
 void QmlApi::buildGetEstimateGasLimitReq(QString jsonStr, QString requestID) {
   json inputParams = json::parse(jsonStr.toStdString());
   json paramsArr = json::array();
@@ -100,6 +99,25 @@ void QmlApi::buildGetEstimateGasLimitReq(QString jsonStr, QString requestID) {
   return;
 }
 
+void QmlApi::estimateGasLimits(QVariantList txs, QString requestID) {
+  std::vector<GasQuery> queries;
+  for (QVariant tx : txs) {
+    QVariantMap txMap = tx.toMap();
+    queries.push_back({
+      txMap["from"].toString().toStdString(), txMap["to"].toString().toStdString(),
+      txMap["value"].toString().toStdString(), txMap["data"].toString().toStdString()
+    });
+  }
+  QtConcurrent::run([=](){
+    std::vector<u256> limits = GasEstimator::estimate(queries);
+    QVariantList ret;
+    for (const u256& limit : limits) {
+      ret << QString::fromStdString(boost::lexical_cast<std::string>(limit));
+    }
+    emit gasLimitsEstimated(ret, requestID);
+  });
+}
+
 void QmlApi::buildARC20TokenExistsReq(std::string address, QString requestID) {
   json supplyJson, balanceJson;
   json supplyJsonArr = json::array();
@@ -15,6 +15,7 @@
 #include <QtWidgets/QApplication>
 
 #include <network/API.h>
+#include <network/GasEstimator.h>
 #include <network/Graph.h>
 #include <core/BIP39.h>
 #include <core/ABI.h>
@@ -41,6 +42,9 @@ class QmlApi : public QObject {
     // The same goes for graph requests.
     void tokenPriceHistoryAnswered(QString answer, QString requestID, int days);
 
+    // And for gas limit estimates.
+    void gasLimitsEstimated(QVariantList limits, QString requestID);
+
   public:
     /**
      * Call every request under requestList in a single connection.
@@ -77,7 +81,8 @@ class QmlApi : public QObject {
     Q_INVOKABLE void buildGetTxReceiptReq(std::string txidHex, QString requestID);
 
     /**
-     * Build request for getting the estimated gas limit.
+     * Build request for getting the estimated gas limit, as is.
+     * Prefer estimateGasLimits(), which is cached and adds a safety margin.
      * requires JSON:
      * {
      *  from: ADDRESS
@@ -91,6 +96,15 @@ class QmlApi : public QObject {
 
     Q_INVOKABLE void buildGetEstimateGasLimitReq(QString jsonStr, QString requestID);
 
+    /**
+     * Estimate the gas limits for a set of transactions, in the background.
+     * Each one is a map with "from", "to", "value" (in Wei, hex) and "data".
+     * Cached estimates are answered right away, the others are fetched in
+     * one batch request. Emits gasLimitsEstimated() with the limits as
+     * strings in the same order ("0" for the ones that failed).
+     */
+    Q_INVOKABLE void estimateGasLimits(QVariantList txs, QString requestID);
+
     /**
      * Build request for querying if an ARC20 token exists.
      */
@@ -7,11 +7,14 @@
 void QmlSystem::listAccountTransactions(QString address) {
   QtConcurrent::run([=](){
     QVariantList ret;
-    this->w.updateAllTxStatus();
+    // Pending transactions are kept up to date in the background
     this->w.loadTxHistory();
-    for (TxData tx : this->w.getCurrentAccountHistory()) {
+    std::shared_ptr<const AccountSnapshot> snapshot = this->w.getCurrentAccountSnapshot();
+    for (const TxData& tx : snapshot->history) {
       std::string obj;
       obj += "{\"txlink\": \"" + tx.txlink;
+      obj += "\", \"hash\": \"" + tx.hex;
+      obj += "\", \"replaces\": \"" + tx.replaces;
       obj += "\", \"operation\": \"" + tx.operation;
       obj += "\", \"txdata\": \"" + tx.data;
       obj += "\", \"from\": \"" + tx.from;
@@ -31,5 +34,19 @@ void QmlSystem::listAccountTransactions(QString address) {
 }
 
 void QmlSystem::updateTransactionStatus() {
-  this->w.updateAllTxStatus();
+  this->w.checkPendingTxs();
+}
+
+void QmlSystem::replaceTransaction(QString hash, bool cancel, QString pass) {
+  QtConcurrent::run([=](){
+    if (QmlSystem::getLedgerFlag()) {
+      emit txReplaced(false, "", "Replacing transactions is not supported with Ledger");
+      return;
+    }
+    std::string error;
+    std::string link = (cancel)
+      ? this->w.cancelTransaction(hash.toStdString(), pass.toStdString(), &error)
+      : this->w.speedUpTransaction(hash.toStdString(), pass.toStdString(), &error);
+    emit txReplaced(!link.empty(), QString::fromStdString(link), QString::fromStdString(error));
+  });
 }
@@ -4,8 +4,8 @@
 
 #include <qmlwrap/QmlSystem.h>
 
-QString QmlSystem::getAutomaticFee() {
-  return QString::fromStdString(API::getAutomaticFee());
+QString QmlSystem::getAutomaticFee(QString speed) {
+  return QString::fromStdString(API::getAutomaticFee(speed.toStdString()));
 }
 
 QRegExp QmlSystem::createTxRegExp(int decimals) {
@@ -94,51 +94,131 @@ void QmlSystem::makeTransaction(
       boost::lexical_cast<u256>(gasPriceStr) * raiseToPow(10, 9)
     );
 
-    // Build the transaction and data hex according to the operation
+    // Build the transaction and data hex according to the operation.
+    // The nonce comes from the Wallet's local nonce manager.
     TransactionSkeleton txSkel;
     txSkel = w.buildTransaction(fromStr, toStr, valueStr, gasStr, gasPriceStr, txDataStr);
-    emit txBuilt(txSkel.nonce != Utils::MAX_U256_VALUE());
+    bool buildSuccess = (txSkel.nonce != Utils::MAX_U256_VALUE());
+    emit txBuilt(buildSuccess);
+    if (!buildSuccess) { emit txSent(false, ""); return; }
 
-    // Sign the transaction
-    bool signSuccess;
-    std::string msg;
-    std::string signedTx;
-    if (QmlSystem::getLedgerFlag()) {
-      std::pair<bool, std::string> signStatus;
-      signStatus = this->ledgerDevice.signTransaction(
-        txSkel, this->w.getCurrentAccount().first
-      );
-      signSuccess = signStatus.first;
-      signedTx = (signSuccess) ? signStatus.second : "";
-      msg = (signSuccess) ? "Transaction signed!" : signStatus.second;
-    } else {
-      signedTx = this->w.signTransaction(txSkel, passStr);
-      signSuccess = !signedTx.empty();
-      msg = (signSuccess) ? "Transaction signed!" : "Error on signing transaction.";
-    }
-    emit txSigned(signSuccess, QString::fromStdString(msg));
+    // Unlock the Account for the duration of the operation if it's not
+    // already, so a retry below doesn't have to decrypt the key again
+    bool tempUnlock = (!QmlSystem::getLedgerFlag()
+      && this->w.accountUnlockedFor(fromStr) == 0
+      && this->w.unlockAccount(fromStr, passStr, 60));
 
-    // Send the transaction
-    std::string txLink = this->w.sendTransaction(signedTx, operationStr);
-    if (txLink.empty()) { emit txSent(false, ""); }
-    while (
-      txLink.find("Transaction nonce is too low") != std::string::npos ||
-      txLink.find("Transaction with the same hash was already imported") != std::string::npos
-    ) {
-      emit txRetry();
-      txSkel.nonce++;
+    // Sign the transaction
+    auto sign = [&](std::string& msg) {
+      std::string signedTx;
       if (QmlSystem::getLedgerFlag()) {
         std::pair<bool, std::string> signStatus;
-        signStatus = this->ledgerDevice.signTransaction(
-          txSkel, this->w.getCurrentAccount().first
-        );
-        signSuccess = signStatus.first;
-        signedTx = (signSuccess) ? signStatus.second : "";
+        {
+          Metrics::Timer timer(Metrics::histogram("avme_ledger_exchange_seconds", "op=\"sign\""));
+          signStatus = this->ledgerDevice.signTransaction(
+            txSkel, Utils::addressString(this->w.getCurrentAccount().first)
+          );
+        }
+        signedTx = (signStatus.first) ? signStatus.second : "";
+        msg = (signStatus.first) ? "Transaction signed!" : signStatus.second;
       } else {
         signedTx = this->w.signTransaction(txSkel, passStr);
+        msg = (!signedTx.empty()) ? "Transaction signed!" : "Error on signing transaction.";
       }
-      txLink = this->w.sendTransaction(signedTx, operationStr);
+      if (signedTx.empty()) this->w.releaseNonce(txSkel);
+      return signedTx;
+    };
+    std::string msg;
+    std::string signedTx = sign(msg);
+    emit txSigned(!signedTx.empty(), QString::fromStdString(msg));
+    if (signedTx.empty()) {
+      if (tempUnlock) this->w.lockAccount(fromStr);
+      emit txSent(false, "");
+      return;
     }
+
+    // Send the transaction. If the node says the nonce was already used
+    // (e.g. by a transaction sent from elsewhere), the Wallet resyncs the
+    // Account's nonces, so rebuilding once is enough to get a fresh one
+    std::string sendError;
+    std::string txLink = this->w.sendTransaction(signedTx, operationStr, &sendError);
+    if (txLink.empty() && NonceManager::isNonceError(sendError)) {
+      emit txRetry();
+      txSkel = w.buildTransaction(fromStr, toStr, valueStr, gasStr, gasPriceStr, txDataStr);
+      if (txSkel.nonce != Utils::MAX_U256_VALUE()) {
+        signedTx = sign(msg);
+        if (!signedTx.empty()) txLink = this->w.sendTransaction(signedTx, operationStr);
+      }
+    }
+    if (tempUnlock) this->w.lockAccount(fromStr);
+    if (txLink.empty()) { emit txSent(false, ""); return; }
     emit txSent(true, QString::fromStdString(txLink));
   });
 }
+
+void QmlSystem::makeTransactions(QVariantList txs, QString pass) {
+  QtConcurrent::run([=](){
+    std::string passStr = pass.toStdString();
+    std::vector<TransactionSkeleton> txSkels;
+    std::vector<std::string> operations;
+
+    // Build all transactions, values are converted to Wei like in makeTransaction().
+    // Nonces are reserved afterwards for the whole batch at once
+    for (const QVariant& item : txs) {
+      QVariantMap tx = item.toMap();
+      std::string valueStr = Utils::fixedPointToWei(tx["value"].toString().toStdString(), 18);
+      std::string gasPriceStr = boost::lexical_cast<std::string>(
+        boost::lexical_cast<u256>(tx["gasPrice"].toString().toStdString()) * raiseToPow(10, 9)
+      );
+      txSkels.push_back(this->w.buildTransaction(
+        tx["from"].toString().toStdString(), tx["to"].toString().toStdString(),
+        valueStr, tx["gas"].toString().toStdString(), gasPriceStr,
+        tx["txData"].toString().toStdString(), false
+      ));
+      operations.push_back(tx["operation"].toString().toStdString());
+    }
+    bool buildSuccess = (!txSkels.empty() && std::none_of(txSkels.begin(), txSkels.end(),
+      [](const TransactionSkeleton& txSkel){ return txSkel.nonce == Utils::MAX_U256_VALUE(); }
+    ) && this->w.reserveNonces(txSkels));
+    emit txBuilt(buildSuccess);
+    if (!buildSuccess) { emit txBatchSent(false, QVariantList()); return; }
+
+    // Sign all transactions. The Ledger signs them one at a time, the
+    // Wallet signs them in parallel with the key decrypted only once
+    std::vector<std::string> signedTxs;
+    if (QmlSystem::getLedgerFlag()) {
+      for (const TransactionSkeleton& txSkel : txSkels) {
+        Metrics::Timer timer(Metrics::histogram("avme_ledger_exchange_seconds", "op=\"sign\""));
+        std::pair<bool, std::string> signStatus = this->ledgerDevice.signTransaction(
+          txSkel, Utils::addressString(this->w.getCurrentAccount().first)
+        );
+        signedTxs.push_back((signStatus.first) ? signStatus.second : "");
+      }
+    } else {
+      signedTxs = this->w.signTransactions(txSkels, passStr);
+    }
+
+    // A transaction that couldn't be signed breaks the nonce sequence,
+    // so the batch is only sent if every transaction was signed
+    bool signSuccess = std::none_of(signedTxs.begin(), signedTxs.end(),
+      [](const std::string& tx){ return tx.empty(); }
+    );
+    std::string msg = (signSuccess) ? "Transactions signed!" : "Error on signing transactions.";
+    emit txSigned(signSuccess, QString::fromStdString(msg));
+    if (!signSuccess) {
+      for (auto it = txSkels.rbegin(); it != txSkels.rend(); it++) this->w.releaseNonce(*it);
+      emit txBatchSent(false, QVariantList());
+      return;
+    }
+
+    // Send all transactions in one request
+    std::vector<std::string> txLinks = this->w.sendTransactions(signedTxs, operations);
+    QVariantList ret;
+    bool sendSuccess = true;
+    for (const std::string& txLink : txLinks) {
+      ret << QString::fromStdString(txLink);
+      if (txLink.empty()) sendSuccess = false;
+    }
+    emit txBatchSent(sendSuccess, ret);
+  });
+}
@@ -7,7 +7,7 @@
 void QmlSystem::getPoolReward() {
   QtConcurrent::run([=](){
     std::string poolRewardWei = Staking::earned(
-      this->w.getCurrentAccount().first
+      Utils::addressString(this->w.getCurrentAccount().first)
     );
     std::string poolReward = Utils::weiToFixedPoint(poolRewardWei, 18);
     emit rewardUpdated(QString::fromStdString(poolReward));
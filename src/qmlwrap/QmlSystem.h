@@ -17,6 +17,7 @@
 #include <lib/ledger/ledger.h>
 
 #include <network/API.h>
+#include <core/AccountScanner.h>
 #include <core/BIP39.h>
 #include <core/Utils.h>
 #include <core/Wallet.h>
@@ -57,6 +58,7 @@ class QmlSystem : public QObject {
 
     // Account screen signals
     void accountGenerated(QVariantMap data);
+    void accountScanFinished(int found);
     void ledgerAccountGenerated(QVariantMap data);
     void accountCreated(QVariantMap data);
     void accountCreationFailed();
@@ -69,6 +71,7 @@ class QmlSystem : public QObject {
 
     // Overview screen signals
     void accountBalancesUpdated(QVariantMap data);
+    void accountBalanceChanged(QString address);
     void accountFiatBalancesUpdated(QVariantMap data);
     void walletBalancesUpdated(QVariantMap data);
     void walletFiatBalancesUpdated(QVariantMap data);
@@ -96,6 +99,9 @@ class QmlSystem : public QObject {
     void txSigned(bool b, QString msg);
     void txSent(bool b, QString linkUrl);
     void txRetry();
+    void txBatchSent(bool b, QVariantList linkUrls);
+    void txConfirmed(QString linkUrl, bool confirmed);
+    void txReplaced(bool b, QString linkUrl, QString error);
 
     // Exchange screen signals
     // TODO: split into exchangeAllowancesUpdated and stakingAllowancesUpdated
@@ -183,6 +189,12 @@ class QmlSystem : public QObject {
     // Check if given passphrase equals the Wallet's
     Q_INVOKABLE bool checkWalletPass(QString pass);
 
+    // Get a short-lived unlock token for the Wallet (empty on wrong passphrase),
+    // check if a token is still valid and revoke it, respectively
+    Q_INVOKABLE QString getWalletAuthToken(QString pass, int ttl = 60);
+    Q_INVOKABLE bool checkWalletAuthToken(QString token);
+    Q_INVOKABLE void revokeWalletAuthToken(QString token);
+
     // Get the seed for the Wallet
     Q_INVOKABLE QString getWalletSeed(QString pass);
 
@@ -208,7 +220,11 @@ class QmlSystem : public QObject {
 
     // Generate an Account list from a given seed, starting from a given index.
     // Emits accountGenerated() for each generated Account
-    Q_INVOKABLE void generateAccounts(QString seed, int idx);
+    Q_INVOKABLE void generateAccounts(QString seed, int idx, int count = 10);
+
+    // Find every used Account in a given seed (BIP44 gap limit rule).
+    // Emits accountGenerated() for each used Account, then accountScanFinished()
+    Q_INVOKABLE void scanAccounts(QString seed, int gapLimit = 20);
 
     // Same as above but for Ledger devices.
     // Emits ledgerAccountGenerated() for each generated Account
@@ -230,6 +246,13 @@ class QmlSystem : public QObject {
     // Check if Account exists
     Q_INVOKABLE bool accountExists(QString account);
 
+    // Unlock an Account for signing during a given number of seconds, lock it
+    // again / lock all Accounts, and get the remaining unlocked time
+    Q_INVOKABLE bool unlockAccount(QString account, QString pass, int ttl = 300);
+    Q_INVOKABLE void lockAccount(QString account);
+    Q_INVOKABLE void lockAllAccounts();
+    Q_INVOKABLE int accountUnlockedFor(QString account);
+
     // Get an Account's private keys
     Q_INVOKABLE QString getPrivateKeys(QString account, QString pass);
 
@@ -308,19 +331,24 @@ class QmlSystem : public QObject {
     // HISTORY SCREEN FUNCTIONS
     // ======================================================================
 
-    // List the Account's transactions, updating their statuses on the spot if required.
+    // List the Account's transactions, whose statuses are kept up to date in the background.
     // Emits historyLoaded()
     Q_INVOKABLE void listAccountTransactions(QString address);
 
-    // Update the statuses of all transactions in the list
+    // Check the statuses of all pending transactions right away.
+    // Emits txConfirmed() for each one that was confirmed or failed
     Q_INVOKABLE void updateTransactionStatus();
 
+    // Speed up (or cancel) a pending transaction by replacing it with a higher fee.
+    // Emits txReplaced(), then txConfirmed() once either of them is mined
+    Q_INVOKABLE void replaceTransaction(QString hash, bool cancel, QString pass);
+
     // ======================================================================
     // SEND SCREEN FUNCTIONS
     // ======================================================================
   
-    // Get gas price from network
-    Q_INVOKABLE QString getAutomaticFee();
+    // Get gas price from network (in Gwei), for a "slow", "normal" or "fast" transaction
+    Q_INVOKABLE QString getAutomaticFee(QString speed = "normal");
 
     // Create a RegExp for transaction amount inputs
     Q_INVOKABLE QRegExp createTxRegExp(int decimals);
@@ -349,7 +377,8 @@ class QmlSystem : public QObject {
     );
 
     // Make a transaction with the collected data.
-    // Emits txBuilt(), txSigned(), txSent() and txRetry()
+    // Emits txBuilt(), txSigned(), txSent() and txRetry(), then txConfirmed()
+    // from the background once the transaction is confirmed or failed
 
     Q_INVOKABLE void makeTransaction(
       QString operation, QString from, QString to,
@@ -357,6 +386,15 @@ class QmlSystem : public QObject {
       QString gasPrice, QString pass
     );
 
+    // Make many transactions from the same Account in one go (e.g. an approval
+    // followed by a swap, or payouts). Each item is a map with the same fields
+    // as makeTransaction(): operation, from, to, value, txData, gas and gasPrice.
+    // Nonces are consecutive, signing is parallel and all transactions are
+    // broadcast in one request.
+    // Emits txBuilt(), txSigned() and txBatchSent() with a link per transaction
+    // (empty for the ones that failed)
+    Q_INVOKABLE void makeTransactions(QVariantList txs, QString pass);
+
     // ======================================================================
     // EXCHANGE SCREEN FUNCTIONS
     // ======================================================================
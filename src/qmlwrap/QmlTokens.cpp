@@ -50,14 +50,17 @@ QString QmlSystem::getARC20TokenImage(QString address) {
 bool QmlSystem::addARC20Token(
   QString address, QString symbol, QString name, int decimals, QString avaxPairContract
 ) {
+  Address a;
+  if (!Utils::parseAddress(address.toStdString(), a)) return false;
   return QmlSystem::w.addARC20Token(
-    address.toStdString(), symbol.toStdString(), name.toStdString(),
+    a, symbol.toStdString(), name.toStdString(),
     decimals, avaxPairContract.toStdString()
   );
 }
 
 bool QmlSystem::removeARC20Token(QString address) {
-  return QmlSystem::w.removeARC20Token(address.toStdString());
+  Address a;
+  return (Utils::parseAddress(address.toStdString(), a) && QmlSystem::w.removeARC20Token(a));
 }
 
 QString QmlSystem::getAVMEAddress() {
@@ -141,8 +144,9 @@ QVariantMap QmlSystem::getARC20TokenData(QString address) {
 }
 
 bool QmlSystem::ARC20TokenWasAdded(QString address) {
-  std::string addressStr = Utils::toCamelCaseAddress(address.toStdString());
-  std::string avmeStr = Pangolin::contracts["AVME"];
-  if (addressStr == avmeStr) { return true; }
-  return QmlSystem::w.ARC20TokenWasAdded(addressStr);
+  Address a, avme;
+  if (!Utils::parseAddress(address.toStdString(), a)) { return false; }
+  Utils::parseAddress(Pangolin::contracts["AVME"], avme);
+  if (a == avme) { return true; }
+  return QmlSystem::w.ARC20TokenWasAdded(a);
 }
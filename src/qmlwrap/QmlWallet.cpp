@@ -31,6 +31,15 @@ void QmlSystem::loadWallet(QString folder, QString pass) {
   QtConcurrent::run([=](){
     std::string passStr = pass.toStdString();
     bool loadSuccess = this->w.load(folder.toStdString(), passStr);
+    if (loadSuccess) {
+      this->w.setTxListener([this](const Address& account, const TxData& tx){
+        emit txConfirmed(QString::fromStdString(tx.txlink), tx.confirmed);
+      });
+      // Token transfers pushed through the WebSocket, if it's enabled
+      this->w.setBalanceListener([this](const Address& address){
+        emit accountBalanceChanged(QString::fromStdString(Utils::addressString(address, true)));
+      });
+    }
     emit walletLoaded(loadSuccess);
   });
 }
@@ -47,6 +56,18 @@ bool QmlSystem::checkWalletPass(QString pass) {
   return this->w.auth(pass.toStdString());
 }
 
+QString QmlSystem::getWalletAuthToken(QString pass, int ttl) {
+  return QString::fromStdString(this->w.issueAuthToken(pass.toStdString(), std::max(ttl, 0)));
+}
+
+bool QmlSystem::checkWalletAuthToken(QString token) {
+  return this->w.authToken(token.toStdString());
+}
+
+void QmlSystem::revokeWalletAuthToken(QString token) {
+  this->w.revokeAuthToken(token.toStdString());
+}
+
 QString QmlSystem::getWalletSeed(QString pass) {
   std::string passStr = pass.toStdString();
   bip3x::Bip39Mnemonic::MnemonicResult mnemonic;
@@ -56,7 +77,11 @@ QString QmlSystem::getWalletSeed(QString pass) {
 
 QVariantMap QmlSystem::checkForLedger() {
   QVariantMap ret;
-  std::pair<bool, std::string> check = this->ledgerDevice.checkForDevice();
+  std::pair<bool, std::string> check;
+  {
+    Metrics::Timer timer(Metrics::histogram("avme_ledger_exchange_seconds", "op=\"check_device\""));
+    check = this->ledgerDevice.checkForDevice();
+  }
   ret.insert("state", check.first);
   ret.insert("message", QString::fromStdString(check.second));
   return ret;